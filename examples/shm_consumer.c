@@ -0,0 +1,88 @@
+/*
+ * Demo consumer for `popplershot --sink shm`: attaches to the ring, prints
+ * one line per page and a byte total when the producer finishes.
+ *
+ *   popplershot-shm-consumer [--name /popplershot] [--delay-ms N] [--unlink]
+ *
+ * --delay-ms sleeps after every page to play a slow consumer, which makes
+ * the producer's backpressure visible. tests/shm_consumer_test.sh runs it
+ * against popplershot and checks the totals it prints.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "popplershot_shm.h"
+
+static void sleep_us(long us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+}
+
+int main(int argc, char** argv) {
+    const char* name = "/popplershot";
+    long delay_ms = 0;
+    int unlink_after = 0;
+    ps_shm_consumer consumer = {0};
+    unsigned long long pages = 0, bytes = 0;
+    long idle_us = 50;
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "--delay-ms") == 0 && i + 1 < argc) {
+            delay_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--unlink") == 0) {
+            unlink_after = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--name NAME] [--delay-ms N] [--unlink]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /* The producer may not have started yet */
+    while (ps_shm_open(&consumer, name) != 0) {
+        if (errno != ENOENT && errno != EAGAIN) {
+            perror("shm_open");
+            return 1;
+        }
+        sleep_us(100000);
+    }
+
+    for (;;) {
+        int done;
+        const ps_shm_record* record = ps_shm_peek(&consumer, &done);
+        if (!record) {
+            if (done) {
+                break;
+            }
+            sleep_us(idle_us);
+            idle_us = idle_us < 5000 ? idle_us * 2 : idle_us;
+            continue;
+        }
+        idle_us = 50;
+
+        printf("%.*s page %u %dx%d %s %llu bytes\n", (int)record->name_size,
+               ps_shm_record_name(record), record->page_number, record->width, record->height,
+               record->encoder, (unsigned long long)record->payload_size);
+        pages++;
+        bytes += record->payload_size;
+        ps_shm_release(&consumer, record);
+
+        if (delay_ms > 0) {
+            sleep_us(delay_ms * 1000);
+        }
+    }
+
+    printf("%llu pages, %llu bytes\n", pages, bytes);
+    ps_shm_close(&consumer);
+    if (unlink_after) {
+        shm_unlink(name);
+    }
+    return 0;
+}
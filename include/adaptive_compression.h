@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+namespace popplershot {
+
+// Steers encoder effort from how many pages sit in the render stage versus
+// the encode stage. Occupancy is proportional to time spent per stage, so an
+// encode-heavy pipeline gets cheaper compression and a render-heavy one gets
+// the spare encoder time spent on smaller files.
+class AdaptiveCompression {
+public:
+    struct Options {
+        int min_level = 1;
+        int max_level = 9;
+        int initial_level = 6;
+        size_t max_page_bytes = 0; // Size ceiling per page, 0 means none
+    };
+
+    AdaptiveCompression();
+    explicit AdaptiveCompression(const Options& options);
+
+    void reset(const Options& options);
+
+    void render_started();
+    void render_finished();
+    void encode_started();
+    void encode_finished(size_t encoded_bytes);
+
+    int current_level() const;
+
+private:
+    void adjust();
+
+    Options options_;
+    std::atomic<int> level_;
+    std::atomic<int> rendering_;
+    std::atomic<int> encoding_;
+
+    std::mutex adjust_mutex_;
+    double encode_ratio_;      // EWMA of encode occupancy / render occupancy
+    double average_bytes_;     // EWMA of encoded page size
+    int pages_since_adjust_;
+};
+
+} // namespace popplershot
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "path_queue.h"
+
+namespace popplershot {
+
+// Finds and loads PDFs inside zip and tar archives, so bundles can be
+// converted without extracting them first. Zip archives are listed from
+// their central directory (zip64 included) and tar archives from their
+// member headers (ustar, pax and GNU long names). Stored members are
+// mapped straight from the archive; deflated zip members are inflated
+// into memory and checked against their CRC. Members are matched by name,
+// and ones with absolute or ".." paths are skipped.
+class ArchiveReader {
+public:
+    // A member's bytes, valid for the life of this object
+    class Data {
+    public:
+        Data() = default;
+        ~Data();
+        Data(const Data&) = delete;
+        Data& operator=(const Data&) = delete;
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        friend class ArchiveReader;
+        void release();
+
+        void* map_ = nullptr; // Mapping of the archive around a stored member
+        size_t map_length_ = 0;
+        std::vector<char> buffer_; // Inflated, or read where there is no mmap
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Name ends in ".zip" or ".tar", any case
+    static bool has_archive_extension(const char* name, size_t length);
+    // Appends the PDF members of the archive at path
+    static bool list(const std::string& path, std::vector<ArchiveMember>& members);
+    // Queues each PDF member of path as a document of its own; false once
+    // the queue has closed
+    static bool queue_members(const std::string& path, PathQueue& queue);
+    static bool read(const std::string& path, const ArchiveMember& member, Data& data);
+
+private:
+    // Maps size bytes at offset, or reads them where there is no mmap
+    static bool map_range(const std::string& path, uint64_t offset, uint64_t size, Data& data);
+    static bool list_zip(const std::string& path, std::vector<ArchiveMember>& members);
+    static bool list_tar(const std::string& path, std::vector<ArchiveMember>& members);
+};
+
+} // namespace popplershot
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "output_sink.h"
+
+namespace popplershot {
+
+// Appends pages as stored (uncompressed) members of sharded archives, written
+// sequentially through a large buffer. Every shard gets a sidecar
+// "<shard>.idx" listing each member's data offset and size, so readers can
+// seek straight to a page without walking the archive.
+class ArchiveSink : public OutputSink {
+public:
+    explicit ArchiveSink(const Options& options);
+    ~ArchiveSink() override;
+
+    bool write(const std::string& name, EncodedPage page) override;
+    bool finish() override;
+
+protected:
+    // Format hooks; all run under the sink mutex
+    virtual const char* extension() const = 0;
+    // Bytes of header plus padding written around a member of this size
+    virtual size_t member_overhead(const std::string& name, size_t size) const = 0;
+    // Writes the member and returns the offset of its first data byte
+    virtual uint64_t write_member(const std::string& name, const std::vector<unsigned char>& data) = 0;
+    virtual void write_trailer() = 0;
+    virtual void reset_shard() {}
+
+    void append(const void* data, size_t size);
+    uint64_t shard_offset() const { return shard_offset_; }
+
+private:
+    bool open_shard();
+    bool close_shard();
+    bool flush();
+
+    Options options_;
+    std::mutex mutex_;
+    std::ofstream shard_;
+    std::string shard_path_;
+    int shard_index_;
+    uint64_t shard_offset_;
+    std::vector<unsigned char> buffer_;
+    std::string index_;
+    bool failed_;
+};
+
+// POSIX ustar members, with a pax header for names that do not fit
+class TarSink : public ArchiveSink {
+public:
+    using ArchiveSink::ArchiveSink;
+
+protected:
+    const char* extension() const override { return "tar"; }
+    size_t member_overhead(const std::string& name, size_t size) const override;
+    uint64_t write_member(const std::string& name, const std::vector<unsigned char>& data) override;
+    void write_trailer() override;
+
+private:
+    void write_header(const std::string& name, size_t size, char type);
+};
+
+// Stored zip members; switches to zip64 records past 65535 entries or 4 GiB
+class ZipSink : public ArchiveSink {
+public:
+    using ArchiveSink::ArchiveSink;
+
+protected:
+    const char* extension() const override { return "zip"; }
+    size_t member_overhead(const std::string& name, size_t size) const override;
+    uint64_t write_member(const std::string& name, const std::vector<unsigned char>& data) override;
+    void write_trailer() override;
+    void reset_shard() override { entries_.clear(); }
+
+private:
+    struct Entry {
+        std::string name;
+        uint32_t crc;
+        uint32_t size;
+        uint64_t header_offset;
+    };
+    std::vector<Entry> entries_;
+};
+
+} // namespace popplershot
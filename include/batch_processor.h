@@ -1,11 +1,19 @@
 #pragma once
 
+#include <map>
 #include <string>
 #include <vector>
 #include <functional>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include "checkpoint_journal.h"
+#include "conversion_index.h"
+#include "file_utils.h"
+#include "hot_folder.h"
+#include "input_order.h"
+#include "manifest_writer.h"
+#include "path_queue.h"
 #include "pdf_converter.h"
 
 namespace popplershot {
@@ -18,11 +26,20 @@ public:
         int failed_conversions;
         int total_pages_converted;
         std::vector<std::string> errors;
+        std::map<std::string, int> pages_by_encoder;
+        std::map<int, int> pages_by_compression_level;
+        int pages_refit;          // Pages re-encoded to meet max_file_size
+        int pages_over_budget;    // Pages that could not be brought under it
+        int total_encode_attempts;
+        int skipped_unchanged;    // Already converted with these options, per the index
+        int skipped_completed;    // Finished by the interrupted run being resumed
+        bool output_failed;       // Completing the sink or syncing the output failed
     };
 
     struct ProgressInfo {
         int current_file;
-        int total_files;
+        int total_files;          // Found so far while scanning
+        bool scanning;            // Discovery is still running
         std::string current_filename;
         int pages_processed;
     };
@@ -45,13 +62,69 @@ public:
                                 const PDFConverter::ConversionOptions& options,
                                 ProgressCallback progress_callback);
 
+    // Converts the documents listed in source ("-" for stdin) instead of
+    // scanning a tree; see InputList for the record format. Relative paths
+    // resolve against input_root, which output paths also mirror.
+    BatchResult process_file_list(const std::string& source,
+                                  bool nul_separated,
+                                  const std::string& input_root,
+                                  const std::string& output_dir,
+                                  const PDFConverter::ConversionOptions& options,
+                                  ProgressCallback progress_callback);
+
+    // Converts the PDFs already below input_dir, then keeps the workers
+    // running and converts new ones as they arrive until stop_watching()
+    BatchResult process_watch(const std::string& input_dir,
+                              const std::string& output_dir,
+                              const PDFConverter::ConversionOptions& options,
+                              ProgressCallback progress_callback,
+                              const HotFolder::Options& watch);
+
     void set_thread_count(int num_threads);
+    // Writes a digest manifest of every page to path; requires options.digest
+    void set_manifest_path(const std::string& path);
+    // Places each document's pages in levels of hashed bucket directories
+    // instead of mirroring the input tree (0) and writes <output>/layout.tsv
+    void set_layout_levels(int levels);
+    // Threads listing the input tree before conversion starts
+    void set_discovery_threads(int threads);
+    // Whether scans match PDFs by name or by their header bytes
+    void set_pdf_detection(FileUtils::PdfDetection detection);
+    // Also converts the PDFs inside .zip and .tar files found by scans and
+    // watches, naming outputs after <archive>/<member path>
+    void set_archives(bool archives);
+    // Dispatches a directory scan in on-disk order once it has finished,
+    // reading ahead of each document, instead of streaming it by path
+    void set_input_order(InputOrder::Mode order);
+    // Skips inputs converted by an earlier run with the same options, as
+    // recorded in index_path (default <output>/.popplershot-index)
+    void set_incremental(bool incremental, const std::string& index_path = "");
+    // Journals finished pages and documents to journal_path (default
+    // <output>/.popplershot-journal); resume skips what it already lists
+    void set_journal(const std::string& journal_path, bool resume);
     void cancel_processing();
+    // Ends watch mode once queued files are converted; async-signal-safe
+    void stop_watching();
 
 private:
-    void worker_thread(const std::vector<std::string>& pdf_files,
+    // Fills the queue from a directory scan or a list; false on a read error
+    using Producer = std::function<bool(PathQueue&)>;
+
+    // Queues a scanned file, or the PDFs inside it if it is an archive;
+    // false once the queue has closed
+    bool queue_file(PathQueue& pdf_files, std::string file);
+
+    BatchResult process(const std::string& input_root,
+                        const std::string& output_dir,
+                        const PDFConverter::ConversionOptions& options,
+                        ProgressCallback progress_callback,
+                        const Producer& produce,
+                        const std::string& source);
+    void worker_thread(PathQueue& pdf_files,
+                      const std::string& input_root,
                       const std::string& output_dir,
                       const PDFConverter::ConversionOptions& options,
+                      uint32_t fingerprint,
                       ProgressCallback progress_callback,
                       BatchResult& result,
                       std::mutex& result_mutex,
@@ -59,7 +132,23 @@ private:
 
     int num_threads_;
     std::atomic<bool> cancel_requested_;
+    std::atomic<bool> stop_watching_;
     PDFConverter converter_;
+    std::string manifest_path_;
+    ManifestWriter manifest_;
+    int layout_levels_;
+    ManifestWriter layout_manifest_;
+    int discovery_threads_;
+    FileUtils::PdfDetection pdf_detection_;
+    bool archives_;
+    InputOrder::Mode input_order_;
+    bool incremental_;
+    std::string index_path_;
+    ConversionIndex index_;
+    std::string journal_path_;
+    bool resume_;
+    CheckpointJournal journal_;
+    CheckpointJournal::State resume_state_;
 };
 
 } // namespace popplershot
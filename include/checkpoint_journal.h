@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace popplershot {
+
+// Append-only record of finished work, so a batch killed partway through
+// can be resumed instead of restarted. One line per event:
+//
+//   O <options fingerprint>   at the start of every run
+//   P <page> <key>            a page of a document is written
+//   F <key>                   every selected page of a document is written
+//
+// Keys escape backslash and newline. Workers only append; a background
+// thread flushes the file to disk once a second. Each line is written as it
+// happens, so a killed process loses nothing and a crashed host at most the
+// last second; a torn last line is ignored. Pages are then only as durable
+// as --durability makes them: with none, a host crash can keep a line whose
+// page was lost. Given sync_output (batch and document durability), lines
+// are instead held until the flusher has synced the pages they list, so no
+// line survives a crash that its pages did not; a killed process then loses
+// up to a second of lines, whose pages are redone.
+class CheckpointJournal {
+public:
+    // What earlier runs finished, by document key
+    struct State {
+        bool has_options = false;
+        uint32_t options = 0; // Fingerprint of the last run
+        std::unordered_set<std::string> files;
+        std::unordered_map<std::string, std::vector<int>> pages; // Only unfinished documents
+    };
+
+    CheckpointJournal();
+    ~CheckpointJournal();
+    CheckpointJournal(const CheckpointJournal&) = delete;
+    CheckpointJournal& operator=(const CheckpointJournal&) = delete;
+
+    // Reads the journal at path; false if it does not exist or cannot be read
+    static bool load(const std::string& path, State& state);
+
+    // Starts a run, continuing the journal when append and replacing it
+    // otherwise; sync_output makes the pages written so far durable
+    bool open(const std::string& path, bool append, uint32_t options,
+              std::function<bool()> sync_output = nullptr);
+    // Flushes to disk and closes
+    bool close();
+    bool is_open() const { return file_ != nullptr; }
+
+    // Thread-safe
+    void page_done(const std::string& key, int page);
+    void file_done(const std::string& key);
+
+private:
+    // Called with mutex_ held
+    void record(const std::string& line);
+    void write_line(const std::string& line);
+    // Called without it
+    void flush_loop();
+    bool sync();
+
+    std::string path_;
+    std::function<bool()> sync_output_;
+    std::FILE* file_;
+    std::string held_; // Lines waiting for sync_output
+    bool dirty_;       // Lines since the last sync
+    bool stopping_;
+    bool failed_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread flusher_;
+};
+
+} // namespace popplershot
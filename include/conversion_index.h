@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+
+namespace popplershot {
+
+// Persistent record of which inputs have been converted, so reruns skip
+// unchanged documents without looking at their outputs. The file is one
+// memory-mapped open-addressing hash table with linear probing: a 64-byte
+// header followed by fixed 40-byte slots keyed by a 64-bit hash of the
+// input's key (plus a 32-bit check hash), each holding the input's mtime,
+// size, content hash and a fingerprint of the options it was converted
+// with. Lookups take one probe sequence in memory; the table doubles into
+// a fresh file once three quarters full. A slot's key is written last, so
+// a crash leaves at worst an entry that reads as empty or stale, which
+// only costs a reconversion.
+class ConversionIndex {
+public:
+    struct FileState {
+        int64_t mtime_ns;
+        uint64_t size;
+    };
+
+    ConversionIndex();
+    ~ConversionIndex();
+    ConversionIndex(const ConversionIndex&) = delete;
+    ConversionIndex& operator=(const ConversionIndex&) = delete;
+
+    // Maps path, creating it if missing; an unreadable or foreign file is
+    // replaced by an empty index
+    bool open(const std::string& path);
+    // Writes the table back and unmaps it
+    bool close();
+    bool is_open() const { return base_ != nullptr; }
+
+    // True if key was last converted from this state with these options.
+    // When only the mtime moved, compares the content hash instead (one
+    // read of the file) and refreshes the entry if the bytes are the same.
+    bool unchanged(const std::string& key, const std::string& path, const FileState& state,
+                   uint32_t options);
+    // Notes a completed conversion of path in state; thread-safe. Records
+    // nothing if path no longer has state once its bytes are hashed, so a
+    // document edited while it was converted is converted again next run.
+    void record(const std::string& key, const std::string& path, const FileState& state,
+                uint32_t options);
+
+    size_t size() const;
+
+    static bool stat_file(const std::string& path, FileState& state);
+    // XXH3 of the file's contents, 0 if it cannot be read
+    static uint64_t hash_file(const std::string& path);
+    // Condenses a description of the output settings into the options value
+    static uint32_t fingerprint(const std::string& settings);
+    static bool supported();
+
+private:
+    struct Header;
+    struct Slot;
+
+    bool map(const std::string& path, uint64_t capacity, bool create);
+    void unmap();
+    Slot* find(uint64_t key, uint32_t check) const;
+    // Doubles the table into a new file; caller holds the lock exclusively
+    bool grow();
+
+    std::string path_;
+    mutable std::shared_mutex mutex_;
+    unsigned char* base_;
+    size_t length_;
+    Header* header_;
+    Slot* slots_;
+};
+
+} // namespace popplershot
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+namespace popplershot {
+
+// Instruction set extensions usable by this process: reported by cpuid and,
+// for AVX state, enabled by the OS through XCR0
+struct CpuFeatures {
+    bool sse2 = false;
+    bool ssse3 = false;
+    bool sse42 = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+
+    // Detected once, then cached
+    static const CpuFeatures& get();
+
+    std::string to_string() const;
+
+private:
+    static CpuFeatures detect();
+};
+
+} // namespace popplershot
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "sha256.h"
+
+struct XXH3_state_s;
+
+namespace popplershot {
+
+// Streaming checksum of encoded output, fed chunk by chunk as the bytes are
+// written so nothing has to be read back from disk
+class Digest {
+public:
+    enum class Algorithm {
+        None,
+        Xxh3,   // 64-bit XXH3, fastest
+        Crc32c, // Castagnoli CRC, hardware accelerated on SSE4.2
+        Sha256
+    };
+
+    explicit Digest(Algorithm algorithm);
+    ~Digest();
+
+    void update(const void* data, size_t size);
+    // Lowercase hex of the digest; empty for Algorithm::None
+    std::string finish();
+
+    static bool parse_algorithm(const std::string& name, Algorithm& algorithm);
+    static const char* to_string(Algorithm algorithm);
+
+    // For outputs this process did not write itself (formats poppler saves)
+    static bool of_file(const std::string& path, Algorithm algorithm, std::string& hex);
+
+private:
+    struct XxhStateDeleter {
+        void operator()(XXH3_state_s* state) const;
+    };
+
+    Algorithm algorithm_;
+    uint32_t crc_;
+    std::unique_ptr<Sha256> sha_;
+    std::unique_ptr<XXH3_state_s, XxhStateDeleter> xxh_;
+};
+
+} // namespace popplershot
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace popplershot {
+
+// An encoded image and where it goes
+struct EncodedPage {
+    std::string path;
+    std::vector<unsigned char> data;
+
+    // Stored alongside the image by sinks that keep metadata
+    std::string source;  // File name of the PDF the page came from
+    int page_number = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;    // Bytes per pixel of raw rasters, 0 when encoded
+    std::string encoder;
+};
+
+} // namespace popplershot
@@ -2,19 +2,58 @@
 
 #include <string>
 #include <vector>
+#include "directory_walker.h"
 
 namespace popplershot {
 
 class FileUtils {
 public:
-    static std::vector<std::string> find_pdf_files(const std::string& directory);
+    // How discovery decides that a file is a PDF
+    enum class PdfDetection {
+        Extension, // Name ends in .pdf, any case
+        Magic      // "%PDF-" within the first 1 KiB, whatever the name
+    };
+
+    // Every PDF below directory, sorted, listed by threads walker threads
+    static std::vector<std::string> find_pdf_files(const std::string& directory, int threads = 8,
+                                                   PdfDetection detection = PdfDetection::Extension);
+    // Streams each directory's PDFs to visit as the walk finds them; visit
+    // and any header reads run on walker threads. With archives, .zip and
+    // .tar files are passed on too, for the caller to look inside.
+    static bool scan_pdf_files(const std::string& directory, int threads,
+                               const DirectoryWalker::Visitor& visit,
+                               PdfDetection detection = PdfDetection::Extension,
+                               bool archives = false);
+    // Name ends in ".pdf", any case, with something before it
+    static bool has_pdf_extension(const char* name, size_t length);
+    // Reads the first 1 KiB of path in one call and looks for "%PDF-",
+    // which readers accept anywhere in that window
+    static bool has_pdf_header(const std::string& path);
+    static bool parse_pdf_detection(const std::string& name, PdfDetection& detection);
     static bool create_directories(const std::string& path);
     static bool file_exists(const std::string& path);
+    // Truncates path after its last newline, dropping a line cut short by a
+    // crash before more are appended; a missing file is fine
+    static bool drop_torn_line(const std::string& path);
     static bool is_directory(const std::string& path);
     static std::string get_filename_without_extension(const std::string& filepath);
     static std::string get_parent_directory(const std::string& filepath);
     static std::string join_path(const std::string& dir, const std::string& filename);
     static bool ensure_output_directory(const std::string& output_dir);
+    // Output directory mirroring file's location below input_root, so same-named
+    // files in different subdirectories do not collide
+    static std::string mirror_directory(const std::string& input_root,
+                                        const std::string& file,
+                                        const std::string& output_root);
+    // Output directory "<output_root>/ab/cd/.../<stem>-<hash>" for levels
+    // two-hex-digit buckets taken from a hash of file's path below
+    // input_root, keeping directories small however many documents there are
+    static std::string bucket_directory(const std::string& input_root,
+                                        const std::string& file,
+                                        const std::string& output_root,
+                                        int levels);
+    // file's path below input_root with '/' separators, or its name if outside
+    static std::string relative_path(const std::string& input_root, const std::string& file);
 };
 
 } // namespace popplershot
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include "file_utils.h"
+#include "path_queue.h"
+
+namespace popplershot {
+
+// Watches an intake directory and queues PDFs as they finish arriving, so a
+// long-running batch converts new files within a fraction of a second
+// instead of rescanning the tree on a timer. A file becomes a candidate on
+// close-after-write or on being moved in, and is queued once it has seen
+// no further events for settle_ms, so files written in several passes are
+// converted once, complete.
+//
+// inotify needs a watch per directory, added as directories appear.
+// fanotify marks the whole filesystem once and reports directory handle
+// plus name, which suits very large trees, but needs CAP_SYS_ADMIN.
+// Linux only.
+class HotFolder {
+public:
+    enum class Backend {
+        Inotify,
+        Fanotify
+    };
+
+    struct Options {
+        Backend backend = Backend::Inotify;
+        int settle_ms = 250; // Quiet time after a file's last event before it is queued
+        FileUtils::PdfDetection detection = FileUtils::PdfDetection::Extension;
+        bool archives = false; // Queue the PDFs inside arriving .zip and .tar files
+    };
+
+    HotFolder(const std::string& root, const Options& options);
+    ~HotFolder();
+    HotFolder(const HotFolder&) = delete;
+    HotFolder& operator=(const HotFolder&) = delete;
+
+    // Subscribes to events; call before scanning existing files so nothing
+    // dropped during that scan is missed
+    bool start();
+    // Queues settled files until stop is set or the queue closes; false if
+    // the event stream failed
+    bool run(PathQueue& queue, const std::atomic<bool>& stop);
+
+    static bool parse_backend(const std::string& name, Backend& backend);
+    static bool supported();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Candidate {
+        Clock::time_point deadline;
+        bool closed; // Seen a close-after-write or move-in since the last write
+    };
+
+    bool add_watches(const std::string& dir);
+    void handle_inotify_events();
+    void handle_fanotify_events();
+    // Records activity on path; closed marks it complete for now
+    void touch(const std::string& path, bool closed);
+    // New directories may already hold files created before their watch
+    void touch_existing(const std::string& dir);
+    // Pushes every settled candidate; false once the queue has closed
+    bool release(PathQueue& queue, Clock::time_point now);
+    bool wanted(const std::string& path) const;
+
+    std::string root_;
+    std::string canonical_root_;           // fanotify: what resolved handles start with
+    Options options_;
+    int fd_;
+    int mount_fd_;                         // fanotify: resolves directory handles
+    std::map<int, std::string> watches_;   // inotify watch descriptor to directory
+    std::map<std::string, Candidate> candidates_;
+};
+
+} // namespace popplershot
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "palette_quantizer.h"
+#include "pixel_pipeline.h"
+
+namespace popplershot {
+
+class ImageEncoder {
+public:
+    // PNG encoders take a zlib compression level, 0-9. Rasters may be gray,
+    // RGB or RGBA as produced by PixelPipeline::prepare.
+
+    // Drops alpha from RGBA input when every pixel is opaque
+    static bool encode_png(const Raster& raster, int compression_level,
+                           std::vector<unsigned char>& out);
+
+    // Encodes a quantized image as an indexed PNG, packing indices to 1/2/4/8 bits
+    static bool encode_indexed_png(const PaletteQuantizer::Result& quantized,
+                                   int width, int height, int compression_level,
+                                   std::vector<unsigned char>& out);
+
+    // Thresholds luma at mid-gray and writes a 1-bit grayscale PNG
+    static bool encode_bilevel_png(const Raster& raster, int compression_level,
+                                   std::vector<unsigned char>& out);
+
+    // Writes a baseline JPEG, ignoring alpha; quality is 1-100 and effort uses
+    // the same 0-9 scale as PNG levels (fast DCT below 4, optimized Huffman from 7)
+    static bool encode_jpeg(const Raster& raster, int quality, int effort,
+                            std::vector<unsigned char>& out);
+};
+
+} // namespace popplershot
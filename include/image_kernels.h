@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace popplershot {
+
+// Hot pixel and byte loops with SSE2/AVX2/AVX-512 variants picked at startup
+// from CpuFeatures, so a single binary runs at full speed on every x86 host
+// and falls back to portable code elsewhere
+struct ImageKernels {
+    // Native-endian ARGB32 words to RGBA, RGB or luma bytes
+    using SwizzleFn = void (*)(const uint8_t* src, uint8_t* dst, int width);
+    // True if every RGBA pixel has alpha 255
+    using OpaqueFn = bool (*)(const uint8_t* rgba, size_t pixel_count);
+    // Continues a CRC-32C (Castagnoli); start from 0
+    using Crc32cFn = uint32_t (*)(uint32_t crc, const uint8_t* data, size_t size);
+    // Halves two RGBA rows into one; each byte is avg(avg(top), avg(bottom)) with
+    // round-half-up averages, which is exactly what pavgb computes
+    using Downsample2xFn = void (*)(const uint8_t* row0, const uint8_t* row1,
+                                    uint8_t* dst, int dst_width);
+    // PaletteQuantizer's histogram bucket of each RGBA pixel: the top 5 bits
+    // of R, G and B and 3 of alpha, as r << 13 | g << 8 | b << 3 | a
+    using HistogramKeysFn = void (*)(const uint8_t* rgba, uint32_t* keys, size_t pixel_count);
+
+    SwizzleFn argb32_to_rgba;
+    SwizzleFn argb32_to_rgb;
+    // (77 R + 150 G + 29 B) >> 8, the same luma as pixel::Luma8
+    SwizzleFn argb32_to_luma;
+    OpaqueFn all_opaque;
+    Crc32cFn crc32c;
+    Downsample2xFn downsample_2x;
+    HistogramKeysFn histogram_keys;
+
+    const char* argb32_to_rgba_variant;
+    const char* argb32_to_rgb_variant;
+    const char* argb32_to_luma_variant;
+    const char* all_opaque_variant;
+    const char* crc32c_variant;
+    const char* downsample_2x_variant;
+    const char* histogram_keys_variant;
+
+    // Best variants for this CPU, selected on first use
+    static const ImageKernels& get();
+
+    // Prints the selected variants and cross-checks every variant this CPU can
+    // run against the scalar reference; returns false on any mismatch
+    static bool verify(std::ostream& out);
+};
+
+} // namespace popplershot
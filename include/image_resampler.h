@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "pixel_pipeline.h"
+
+namespace popplershot {
+
+class ImageResampler {
+public:
+    // Box-filter downscale to width x height for any channel count. RGBA
+    // rasters are first halved with the SIMD 2x kernel while the target is at
+    // most half the current size. Returns a tightly packed raster in storage.
+    static Raster downscale(const Raster& source, int width, int height,
+                            std::vector<uint8_t>& storage);
+
+    // Expands gray or RGB rasters to tightly packed RGBA; RGBA is copied as is
+    static Raster to_rgba(const Raster& source, std::vector<uint8_t>& storage);
+};
+
+} // namespace popplershot
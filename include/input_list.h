@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include "path_queue.h"
+
+namespace popplershot {
+
+// Documents to convert, listed by a caller that already knows them instead
+// of found by walking a tree. One record per line, or per NUL-terminated
+// entry for paths that may contain newlines:
+//
+//   path[<TAB>output_dir[<TAB>pages]]
+//
+// output_dir is a directory below the output root for this document's
+// pages (empty keeps the usual layout) and pages a range list such as
+// "1-3,7,10-". Relative paths resolve against the input root.
+class InputList {
+public:
+    // Pushes records into queue as they are read from source ("-" for
+    // stdin); malformed records are logged and skipped. False if source
+    // cannot be read.
+    static bool read(const std::string& source, bool nul_separated, const std::string& input_root,
+                     PathQueue& queue);
+    // False if the record is malformed or empty
+    static bool parse_record(const std::string& record, const std::string& input_root, InputFile& file);
+};
+
+} // namespace popplershot
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace popplershot {
+
+// Orders a scanned work list by where the files sit on disk, so a cold or
+// rotational tier is read in one sweep instead of seeking between files in
+// directory-hash order. The inode order follows allocation on most local
+// filesystems; the extent order asks Linux FIEMAP for the physical offset
+// of each file's first block and falls back to the inode where the
+// filesystem cannot say.
+class InputOrder {
+public:
+    enum class Mode {
+        Scan,  // Sorted by path within each directory, dispatched as found
+        Inode,
+        Extent
+    };
+
+    static bool parse_mode(const std::string& name, Mode& mode);
+
+    // Sort key placing path among its neighbours on disk; files without an
+    // extent sort after those with one, by inode. 0 if path cannot be read.
+    static uint64_t physical_key(const std::string& path, Mode mode);
+    // Stably sorts files by physical_key, reading the keys with threads
+    static void sort(std::vector<std::string>& files, Mode mode, int threads);
+
+    // Asks the kernel to start reading length bytes at offset into the page
+    // cache, capped so a huge document does not evict the next ones
+    static void readahead(const std::string& path, uint64_t offset = 0, uint64_t length = UINT64_MAX);
+
+    // Times reading every PDF below dir, cache dropped per file, in each order
+    static void benchmark(const std::string& dir, std::ostream& out);
+};
+
+} // namespace popplershot
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifdef POPPLERSHOT_HAVE_LMDB
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lmdb.h>
+#include "output_sink.h"
+
+namespace popplershot {
+
+// Stores pages in a single-file LMDB environment "<root>/<prefix>.mdb" with
+// two databases keyed by "<relative pdf path>/<page number>":
+//   "pages" - the encoded image bytes
+//   "meta"  - "name=...\tencoder=...\twidth=...\theight=...\tbytes=..."
+// Encoder threads only queue pages; one writer thread commits them in large
+// transactions, so readers can mmap the file and get pages without copies.
+class LmdbSink : public OutputSink {
+public:
+    explicit LmdbSink(const Options& options);
+    ~LmdbSink() override;
+
+    bool write(const std::string& name, EncodedPage page) override;
+    bool finish() override;
+
+    bool is_open() const { return env_ != nullptr; }
+
+private:
+    struct Record {
+        std::string key;
+        std::string meta;
+        std::vector<unsigned char> data;
+    };
+
+    bool open();
+    void run();
+    // Puts batch in one transaction, growing the map when it is full
+    bool commit(const std::vector<Record>& batch);
+    void close();
+
+    Options options_;
+    std::string path_;
+    MDB_env* env_;
+    MDB_dbi pages_;
+    MDB_dbi meta_;
+    size_t map_size_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_; // Records queued or finishing
+    std::condition_variable space_; // Queue dropped below its byte limit
+    std::deque<Record> queue_;
+    size_t queued_bytes_;
+    bool finishing_;
+    bool failed_;
+    std::thread writer_;
+};
+
+} // namespace popplershot
+
+#endif // POPPLERSHOT_HAVE_LMDB
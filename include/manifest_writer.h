@@ -0,0 +1,45 @@
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "pdf_converter.h"
+
+namespace popplershot {
+
+// Batch manifest of written pages with paths relative to the output root.
+// The digest format has one "<digest>  <path>" line per page: the layout
+// sha256sum -c and similar checkers read, so verification needs no separate
+// hashing pass. The layout format has "<document>\t<page>\t<path>" lines
+// mapping each source page to wherever the output layout placed it.
+// A rerun that skips documents keeps the earlier lines and appends its
+// own; close then leaves one line per output path, the latest.
+class ManifestWriter {
+public:
+    enum class Format {
+        Digest,
+        Layout
+    };
+
+    bool open(const std::string& manifest_path, const std::string& output_root,
+              Format format = Format::Digest, bool keep_existing = false);
+    // Thread-safe; appends the successful pages and flushes them to the file
+    void add(const std::vector<PDFConverter::PageResult>& pages, const std::string& document = "");
+    bool close();
+
+    bool is_open() const { return file_.is_open(); }
+
+private:
+    // Rewrites the manifest with only the last line for each output path
+    bool compact();
+
+    std::ofstream file_;
+    std::string path_;
+    bool keep_existing_ = false;
+    std::string output_root_;
+    Format format_ = Format::Digest;
+    std::mutex mutex_;
+};
+
+} // namespace popplershot
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include "output_sink.h"
+
+namespace popplershot {
+
+// Content-addressed output: every page is stored once as
+// "<root>/objects/<first two hex digits>/<rest of sha256><ext>", published
+// with an atomic link so a half-written object is never visible, and pages
+// whose object already exists are not written at all. finish() writes one
+// "<root>/<relative dir>/<pdf>.objects" manifest per document with
+// "<page>\t<object path>" lines, leaving unchanged manifests untouched.
+class ObjectStoreSink : public OutputSink {
+public:
+    explicit ObjectStoreSink(const Options& options);
+
+    bool write(const std::string& name, EncodedPage page) override;
+    bool finish() override;
+
+private:
+    bool ensure_shard(const std::string& dir);
+    // Moves temp to path unless path exists; true if path holds the object
+    static bool publish(const std::string& temp, const std::string& path);
+
+    Options options_;
+    std::mutex mutex_;
+    std::unordered_set<std::string> shards_;
+    // Document manifest path -> page number -> object path
+    std::map<std::string, std::map<int, std::string>> documents_;
+    std::atomic<uint64_t> temp_counter_;
+    std::atomic<uint64_t> objects_written_;
+    std::atomic<uint64_t> objects_reused_;
+    bool failed_;
+};
+
+} // namespace popplershot
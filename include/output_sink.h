@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include "encoded_page.h"
+
+namespace popplershot {
+
+// Destination for encoded pages other than one file per page. Names are
+// relative to the output root with '/' separators. Implementations are
+// thread-safe.
+class OutputSink {
+public:
+    enum class Kind {
+        Directory, // One file per page, handled by OutputWriter itself
+        Tar,
+        Zip,
+        Lmdb,
+        Objects,   // Content-addressed, deduplicated objects/ directory
+        Shm,       // Shared-memory ring for a consumer on the same host
+        S3         // Objects uploaded to an S3-compatible endpoint
+    };
+
+    struct Options {
+        Kind kind = Kind::Directory;
+        std::string root;                  // Output directory holding the shards
+        std::string shard_prefix = "pages";
+        size_t shard_size = size_t{1} << 30; // Start a new shard beyond this
+        size_t map_size = size_t{1} << 30;   // Initial LMDB map, doubled when full
+        size_t batch_pages = 1024;           // LMDB pages per write transaction
+        size_t batch_bytes = 256 << 20;      // ... or bytes, whichever comes first
+        std::string shm_name = "/popplershot"; // POSIX shared-memory object
+        size_t shm_size = 256 << 20;         // Ring bytes, a power of two
+        std::string s3_url;                  // http(s)://host[:port]/bucket[/prefix]
+        std::string s3_region = "us-east-1";
+        int upload_threads = 16;             // Parallel uploads, one connection each
+        size_t max_inflight_bytes = 256 << 20; // write() blocks above this
+        size_t part_size = 8 << 20;          // Larger pages use multipart uploads; at least 5 MiB
+    };
+
+    virtual ~OutputSink() = default;
+
+    // False once the sink has failed; asynchronous sinks report failures of
+    // accepted pages from finish()
+    virtual bool write(const std::string& name, EncodedPage page) = 0;
+    // Like write, but the future reports whether the page was stored, which
+    // sinks storing in the background only know once they have done so
+    virtual std::future<bool> submit(const std::string& name, EncodedPage page) {
+        std::promise<bool> stored;
+        stored.set_value(write(name, std::move(page)));
+        return stored.get_future();
+    }
+    // Completes the current shard; no writes may follow
+    virtual bool finish() = 0;
+
+    // Directory yields nullptr, as does a kind that is not compiled in
+    static std::unique_ptr<OutputSink> create(const Options& options);
+    static bool parse_kind(const std::string& name, Kind& kind);
+    static bool lmdb_supported();
+    static bool s3_supported();
+};
+
+} // namespace popplershot
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include "digest.h"
+#include "encoded_page.h"
+#include "output_sink.h"
+#include "write_queue.h"
+
+namespace popplershot {
+
+// Writes encoded pages from memory. Directories are created once per run and
+// remembered, and each file is preallocated and written with a single write,
+// either on the calling thread or through a background WriteQueue, by
+// default under a temporary name that is renamed into place once complete.
+// Batch and document durability group flushes into one syncfs of the output
+// filesystem. With a sink configured, pages go to the sink instead.
+class OutputWriter {
+public:
+    OutputWriter();
+    ~OutputWriter();
+
+    // Replaces the write backend and sink; waits for writes queued on the old
+    // backend. An existing sink should be finished first.
+    bool configure(const WriteQueue::Options& options, const OutputSink::Options& sink = {});
+    const char* backend_name() const;
+
+    // Creates dir and its parents unless already known to exist; thread-safe
+    bool ensure_directory(const std::string& dir);
+
+    // Creates the parent directory if needed and feeds digest on the calling
+    // thread, then writes. The future is ready immediately without a queue,
+    // and once the page is stored with a sink that uploads in the background.
+    std::future<bool> write(EncodedPage page, Digest& digest);
+
+    // Called once every page of a document has been written
+    void document_finished();
+
+    // Waits for every queued write
+    void drain();
+    // Drains, completes the sink and makes grouped durability cover the
+    // tail of the run; false if any shard or sync failed
+    bool finish();
+    // Makes every page written so far durable with one syncfs under batch
+    // and document durability; a no-op otherwise, when pages are fsync'd one
+    // by one, left to the kernel or stored by a sink
+    bool sync();
+
+private:
+    void forget_directory(const std::string& dir);
+    void page_written();
+    bool sync_output();
+
+    std::mutex mutex_;
+    std::unordered_set<std::string> known_directories_;
+    WriteQueue::Options options_;
+    std::unique_ptr<WriteQueue> queue_;
+    std::string root_;
+    std::unique_ptr<OutputSink> sink_;
+    std::atomic<size_t> pages_since_sync_;
+    std::mutex sync_mutex_;
+    bool sync_failed_;
+};
+
+} // namespace popplershot
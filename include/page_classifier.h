@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace popplershot {
+
+class PageClassifier {
+public:
+    enum class PageClass {
+        Bilevel, // Black and white text, best as 1-bit PNG
+        Palette, // Few flat colors, best as indexed PNG
+        Photo    // Continuous tone, best as lossy JPEG
+    };
+
+    struct Classification {
+        PageClass page_class;
+        int sampled_colors;       // Distinct colors among samples, capped at 257
+        double edge_density;      // Fraction of sampled neighbors with a sharp luma step
+        double dominant_fraction; // Share of samples in the most populated luma bin
+        bool grayscale;
+    };
+
+    // Samples a sparse grid of a tightly packed RGBA raster; never touches every pixel
+    static Classification classify(const uint8_t* rgba, int width, int height);
+
+    static const char* to_string(PageClass page_class);
+};
+
+} // namespace popplershot
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace popplershot {
+
+class PaletteQuantizer {
+public:
+    struct Options {
+        int max_colors = 256;
+        bool dither = false; // Floyd-Steinberg error diffusion when approximating
+    };
+
+    struct Result {
+        std::vector<uint8_t> palette; // RGBA entries, 4 bytes each
+        std::vector<uint8_t> indices; // One palette index per pixel
+        bool exact;                   // True if every source color is in the palette
+    };
+
+    // Function overloads for convenience (default options)
+    // Input is tightly packed RGBA, 4 bytes per pixel
+    static Result quantize(const uint8_t* rgba, int width, int height);
+
+    static Result quantize(const uint8_t* rgba, int width, int height,
+                           const Options& options);
+
+    // Builds a lossless palette, bailing out as soon as more than
+    // max_colors distinct colors have been seen
+    static bool build_exact_palette(const uint8_t* rgba, size_t pixel_count,
+                                    int max_colors, Result& result);
+
+private:
+    static void median_cut(const uint8_t* rgba, int width, int height,
+                           const Options& options, Result& result);
+};
+
+} // namespace popplershot
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace popplershot {
+
+// Where a document stored inside a zip or tar archive lives
+struct ArchiveMember {
+    std::string name;         // Path inside the archive; empty for a plain file
+    uint64_t offset = 0;      // Zip: local header; tar: first data byte
+    uint64_t stored_size = 0; // Bytes in the archive
+    uint64_t size = 0;        // Bytes once inflated
+    uint32_t crc32 = 0;       // Zip only
+    int64_t mtime_ns = 0;
+    bool deflated = false;
+};
+
+// One document to convert
+struct InputFile {
+    std::string path;
+    std::string output_dir; // Below the output root; empty to mirror or bucket path
+    std::string pages;      // Page ranges such as "1-3,7"; empty for every page
+    ArchiveMember member;   // Set when path is an archive holding the document
+};
+
+// Bounded hand-off of input files from a discovery thread to the
+// conversion workers, so rendering starts with the first file found
+// instead of after the whole scan. push() blocks while the queue is full,
+// which caps memory however large the tree is.
+class PathQueue {
+public:
+    explicit PathQueue(size_t capacity);
+
+    // Blocks while full; false once closed
+    bool push(InputFile file);
+    // Blocks until a file is available; false once closed and drained
+    bool pop(InputFile& file);
+    // Ends the stream; pending files can still be popped
+    void close();
+
+    // Files pushed so far, and whether that count is final
+    size_t pushed() const;
+    bool closed() const;
+
+private:
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<InputFile> files_;
+    size_t pushed_;
+    bool closed_;
+};
+
+} // namespace popplershot
@@ -3,26 +3,65 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <poppler-document.h>
 #include <poppler-page.h>
 #include <poppler-page-renderer.h>
+#include <poppler-image.h>
+#include "adaptive_compression.h"
+#include "digest.h"
+#include "output_writer.h"
+#include "pixel_pipeline.h"
 
 namespace popplershot {
 
 class PDFConverter {
 public:
+    struct PageResult {
+        int page_number;
+        bool success;
+        std::string output_path;
+        std::string page_class; // Classifier verdict in auto mode, empty otherwise
+        std::string encoder;    // e.g. "png", "png-palette", "png-1bit", "jpeg"
+        int compression_level;  // Deflate level, or JPEG effort on the same 0-9 scale
+        int encode_attempts;    // More than one when fitting a size budget
+        double scale;           // Below 1 when shrunk to fit a size budget
+        bool within_budget;     // False if even the smallest attempt was too large
+        size_t output_bytes;
+        std::string digest;     // Hex digest of the written file, empty if disabled
+    };
+
     struct ConversionResult {
         bool success;
         std::string error_message;
         int pages_converted;
+        std::vector<PageResult> pages;
     };
 
     struct ConversionOptions {
         double dpi = 300.0;
-        std::string output_format = "png";
+        std::string output_format = "png"; // png, jpg, or auto to pick per page
+        int jpeg_quality = 85;
         bool preserve_aspect_ratio = true;
         int max_width = 0;  // 0 means no limit
         int max_height = 0; // 0 means no limit
+        bool palette = false; // Quantize PNG output to an 8-bit indexed palette
+        bool dither = false;  // Dither when the page needs more than 256 colors
+        bool grayscale = false; // Render and encode a single gray channel
+        int compression_level = 6; // 0-9; starting point when adaptive
+        bool adaptive_compression = false;
+        int min_compression_level = 1;
+        int max_compression_level = 9;
+        size_t size_ceiling = 0; // Average bytes per page to stay under, 0 means none
+        size_t max_file_size = 0; // Hard per-page byte budget, 0 means none
+        Digest::Algorithm digest = Digest::Algorithm::None; // Checksum computed while writing
+        WriteQueue::Options write_queue; // Output backend, applied by BatchProcessor
+        OutputSink::Options sink;        // Archive shards instead of files; root set by BatchProcessor
+        std::string pages; // Page ranges such as "1-3,7,10-"; empty converts every page
+        std::vector<int> done_pages; // Sorted; written by an interrupted run and skipped
+        std::function<void(const PageResult& page)> page_written; // Called in page order once each is on disk
     };
 
     PDFConverter();
@@ -36,6 +75,14 @@ public:
                                const std::string& output_dir,
                                const ConversionOptions& options);
 
+    // Converts a document already in memory, such as an archive member;
+    // data must outlive the call, and pdf_path only names the outputs
+    ConversionResult convert_pdf_data(const std::string& pdf_path,
+                                    const char* data,
+                                    size_t size,
+                                    const std::string& output_dir,
+                                    const ConversionOptions& options);
+
     // Function overloads for page conversion
     ConversionResult convert_page(const std::string& pdf_path,
                                 int page_number,
@@ -46,15 +93,52 @@ public:
                                 const std::string& output_path,
                                 const ConversionOptions& options);
 
+    // Selects how encoded pages are written; call before converting
+    bool configure_output(const WriteQueue::Options& options, const OutputSink::Options& sink = {});
+    // Waits for pending writes and completes any archive shard
+    bool finish_output();
+    // Makes the pages written so far durable
+    bool sync_output();
+
+    // Restarts adaptive compression from options; call once per batch run
+    void reset_adaptive_compression(const ConversionOptions& options);
+
+    // Expands ranges such as "1-3,7,10-" into ascending page numbers of a
+    // page_count page document, dropping pages past the end; false if
+    // malformed (page_count 0 just checks the syntax)
+    static bool select_pages(const std::string& ranges, int page_count, std::vector<int>& pages);
+
     static std::string generate_output_filename(const std::string& pdf_path, 
                                               int page_number,
                                               const std::string& extension = "png");
 
 private:
     std::unique_ptr<poppler::document> load_document(const std::string& pdf_path);
+    ConversionResult convert_document(std::unique_ptr<poppler::document> doc,
+                                    const std::string& pdf_path,
+                                    const std::string& output_dir,
+                                    const ConversionOptions& options);
     bool save_page_as_image(poppler::page* page, 
+                          const std::string& pdf_path,
                           const std::string& output_path,
-                          const ConversionOptions& options);
+                          const ConversionOptions& options,
+                          const PixelPipeline& pipeline,
+                          PageResult& page_result,
+                          std::future<bool>& written);
+    bool encode_page(const Raster& raster,
+                   const std::string& output_path,
+                   const ConversionOptions& options,
+                   EncoderKind encoder,
+                   int compression_level,
+                   PageResult& page_result,
+                   std::vector<unsigned char>& encoded);
+    bool fit_to_size(const Raster& raster,
+                   const ConversionOptions& options,
+                   PageResult& page_result,
+                   std::vector<unsigned char>& encoded);
+
+    AdaptiveCompression adaptive_;
+    OutputWriter writer_;
 };
 
 } // namespace popplershot
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <poppler-image.h>
+
+namespace popplershot {
+
+enum class OutputFormat {
+    Png,
+    Jpeg,
+    Auto,
+    Raw,  // Packed pixels without a container, for in-memory consumers
+    Other // Anything else is handed to poppler::image::save
+};
+
+enum class EncoderKind {
+    Png,
+    PalettePng,
+    Jpeg,
+    Auto,
+    Raw,
+    Poppler
+};
+
+// Read-only view of packed pixels in the layout an encoder consumes
+struct Raster {
+    const uint8_t* data;
+    int width;
+    int height;
+    size_t stride; // Bytes per row, may include padding
+    int channels;  // 1 = gray, 3 = RGB, 4 = RGBA
+
+    const uint8_t* row(int y) const { return data + static_cast<size_t>(y) * stride; }
+};
+
+namespace pixel {
+
+struct Rgba {
+    uint8_t r, g, b, a;
+};
+
+// Source layouts as rendered by poppler
+
+struct Argb32 {
+    // Native-endian 0xAARRGGBB words
+    static Rgba load(const uint8_t* row, int x) {
+        uint32_t v;
+        std::memcpy(&v, row + static_cast<size_t>(x) * 4, sizeof(v));
+        return {static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 8),
+                static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 24)};
+    }
+};
+
+struct Rgb24 {
+    static Rgba load(const uint8_t* row, int x) {
+        const uint8_t* p = row + static_cast<size_t>(x) * 3;
+        return {p[0], p[1], p[2], 255};
+    }
+};
+
+struct Bgr24 {
+    static Rgba load(const uint8_t* row, int x) {
+        const uint8_t* p = row + static_cast<size_t>(x) * 3;
+        return {p[2], p[1], p[0], 255};
+    }
+};
+
+struct Gray8 {
+    static Rgba load(const uint8_t* row, int x) {
+        return {row[x], row[x], row[x], 255};
+    }
+};
+
+struct Mono1 {
+    static Rgba load(const uint8_t* row, int x) {
+        uint8_t v = (row[x / 8] >> (7 - x % 8)) & 1 ? 255 : 0;
+        return {v, v, v, 255};
+    }
+};
+
+// Packed destination layouts handed to encoders
+
+struct Rgba8 {
+    static constexpr int channels = 4;
+    static void store(uint8_t* row, int x, Rgba p) {
+        uint8_t* d = row + static_cast<size_t>(x) * 4;
+        d[0] = p.r;
+        d[1] = p.g;
+        d[2] = p.b;
+        d[3] = p.a;
+    }
+};
+
+struct Rgb8 {
+    static constexpr int channels = 3;
+    static void store(uint8_t* row, int x, Rgba p) {
+        uint8_t* d = row + static_cast<size_t>(x) * 3;
+        d[0] = p.r;
+        d[1] = p.g;
+        d[2] = p.b;
+    }
+};
+
+struct Luma8 {
+    static constexpr int channels = 1;
+    static void store(uint8_t* row, int x, Rgba p) {
+        row[x] = static_cast<uint8_t>((p.r * 77 + p.g * 150 + p.b * 29) >> 8);
+    }
+};
+
+// One instantiation per (source, destination) pair; the loop body has no
+// format branches left in it
+template <class Src, class Dst>
+void convert_row(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        Dst::store(dst, x, Src::load(src, x));
+    }
+}
+
+} // namespace pixel
+
+using RowConverter = void (*)(const uint8_t* src, uint8_t* dst, int width);
+
+// Render format, row conversion and encoder for one output configuration,
+// resolved up front so per-page work only follows function pointers
+struct PixelPipeline {
+    OutputFormat format;
+    EncoderKind encoder;
+    poppler::image::format_enum render_format;
+    int channels; // Channels of the raster handed to the encoder
+
+    static OutputFormat parse_format(const std::string& name);
+    static PixelPipeline resolve(OutputFormat format, bool palette, bool grayscale);
+
+    // Returns nullptr when rows of the source format already match channels
+    static RowConverter select_converter(poppler::image::format_enum source, int channels);
+
+    // Produces a raster of img in the encoder layout, converting into storage
+    // only when the rendered rows cannot be passed through untouched
+    bool prepare(const poppler::image& img, std::vector<uint8_t>& storage, Raster& raster) const;
+
+    // Times RGBA->PNG, RGB->JPEG and gray->PNG on a synthetic page through
+    // the resolved pipelines and through a branchy expand-to-RGBA path
+    static void benchmark(std::ostream& out);
+};
+
+} // namespace popplershot
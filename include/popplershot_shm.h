@@ -0,0 +1,180 @@
+/*
+ * Shared-memory page ring written by `popplershot --sink shm` and read by a
+ * co-located consumer. Plain C so consumers need nothing but this header;
+ * POSIX and GCC/Clang atomics only.
+ *
+ * Layout of the object named by --shm-name:
+ *   [0, 4096)                ps_shm_header
+ *   [4096, 4096 + capacity)  ring of records, each starting on a 64-byte
+ *                            boundary: ps_shm_record, name bytes, payload
+ *
+ * Producers (any number of encoder threads) reserve space by advancing
+ * write_pos with a compare-and-swap, fill the record and publish it by
+ * storing its size last. A record that would cross the end of the ring is
+ * preceded by a PS_SHM_PAD record running to the end, so records are at
+ * most half the capacity: larger ones could need more than the whole ring
+ * with their padding. The single consumer reads records in order at
+ * read_pos and releases them by advancing it; producers wait while the ring
+ * is full, which is the backpressure.
+ */
+#ifndef POPPLERSHOT_SHM_H
+#define POPPLERSHOT_SHM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PS_SHM_MAGIC 0x52485350u /* "PSHR" */
+#define PS_SHM_VERSION 1u
+#define PS_SHM_HEADER_SIZE 4096u
+#define PS_SHM_ALIGN 64u
+
+enum {
+    PS_SHM_PAGE = 1,
+    PS_SHM_PAD = 2
+};
+
+typedef struct ps_shm_header {
+    uint32_t magic;      /* Stored last by the producer once initialized */
+    uint32_t version;
+    uint64_t capacity;   /* Ring bytes, a power of two */
+    uint64_t closed;     /* Non-zero once the producer has finished */
+    uint64_t reserved0[5];
+    uint64_t write_pos;  /* Bytes ever reserved; own cache line */
+    uint64_t reserved1[7];
+    uint64_t read_pos;   /* Bytes ever released; own cache line */
+    uint64_t reserved2[7];
+} ps_shm_header;
+
+typedef struct ps_shm_record {
+    uint32_t size;         /* Whole record incl. padding; 0 until published */
+    uint32_t type;         /* PS_SHM_PAGE or PS_SHM_PAD */
+    uint32_t page_number;
+    int32_t width;
+    int32_t height;
+    int32_t channels;      /* Bytes per pixel of "raw" payloads, else 0 */
+    uint32_t name_size;    /* Output path relative to the output directory */
+    uint32_t reserved;
+    uint64_t payload_size;
+    char encoder[16];      /* "raw", "png", "png-palette", "jpeg", ... */
+    uint64_t reserved2;
+} ps_shm_record;
+
+static inline uint64_t ps_shm_record_size(uint32_t name_size, uint64_t payload_size) {
+    uint64_t size = sizeof(ps_shm_record) + name_size + payload_size;
+    return (size + PS_SHM_ALIGN - 1) & ~(uint64_t)(PS_SHM_ALIGN - 1);
+}
+
+static inline const char* ps_shm_record_name(const ps_shm_record* record) {
+    return (const char*)(record + 1);
+}
+
+/* Raw payloads are tightly packed rows of width * channels bytes */
+static inline const unsigned char* ps_shm_record_payload(const ps_shm_record* record) {
+    return (const unsigned char*)(record + 1) + record->name_size;
+}
+
+typedef struct ps_shm_consumer {
+    void* base;
+    size_t length;
+    ps_shm_header* header;
+    unsigned char* ring;
+} ps_shm_consumer;
+
+/* Maps an existing ring; 0 on success, -1 with errno set (ENOENT or EAGAIN
+ * while the producer has not created or initialized it yet) */
+static inline int ps_shm_open(ps_shm_consumer* consumer, const char* name) {
+    struct stat st;
+    void* base;
+    ps_shm_header* header;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < PS_SHM_HEADER_SIZE) {
+        close(fd);
+        errno = EAGAIN;
+        return -1;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    header = (ps_shm_header*)base;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != PS_SHM_MAGIC ||
+        header->version != PS_SHM_VERSION ||
+        PS_SHM_HEADER_SIZE + header->capacity > (uint64_t)st.st_size) {
+        munmap(base, (size_t)st.st_size);
+        errno = EAGAIN;
+        return -1;
+    }
+    consumer->base = base;
+    consumer->length = (size_t)st.st_size;
+    consumer->header = header;
+    consumer->ring = (unsigned char*)base + PS_SHM_HEADER_SIZE;
+    return 0;
+}
+
+static inline void ps_shm_close(ps_shm_consumer* consumer) {
+    if (consumer->base) {
+        munmap(consumer->base, consumer->length);
+        consumer->base = NULL;
+    }
+}
+
+/* Zeroes the size word of every 64-byte line in [pos, pos + size), since any
+ * of them may hold a future record header, then hands the space back */
+static inline void ps_shm_advance(ps_shm_consumer* consumer, uint64_t pos, uint64_t size) {
+    uint64_t mask = consumer->header->capacity - 1;
+    uint64_t offset;
+    for (offset = 0; offset < size; offset += PS_SHM_ALIGN) {
+        *(uint32_t*)(consumer->ring + ((pos + offset) & mask)) = 0;
+    }
+    __atomic_store_n(&consumer->header->read_pos, pos + size, __ATOMIC_RELEASE);
+}
+
+/* Next published page without copying it, or NULL if there is none yet.
+ * *done becomes non-zero once the producer has closed and the ring is empty. */
+static inline const ps_shm_record* ps_shm_peek(ps_shm_consumer* consumer, int* done) {
+    ps_shm_header* header = consumer->header;
+    *done = 0;
+    for (;;) {
+        uint64_t pos = header->read_pos;
+        ps_shm_record* record = (ps_shm_record*)(consumer->ring + (pos & (header->capacity - 1)));
+        uint32_t size = __atomic_load_n(&record->size, __ATOMIC_ACQUIRE);
+        if (size == 0) {
+            /* closed is set after the last publish, so check the ring again */
+            if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&record->size, __ATOMIC_ACQUIRE) == 0 &&
+                __atomic_load_n(&header->write_pos, __ATOMIC_ACQUIRE) == pos) {
+                *done = 1;
+            }
+            return NULL;
+        }
+        if (record->type != PS_SHM_PAD) {
+            return record;
+        }
+        ps_shm_advance(consumer, pos, size);
+    }
+}
+
+/* Returns the record from ps_shm_peek to the producers */
+static inline void ps_shm_release(ps_shm_consumer* consumer, const ps_shm_record* record) {
+    ps_shm_advance(consumer, consumer->header->read_pos, record->size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POPPLERSHOT_SHM_H */
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+namespace popplershot {
+
+struct S3Credentials {
+    std::string access_key;
+    std::string secret_key;
+    std::string session_token; // Temporary credentials only
+
+    // Reads AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and AWS_SESSION_TOKEN
+    static bool from_environment(S3Credentials& credentials);
+};
+
+// AWS Signature Version 4 for S3-compatible endpoints
+class S3Signer {
+public:
+    S3Signer(S3Credentials credentials, std::string region, std::string service = "s3");
+
+    // Value of the Authorization header. headers maps lowercase names to
+    // trimmed values and must include host and x-amz-date; all are signed.
+    // uri and query are already encoded, query with its parameters sorted.
+    std::string authorization(const std::string& method, const std::string& uri,
+                              const std::string& query,
+                              const std::map<std::string, std::string>& headers,
+                              const std::string& payload_hash) const;
+
+    const S3Credentials& credentials() const { return credentials_; }
+
+    // "20150830T123600Z" for now
+    static std::string amz_date();
+    // RFC 3986 encoding of everything but unreserved characters (and '/')
+    static std::string uri_encode(const std::string& value, bool keep_slash);
+    static std::string sha256_hex(const void* data, size_t size);
+
+private:
+    static std::string hmac(const std::string& key, const std::string& message);
+
+    S3Credentials credentials_;
+    std::string region_;
+    std::string service_;
+};
+
+} // namespace popplershot
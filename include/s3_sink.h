@@ -0,0 +1,87 @@
+#pragma once
+
+#ifdef POPPLERSHOT_HAVE_CURL
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "output_sink.h"
+#include "s3_signer.h"
+
+namespace popplershot {
+
+// Uploads pages straight to an S3-compatible endpoint (AWS, MinIO, ...) as
+// "<prefix>/<name>" using path-style URLs. A pool of upload threads each
+// keeps one curl handle, so connections are reused across pages; pages up
+// to part_size go up in a single PUT, larger ones as multipart uploads.
+// write() blocks while max_inflight_bytes are queued or uploading.
+class S3Sink : public OutputSink {
+public:
+    explicit S3Sink(const Options& options);
+    ~S3Sink() override;
+
+    bool write(const std::string& name, EncodedPage page) override;
+    // The future is ready once the upload has succeeded or finally failed
+    std::future<bool> submit(const std::string& name, EncodedPage page) override;
+    // Waits for every upload; false if any failed
+    bool finish() override;
+
+    bool is_open() const { return !workers_.empty(); }
+
+    // Splits "http://host:9000/bucket/prefix" into its parts
+    static bool parse_url(const std::string& url, std::string& endpoint, std::string& host,
+                          std::string& bucket, std::string& prefix);
+
+private:
+    struct Upload {
+        std::string key;
+        std::vector<unsigned char> data;
+        std::shared_ptr<std::promise<bool>> done; // Set by submit
+    };
+
+    struct Response {
+        long status = 0;
+        std::string body;
+        std::string etag;
+    };
+
+    class Connection;
+
+    // Queues an upload, blocking while too many bytes are in flight
+    bool enqueue(Upload upload);
+    void run();
+    bool upload(Connection& connection, const Upload& upload);
+    bool upload_multipart(Connection& connection, const Upload& upload);
+    // Signs and sends one request, retrying transport errors and 5xx replies
+    bool request(Connection& connection, const std::string& method, const std::string& key,
+                 const std::string& query, const unsigned char* body, size_t size,
+                 Response& response);
+
+    Options options_;
+    std::string endpoint_;
+    std::string host_;
+    std::string bucket_;
+    std::string prefix_;
+    std::unique_ptr<S3Signer> signer_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;  // Uploads queued or stopping
+    std::condition_variable space_;  // In-flight bytes dropped
+    std::condition_variable idle_;   // Nothing queued or uploading
+    std::deque<Upload> queue_;
+    size_t inflight_bytes_;
+    size_t active_;
+    bool stopping_;
+    bool failed_;
+    std::vector<std::thread> workers_;
+};
+
+} // namespace popplershot
+
+#endif // POPPLERSHOT_HAVE_CURL
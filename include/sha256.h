@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace popplershot {
+
+// Incremental SHA-256 (FIPS 180-4)
+class Sha256 {
+public:
+    using Hash = std::array<uint8_t, 32>;
+
+    Sha256();
+
+    void update(const void* data, size_t size);
+    Hash finish();
+
+    // One-shot helpers
+    static Hash hash(const void* data, size_t size);
+    static std::string to_hex(const uint8_t* bytes, size_t size);
+
+private:
+    void compress(const uint8_t* block);
+
+    std::array<uint32_t, 8> state_;
+    std::array<uint8_t, 64> buffer_;
+    size_t buffered_;
+    uint64_t total_bytes_;
+};
+
+} // namespace popplershot
@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <string>
+#include "output_sink.h"
+#include "popplershot_shm.h"
+
+namespace popplershot {
+
+// Publishes pages into the POSIX shared-memory ring described in
+// popplershot_shm.h for a consumer on the same host. Encoder threads reserve
+// space lock-free and block with backoff while the consumer is behind.
+class ShmSink : public OutputSink {
+public:
+    explicit ShmSink(const Options& options);
+    ~ShmSink() override;
+
+    bool write(const std::string& name, EncodedPage page) override;
+    // Marks the ring closed so the consumer can stop once it has drained it
+    bool finish() override;
+
+    bool is_open() const { return header_ != nullptr; }
+
+private:
+    // Returns the ring position of size contiguous bytes, after a pad record
+    // if they would have wrapped
+    uint64_t reserve(uint64_t size);
+
+    std::string name_;
+    size_t length_;
+    ps_shm_header* header_;
+    unsigned char* ring_;
+    uint64_t capacity_;
+};
+
+} // namespace popplershot
+
+#endif // _WIN32
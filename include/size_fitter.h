@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "pixel_pipeline.h"
+
+namespace popplershot {
+
+// Re-encodes one rendered raster until it fits a byte budget: lossy encoders
+// first get a binary search over quality, then the raster is downscaled with
+// the scale estimated from how far over budget the last attempt was
+class SizeFitter {
+public:
+    struct Options {
+        size_t max_bytes = 0;
+        bool lossy = false;    // The encoder takes a quality worth searching
+        int max_quality = 85;  // Preferred quality, tried first
+        int min_quality = 30;  // Below this, shrink the image instead
+        double min_scale = 0.1;
+    };
+
+    struct Result {
+        bool fits;
+        int attempts;  // Encoder invocations
+        int quality;   // Quality of the kept attempt, 0 for lossless encoders
+        double scale;  // Linear scale of the kept attempt
+    };
+
+    // Encodes raster at quality into out; quality is ignored by lossless encoders
+    using EncodeFn = std::function<bool(const Raster& raster, int quality,
+                                        std::vector<unsigned char>& out)>;
+
+    // A non-empty out is taken as the full-scale attempt at max_quality. Leaves
+    // the best attempt in out: the highest quality that fits at the largest
+    // scale, otherwise the smallest. Returns false only if the encoder fails.
+    static bool fit(const Raster& raster, const Options& options, const EncodeFn& encode,
+                    std::vector<unsigned char>& out, Result& result);
+};
+
+} // namespace popplershot
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include "encoded_page.h"
+
+namespace popplershot {
+
+// Takes encoded pages off the encoder threads and writes them in the
+// background. On Linux the io_uring backend submits open/write/fsync/close
+// as one linked chain per page; elsewhere, or when the kernel refuses it, a
+// small thread pool does the same with blocking calls.
+class WriteQueue {
+public:
+    enum class Backend {
+        Sync,       // No queue, write on the calling thread
+        ThreadPool,
+        IoUring,
+        Auto        // io_uring when available, else the thread pool
+    };
+
+    enum class Durability {
+        None,     // Leave write-back to the kernel
+        File,     // fsync every file before it is published
+        Batch,    // syncfs the output filesystem every sync_interval pages
+        Document  // syncfs once all pages of a document are written
+    };
+
+    struct Options {
+        Backend backend = Backend::Sync;
+        bool atomic = true;                   // Write a temporary file, then rename it into place
+        Durability durability = Durability::None;
+        size_t sync_interval = 1000;          // Pages per syncfs with Durability::Batch
+        int threads = 4;                      // Thread-pool workers
+        unsigned queue_depth = 64;            // io_uring pages in flight
+        size_t max_pending_bytes = 256 << 20; // submit() blocks above this
+    };
+
+    // Runs on an I/O thread once the page is on disk (or failed)
+    using Completion = std::function<void(bool ok)>;
+
+    virtual ~WriteQueue() = default;
+
+    // Queues page; only blocks if max_pending_bytes are already queued
+    virtual void submit(EncodedPage page, Completion done) = 0;
+    virtual const char* name() const = 0;
+
+    // Blocks until every submitted page has completed
+    void drain();
+
+    // Sync yields nullptr; io_uring falls back to the thread pool when it is
+    // not compiled in or the kernel lacks direct descriptors
+    static std::unique_ptr<WriteQueue> create(const Options& options);
+
+    static bool parse_backend(const std::string& name, Backend& backend);
+    static bool parse_durability(const std::string& name, Durability& durability);
+    static bool io_uring_supported();
+
+    // Blocking preallocated single-write used by Sync and the thread pool.
+    // Atomic writes go to an unnamed O_TMPFILE (Linux) or a hidden temporary
+    // name and only appear at path once complete, so a crash never leaves a
+    // truncated file under the final name.
+    static bool write_file(const std::string& path, const std::vector<unsigned char>& data,
+                           bool fsync, bool atomic = false);
+    // Hidden sibling of path for atomic writes, unique within the process
+    static std::string temp_path(const std::string& path);
+    // Flushes the whole filesystem holding dir (syncfs on Linux)
+    static bool sync_filesystem(const std::string& dir);
+
+    // Writes count files of file_size bytes into dir with every available
+    // backend and prints files/s and MB/s for each
+    static void benchmark(const std::string& dir, int count, size_t file_size, bool fsync,
+                          std::ostream& out);
+
+protected:
+    explicit WriteQueue(const Options& options);
+
+    // Byte accounting for backpressure and drain()
+    void reserve(size_t bytes);
+    void release(size_t bytes);
+
+    Options options_;
+
+private:
+    std::mutex pending_mutex_;
+    std::condition_variable pending_cv_;
+    size_t pending_bytes_;
+    size_t pending_pages_;
+};
+
+} // namespace popplershot
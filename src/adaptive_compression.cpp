@@ -0,0 +1,97 @@
+#include "adaptive_compression.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+namespace {
+
+constexpr double kSmoothing = 0.2;
+// Pages between level changes, so one slow page cannot whipsaw the level
+constexpr int kAdjustInterval = 4;
+
+} // namespace
+
+AdaptiveCompression::AdaptiveCompression() : AdaptiveCompression(Options{}) {}
+
+AdaptiveCompression::AdaptiveCompression(const Options& options)
+    : level_(0), rendering_(0), encoding_(0) {
+    reset(options);
+}
+
+void AdaptiveCompression::reset(const Options& options) {
+    std::lock_guard<std::mutex> lock(adjust_mutex_);
+    options_ = options;
+    options_.min_level = std::clamp(options_.min_level, 0, 9);
+    options_.max_level = std::clamp(options_.max_level, options_.min_level, 9);
+    level_ = std::clamp(options_.initial_level, options_.min_level, options_.max_level);
+    encode_ratio_ = 1.0;
+    average_bytes_ = 0.0;
+    pages_since_adjust_ = 0;
+}
+
+void AdaptiveCompression::render_started() {
+    rendering_.fetch_add(1);
+}
+
+void AdaptiveCompression::render_finished() {
+    rendering_.fetch_sub(1);
+}
+
+void AdaptiveCompression::encode_started() {
+    encoding_.fetch_add(1);
+}
+
+void AdaptiveCompression::encode_finished(size_t encoded_bytes) {
+    // Failed encodes say nothing about throughput or size
+    if (encoded_bytes == 0) {
+        encoding_.fetch_sub(1);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(adjust_mutex_);
+
+    // Sample occupancy while this page still counts as encoding
+    double encode_depth = encoding_.load();
+    double render_depth = std::max(1, rendering_.load());
+    encode_ratio_ += kSmoothing * (encode_depth / render_depth - encode_ratio_);
+    average_bytes_ = average_bytes_ == 0.0
+                         ? static_cast<double>(encoded_bytes)
+                         : average_bytes_ + kSmoothing * (encoded_bytes - average_bytes_);
+    encoding_.fetch_sub(1);
+
+    if (++pages_since_adjust_ >= kAdjustInterval) {
+        pages_since_adjust_ = 0;
+        adjust();
+    }
+}
+
+int AdaptiveCompression::current_level() const {
+    return level_.load();
+}
+
+void AdaptiveCompression::adjust() {
+    int level = level_.load();
+    double ceiling = static_cast<double>(options_.max_page_bytes);
+    bool over_ceiling = ceiling > 0 && average_bytes_ > ceiling;
+    bool near_ceiling = ceiling > 0 && average_bytes_ > ceiling * 0.9;
+
+    int next = level;
+    if (over_ceiling) {
+        // Size ceiling wins over throughput
+        next = level + 1;
+    } else if (encode_ratio_ > 1.5 && !near_ceiling) {
+        next = level - 1;
+    } else if (encode_ratio_ < 0.5) {
+        next = level + 1;
+    }
+    next = std::clamp(next, options_.min_level, options_.max_level);
+
+    if (next != level) {
+        spdlog::debug("Compression level {} -> {} (encode/render occupancy {:.2f}, avg page {:.0f} bytes)",
+                      level, next, encode_ratio_, average_bytes_);
+        level_ = next;
+    }
+}
+
+} // namespace popplershot
@@ -0,0 +1,464 @@
+#include "archive_reader.h"
+#include "file_utils.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace popplershot {
+
+namespace {
+
+constexpr uint32_t kZipLocalHeader = 0x04034b50;
+constexpr uint32_t kZipCentralHeader = 0x02014b50;
+constexpr uint32_t kZipEnd = 0x06054b50;
+constexpr uint32_t kZip64End = 0x06064b50;
+constexpr uint32_t kZip64Locator = 0x07064b50;
+constexpr size_t kTarBlock = 512;
+
+uint16_t get_le16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(get_le16(p)) | (static_cast<uint32_t>(get_le16(p + 2)) << 16);
+}
+
+uint64_t get_le64(const unsigned char* p) {
+    return static_cast<uint64_t>(get_le32(p)) | (static_cast<uint64_t>(get_le32(p + 4)) << 32);
+}
+
+bool read_at(std::ifstream& file, uint64_t offset, void* buffer, size_t size) {
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(static_cast<char*>(buffer), static_cast<std::streamsize>(size));
+    return static_cast<size_t>(file.gcount()) == size;
+}
+
+// Drops a leading "./"; empty if the name would leave the archive's tree
+std::string safe_member_name(std::string name) {
+    while (name.compare(0, 2, "./") == 0) {
+        name.erase(0, 2);
+    }
+    if (name.empty() || name.front() == '/' || name.find('\\') != std::string::npos) {
+        return "";
+    }
+    for (size_t start = 0; start <= name.size();) {
+        size_t end = std::min(name.find('/', start), name.size());
+        if (name.compare(start, end - start, "..") == 0) {
+            return "";
+        }
+        start = end + 1;
+    }
+    return name;
+}
+
+bool wanted_member(std::string& name, const std::string& archive) {
+    if (!FileUtils::has_pdf_extension(name.c_str(), name.size())) {
+        return false;
+    }
+    std::string safe = safe_member_name(name);
+    if (safe.empty()) {
+        spdlog::warn("Skipping {} in {}: path leaves the archive", name, archive);
+        return false;
+    }
+    name = std::move(safe);
+    return true;
+}
+
+int64_t dos_time_ns(uint16_t time, uint16_t date) {
+    using namespace std::chrono;
+    sys_days day = year_month_day{year{1980 + (date >> 9)}, month{static_cast<unsigned>((date >> 5) & 15)},
+                                  std::chrono::day{static_cast<unsigned>(date & 31)}};
+    auto stamp = day + hours{time >> 11} + minutes{(time >> 5) & 63} + seconds{(time & 31) * 2};
+    return duration_cast<nanoseconds>(stamp.time_since_epoch()).count();
+}
+
+// Octal, or base-256 when the top bit is set (GNU, for large values)
+uint64_t tar_number(const unsigned char* field, size_t length) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < length; ++i) {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    for (size_t i = 0; i < length && field[i] != 0; ++i) {
+        if (field[i] >= '0' && field[i] <= '7') {
+            value = (value << 3) | static_cast<uint64_t>(field[i] - '0');
+        }
+    }
+    return value;
+}
+
+bool tar_checksum_ok(const unsigned char* header) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kTarBlock; ++i) {
+        sum += (i >= 148 && i < 156) ? ' ' : header[i];
+    }
+    return sum == tar_number(header + 148, 8);
+}
+
+// "path" from a pax extended header's "<length> key=value\n" records
+std::string pax_path(const std::string& records) {
+    std::string path;
+    for (size_t pos = 0; pos < records.size();) {
+        size_t space = records.find(' ', pos);
+        size_t length = std::strtoul(records.c_str() + pos, nullptr, 10);
+        if (space == std::string::npos || length == 0 || pos + length > records.size()) {
+            break;
+        }
+        std::string record = records.substr(space + 1, pos + length - space - 2);
+        if (record.compare(0, 5, "path=") == 0) {
+            path = record.substr(5);
+        }
+        pos += length;
+    }
+    return path;
+}
+
+bool is_zip(const std::string& path) {
+    return path.size() > 4 && std::tolower(static_cast<unsigned char>(path[path.size() - 3])) == 'z';
+}
+
+} // namespace
+
+bool ArchiveReader::map_range(const std::string& path, uint64_t offset, uint64_t size, Data& data) {
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    data.buffer_.resize(static_cast<size_t>(size));
+    if (!file || !read_at(file, offset, data.buffer_.data(), data.buffer_.size())) {
+        return false;
+    }
+    data.data_ = data.buffer_.data();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // Touching a mapping past the end of the file raises SIGBUS, so a range
+    // from a damaged archive, or one truncated since it was listed, is refused
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || offset > static_cast<uint64_t>(st.st_size) ||
+        size > static_cast<uint64_t>(st.st_size) - offset) {
+        spdlog::error("Archive member extends past the end of {}", path);
+        ::close(fd);
+        return false;
+    }
+    // Mappings start on a page boundary
+    uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    uint64_t start = offset & ~(page - 1);
+    size_t length = static_cast<size_t>(offset - start + std::max<uint64_t>(size, 1));
+    void* map = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(start));
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    data.map_ = map;
+    data.map_length_ = length;
+    data.data_ = static_cast<const char*>(map) + (offset - start);
+#endif
+    data.size_ = static_cast<size_t>(size);
+    return true;
+}
+
+ArchiveReader::Data::~Data() {
+    release();
+}
+
+void ArchiveReader::Data::release() {
+#ifndef _WIN32
+    if (map_) {
+        ::munmap(map_, map_length_);
+    }
+#endif
+    map_ = nullptr;
+    map_length_ = 0;
+    buffer_.clear();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool ArchiveReader::has_archive_extension(const char* name, size_t length) {
+    auto ends_with = [&](const char* suffix) {
+        for (size_t i = 0; i < 4; ++i) {
+            if (std::tolower(static_cast<unsigned char>(name[length - 4 + i])) != suffix[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    return length > 4 && (ends_with(".zip") || ends_with(".tar"));
+}
+
+bool ArchiveReader::list(const std::string& path, std::vector<ArchiveMember>& members) {
+    return is_zip(path) ? list_zip(path, members) : list_tar(path, members);
+}
+
+bool ArchiveReader::list_zip(const std::string& path, std::vector<ArchiveMember>& members) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        spdlog::error("Failed to open archive: {}", path);
+        return false;
+    }
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+
+    // The end record is 22 bytes, followed by a comment of up to 64 KiB
+    std::vector<unsigned char> tail(static_cast<size_t>(std::min<uint64_t>(file_size, 22 + 0xFFFF)));
+    if (tail.size() < 22 || !read_at(file, file_size - tail.size(), tail.data(), tail.size())) {
+        spdlog::error("Not a zip archive: {}", path);
+        return false;
+    }
+    size_t end = tail.size() - 22;
+    while (end > 0 && get_le32(&tail[end]) != kZipEnd) {
+        --end;
+    }
+    if (get_le32(&tail[end]) != kZipEnd) {
+        spdlog::error("Not a zip archive: {}", path);
+        return false;
+    }
+    uint64_t directory_size = get_le32(&tail[end + 12]);
+    uint64_t directory_offset = get_le32(&tail[end + 16]);
+
+    // Zip64 keeps the real values in a record found through the locator
+    uint64_t locator_offset = file_size - tail.size() + end;
+    unsigned char record[56];
+    if (locator_offset >= 20 && read_at(file, locator_offset - 20, record, 20) &&
+        get_le32(record) == kZip64Locator) {
+        uint64_t zip64_end = get_le64(record + 8);
+        if (!read_at(file, zip64_end, record, sizeof(record)) || get_le32(record) != kZip64End) {
+            spdlog::error("Corrupt zip64 end record in {}", path);
+            return false;
+        }
+        directory_size = get_le64(record + 40);
+        directory_offset = get_le64(record + 48);
+    }
+
+    std::vector<unsigned char> directory;
+    if (directory_offset + directory_size > file_size) {
+        spdlog::error("Corrupt central directory in {}", path);
+        return false;
+    }
+    directory.resize(static_cast<size_t>(directory_size));
+    if (!read_at(file, directory_offset, directory.data(), directory.size())) {
+        spdlog::error("Failed to read central directory of {}", path);
+        return false;
+    }
+
+    size_t skipped = 0;
+    for (size_t pos = 0; pos + 46 <= directory.size();) {
+        const unsigned char* entry = &directory[pos];
+        if (get_le32(entry) != kZipCentralHeader) {
+            spdlog::error("Corrupt central directory in {}", path);
+            return false;
+        }
+        uint16_t flags = get_le16(entry + 8);
+        uint16_t method = get_le16(entry + 10);
+        size_t name_length = get_le16(entry + 28);
+        size_t extra_length = get_le16(entry + 30);
+        size_t comment_length = get_le16(entry + 32);
+        if (pos + 46 + name_length + extra_length + comment_length > directory.size()) {
+            spdlog::error("Corrupt central directory in {}", path);
+            return false;
+        }
+
+        ArchiveMember member;
+        member.name.assign(reinterpret_cast<const char*>(entry + 46), name_length);
+        member.crc32 = get_le32(entry + 16);
+        member.stored_size = get_le32(entry + 20);
+        member.size = get_le32(entry + 24);
+        member.offset = get_le32(entry + 42);
+        member.mtime_ns = dos_time_ns(get_le16(entry + 12), get_le16(entry + 14));
+        member.deflated = method == 8;
+
+        // Fields that overflowed 32 bits follow in order in the zip64 extra
+        const unsigned char* extra = entry + 46 + name_length;
+        for (size_t at = 0; at + 4 <= extra_length;) {
+            uint16_t id = get_le16(extra + at);
+            size_t size = get_le16(extra + at + 2);
+            if (id == 0x0001) {
+                const unsigned char* field = extra + at + 4;
+                const unsigned char* field_end = field + std::min(size, extra_length - at - 4);
+                for (uint64_t* value : {&member.size, &member.stored_size, &member.offset}) {
+                    if (*value == 0xFFFFFFFFu && field + 8 <= field_end) {
+                        *value = get_le64(field);
+                        field += 8;
+                    }
+                }
+            }
+            at += 4 + size;
+        }
+        pos += 46 + name_length + extra_length + comment_length;
+
+        if (!wanted_member(member.name, path)) {
+            continue;
+        }
+        if (member.offset > file_size || member.stored_size > file_size - member.offset) {
+            spdlog::warn("Skipping {} in {}: data extends past the end of the archive", member.name, path);
+            skipped++;
+            continue;
+        }
+        if ((flags & 1) || (method != 0 && method != 8)) {
+            spdlog::warn("Skipping {} in {}: {}", member.name, path,
+                         (flags & 1) ? "encrypted" : "unsupported compression method");
+            skipped++;
+            continue;
+        }
+        members.push_back(std::move(member));
+    }
+    if (skipped > 0) {
+        spdlog::warn("Skipped {} unreadable PDFs in {}", skipped, path);
+    }
+    return true;
+}
+
+bool ArchiveReader::list_tar(const std::string& path, std::vector<ArchiveMember>& members) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        spdlog::error("Failed to open archive: {}", path);
+        return false;
+    }
+
+    std::error_code ec;
+    uint64_t file_size = std::filesystem::file_size(path, ec);
+    unsigned char header[kTarBlock];
+    std::string long_name; // From a preceding GNU 'L' or pax 'x' member
+    uint64_t offset = 0;
+    while (read_at(file, offset, header, sizeof(header))) {
+        if (std::all_of(header, header + kTarBlock, [](unsigned char c) { return c == 0; })) {
+            break; // End of archive
+        }
+        if (!tar_checksum_ok(header)) {
+            if (offset == 0) {
+                spdlog::error("Not a tar archive: {}", path);
+                return false;
+            }
+            spdlog::warn("Corrupt tar header at offset {} in {}; ignoring the rest", offset, path);
+            break;
+        }
+
+        uint64_t size = tar_number(header + 124, 12);
+        uint64_t data = offset + kTarBlock;
+        char type = static_cast<char>(header[156]);
+        if (type == 'L' || type == 'x') {
+            std::string text(static_cast<size_t>(std::min<uint64_t>(size, 1 << 20)), '\0');
+            if (!read_at(file, data, text.data(), text.size())) {
+                spdlog::error("Truncated tar archive: {}", path);
+                return false;
+            }
+            long_name = type == 'L' ? std::string(text.c_str()) : pax_path(text);
+        } else if (type == '0' || type == '\0' || type == '7') {
+            ArchiveMember member;
+            if (!long_name.empty()) {
+                member.name = std::move(long_name);
+            } else {
+                member.name.assign(reinterpret_cast<const char*>(header), strnlen(reinterpret_cast<const char*>(header), 100));
+                // POSIX ustar splits long names into prefix and name
+                if (std::memcmp(header + 257, "ustar\0", 6) == 0 && header[345] != 0) {
+                    std::string prefix(reinterpret_cast<const char*>(header + 345),
+                                       strnlen(reinterpret_cast<const char*>(header + 345), 155));
+                    member.name = prefix + "/" + member.name;
+                }
+            }
+            long_name.clear();
+            member.offset = data;
+            member.stored_size = size;
+            member.size = size;
+            member.mtime_ns = static_cast<int64_t>(tar_number(header + 136, 12)) * 1000000000;
+            if (ec || data > file_size || size > file_size - data) {
+                spdlog::warn("Truncated tar archive {}; ignoring {} and the rest", path, member.name);
+                break;
+            }
+            if (wanted_member(member.name, path)) {
+                members.push_back(std::move(member));
+            }
+        } else if (type != 'g') {
+            long_name.clear();
+        }
+        offset = data + (size + kTarBlock - 1) / kTarBlock * kTarBlock;
+    }
+    return true;
+}
+
+bool ArchiveReader::queue_members(const std::string& path, PathQueue& queue) {
+    std::vector<ArchiveMember> members;
+    if (!list(path, members)) {
+        return true; // Already logged; the rest of the scan goes on
+    }
+    spdlog::debug("Found {} PDFs in {}", members.size(), path);
+    for (auto& member : members) {
+        if (!queue.push(InputFile{path, "", "", std::move(member)})) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArchiveReader::read(const std::string& path, const ArchiveMember& member, Data& data) {
+    data.release();
+    // Documents are handed to poppler as one buffer with an int length
+    if (member.size > INT_MAX || member.stored_size > UINT_MAX) {
+        spdlog::error("{} in {} is too large to load from memory", member.name, path);
+        return false;
+    }
+
+    // Zip data follows a local header whose name and extra may differ in
+    // length from the central directory's
+    uint64_t offset = member.offset;
+    if (is_zip(path)) {
+        std::ifstream file(path, std::ios::binary);
+        unsigned char header[30];
+        if (!file || !read_at(file, offset, header, sizeof(header)) || get_le32(header) != kZipLocalHeader) {
+            spdlog::error("Corrupt local header for {} in {}", member.name, path);
+            return false;
+        }
+        offset += sizeof(header) + get_le16(header + 26) + get_le16(header + 28);
+    }
+
+    // Stored members are used in place
+    Data compressed;
+    Data& stored = member.deflated ? compressed : data;
+    if (!map_range(path, offset, member.stored_size, stored)) {
+        spdlog::error("Failed to read {} in {}", member.name, path);
+        return false;
+    }
+    if (!member.deflated) {
+        return true;
+    }
+
+    data.buffer_.resize(static_cast<size_t>(member.size));
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(member.stored_size);
+    stream.next_out = reinterpret_cast<Bytef*>(data.buffer_.data());
+    stream.avail_out = static_cast<uInt>(member.size);
+    int status = inflate(&stream, Z_FINISH);
+    uint64_t inflated = stream.total_out;
+    inflateEnd(&stream);
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(data.buffer_.data()), static_cast<uInt>(member.size));
+    if (status != Z_STREAM_END || inflated != member.size || crc != member.crc32) {
+        spdlog::error("Corrupt compressed data for {} in {}", member.name, path);
+        data.release();
+        return false;
+    }
+    data.data_ = data.buffer_.data();
+    data.size_ = data.buffer_.size();
+    return true;
+}
+
+} // namespace popplershot
@@ -0,0 +1,353 @@
+#include "archive_sink.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+namespace popplershot {
+
+namespace {
+
+// Pages are buffered and flushed in large sequential writes
+constexpr size_t kBufferSize = 8 << 20;
+// Room kept for the end-of-archive records when deciding to roll over
+constexpr size_t kTrailerReserve = 1024;
+
+constexpr size_t kTarBlock = 512;
+
+size_t tar_padding(size_t size) {
+    return (kTarBlock - size % kTarBlock) % kTarBlock;
+}
+
+void put_octal(char* field, size_t width, uint64_t value) {
+    // width - 1 digits followed by NUL, as ustar expects
+    std::string digits = fmt::format("{:0{}o}", value, width - 1);
+    std::memcpy(field, digits.data(), std::min(digits.size(), width - 1));
+    field[width - 1] = '\0';
+}
+
+void put_le16(std::vector<unsigned char>& out, uint16_t value) {
+    out.push_back(static_cast<unsigned char>(value));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+}
+
+void put_le32(std::vector<unsigned char>& out, uint32_t value) {
+    put_le16(out, static_cast<uint16_t>(value));
+    put_le16(out, static_cast<uint16_t>(value >> 16));
+}
+
+void put_le64(std::vector<unsigned char>& out, uint64_t value) {
+    put_le32(out, static_cast<uint32_t>(value));
+    put_le32(out, static_cast<uint32_t>(value >> 32));
+}
+
+// Splits a long path into ustar prefix and name at a '/'; false if impossible
+bool split_ustar_name(const std::string& path, std::string& prefix, std::string& name) {
+    if (path.size() <= 100) {
+        prefix.clear();
+        name = path;
+        return true;
+    }
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (slash <= 155 && path.size() - slash - 1 <= 100) {
+            prefix = path.substr(0, slash);
+            name = path.substr(slash + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// DOS date and time of the moment the shard is written
+void dos_timestamp(uint16_t& time, uint16_t& date) {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    time = static_cast<uint16_t>((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+    date = static_cast<uint16_t>(((std::max(local.tm_year, 80) - 80) << 9) |
+                                 ((local.tm_mon + 1) << 5) | local.tm_mday);
+}
+
+} // namespace
+
+ArchiveSink::ArchiveSink(const Options& options)
+    : options_(options), shard_index_(0), shard_offset_(0), failed_(false) {
+    buffer_.reserve(kBufferSize);
+}
+
+ArchiveSink::~ArchiveSink() {
+    if (shard_.is_open()) {
+        spdlog::warn("Archive shard {} was not finished", shard_path_);
+    }
+}
+
+bool ArchiveSink::write(const std::string& name, EncodedPage page) {
+    const std::vector<unsigned char>& data = page.data;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) {
+        return false;
+    }
+
+    size_t needed = member_overhead(name, data.size()) + data.size() + kTrailerReserve;
+    if (shard_.is_open() && shard_offset_ > 0 && shard_offset_ + needed > options_.shard_size) {
+        if (!close_shard()) {
+            return false;
+        }
+    }
+    if (!shard_.is_open() && !open_shard()) {
+        return false;
+    }
+
+    uint64_t data_offset = write_member(name, data);
+    index_ += fmt::format("{}\t{}\t{}\n", data_offset, data.size(), name);
+    return !failed_;
+}
+
+bool ArchiveSink::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !shard_.is_open() ? !failed_ : close_shard();
+}
+
+void ArchiveSink::append(const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    shard_offset_ += size;
+    if (buffer_.size() + size > kBufferSize) {
+        flush();
+    }
+    // Large members skip the copy and go straight to the file
+    if (size >= kBufferSize) {
+        shard_.write(reinterpret_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+        failed_ = failed_ || !shard_;
+        return;
+    }
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+}
+
+bool ArchiveSink::flush() {
+    if (!buffer_.empty()) {
+        shard_.write(reinterpret_cast<const char*>(buffer_.data()),
+                     static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+    failed_ = failed_ || !shard_;
+    return !failed_;
+}
+
+bool ArchiveSink::open_shard() {
+    shard_path_ = (std::filesystem::path(options_.root) /
+                   fmt::format("{}-{:05d}.{}", options_.shard_prefix, shard_index_++, extension())).string();
+    shard_.open(shard_path_, std::ios::binary | std::ios::trunc);
+    if (!shard_) {
+        spdlog::error("Failed to create archive shard: {}", shard_path_);
+        failed_ = true;
+        return false;
+    }
+    shard_offset_ = 0;
+    index_ = "# data_offset\tsize\tname\n";
+    reset_shard();
+    spdlog::debug("Started archive shard {}", shard_path_);
+    return true;
+}
+
+bool ArchiveSink::close_shard() {
+    write_trailer();
+    flush();
+    shard_.close();
+    if (!failed_ && shard_.fail()) {
+        failed_ = true;
+    }
+    if (failed_) {
+        spdlog::error("Failed to write archive shard: {}", shard_path_);
+        return false;
+    }
+
+    std::ofstream index(shard_path_ + ".idx", std::ios::trunc);
+    index << index_;
+    if (!index) {
+        spdlog::error("Failed to write archive index: {}.idx", shard_path_);
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+size_t TarSink::member_overhead(const std::string& name, size_t size) const {
+    std::string prefix, short_name;
+    size_t pax = split_ustar_name(name, prefix, short_name) ? 0 : 2 * kTarBlock + name.size();
+    return pax + kTarBlock + tar_padding(size);
+}
+
+void TarSink::write_header(const std::string& name, size_t size, char type) {
+    char header[kTarBlock] = {};
+    std::string prefix, short_name;
+    if (!split_ustar_name(name, prefix, short_name)) {
+        // Real name lives in the preceding pax record
+        short_name = name.substr(name.size() - std::min<size_t>(name.size(), 99));
+        prefix.clear();
+    }
+    std::memcpy(header, short_name.data(), std::min<size_t>(short_name.size(), 100));
+    put_octal(header + 100, 8, 0644);
+    put_octal(header + 108, 8, 0);
+    put_octal(header + 116, 8, 0);
+    put_octal(header + 124, 12, size);
+    put_octal(header + 136, 12, static_cast<uint64_t>(std::time(nullptr)));
+    header[156] = type;
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+    std::memcpy(header + 345, prefix.data(), std::min<size_t>(prefix.size(), 155));
+
+    // Checksum is computed with its own field set to spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (unsigned char byte : header) {
+        sum += byte;
+    }
+    put_octal(header + 148, 7, sum);
+    header[155] = ' ';
+    append(header, sizeof(header));
+}
+
+uint64_t TarSink::write_member(const std::string& name, const std::vector<unsigned char>& data) {
+    static const char kZeros[kTarBlock] = {};
+    std::string prefix, short_name;
+    if (!split_ustar_name(name, prefix, short_name)) {
+        // "<length> path=<name>\n", where length counts its own digits
+        std::string body = " path=" + name + "\n";
+        size_t length = body.size() + 1;
+        while (std::to_string(length).size() + body.size() != length) {
+            length++;
+        }
+        std::string record = std::to_string(length) + body;
+        write_header("PaxHeaders/" + std::filesystem::path(name).filename().string(), record.size(), 'x');
+        append(record.data(), record.size());
+        append(kZeros, tar_padding(record.size()));
+    }
+
+    write_header(name, data.size(), '0');
+    uint64_t data_offset = shard_offset();
+    append(data.data(), data.size());
+    append(kZeros, tar_padding(data.size()));
+    return data_offset;
+}
+
+void TarSink::write_trailer() {
+    static const char kZeros[2 * kTarBlock] = {};
+    append(kZeros, sizeof(kZeros));
+}
+
+size_t ZipSink::member_overhead(const std::string& name, size_t) const {
+    // Local header now, central directory entry (with zip64 extra) at the end
+    return 30 + name.size() + 46 + name.size() + 12;
+}
+
+uint64_t ZipSink::write_member(const std::string& name, const std::vector<unsigned char>& data) {
+    uint32_t crc = static_cast<uint32_t>(crc32(0L, Z_NULL, 0));
+    for (size_t offset = 0; offset < data.size();) {
+        uInt chunk = static_cast<uInt>(std::min<size_t>(data.size() - offset, 1u << 30));
+        crc = static_cast<uint32_t>(crc32(crc, data.data() + offset, chunk));
+        offset += chunk;
+    }
+    uint64_t header_offset = shard_offset();
+    entries_.push_back({name, crc, static_cast<uint32_t>(data.size()), header_offset});
+
+    uint16_t time, date;
+    dos_timestamp(time, date);
+    std::vector<unsigned char> header;
+    header.reserve(30 + name.size());
+    put_le32(header, 0x04034b50);
+    put_le16(header, 20);     // Version needed: stored member
+    put_le16(header, 0x0800); // UTF-8 names
+    put_le16(header, 0);      // Stored
+    put_le16(header, time);
+    put_le16(header, date);
+    put_le32(header, crc);
+    put_le32(header, static_cast<uint32_t>(data.size()));
+    put_le32(header, static_cast<uint32_t>(data.size()));
+    put_le16(header, static_cast<uint16_t>(name.size()));
+    put_le16(header, 0);
+    header.insert(header.end(), name.begin(), name.end());
+    append(header.data(), header.size());
+
+    uint64_t data_offset = shard_offset();
+    append(data.data(), data.size());
+    return data_offset;
+}
+
+void ZipSink::write_trailer() {
+    uint16_t time, date;
+    dos_timestamp(time, date);
+    uint64_t directory_offset = shard_offset();
+
+    std::vector<unsigned char> record;
+    for (const auto& entry : entries_) {
+        bool zip64 = entry.header_offset >= 0xFFFFFFFFu;
+        record.clear();
+        put_le32(record, 0x02014b50);
+        put_le16(record, zip64 ? 45 : 20); // Made by
+        put_le16(record, zip64 ? 45 : 20); // Needed
+        put_le16(record, 0x0800);
+        put_le16(record, 0);
+        put_le16(record, time);
+        put_le16(record, date);
+        put_le32(record, entry.crc);
+        put_le32(record, entry.size);
+        put_le32(record, entry.size);
+        put_le16(record, static_cast<uint16_t>(entry.name.size()));
+        put_le16(record, zip64 ? 12 : 0); // Extra field length
+        put_le16(record, 0);              // Comment
+        put_le16(record, 0);              // Disk
+        put_le16(record, 0);              // Internal attributes
+        put_le32(record, 0100644u << 16); // Unix mode in the external attributes
+        put_le32(record, zip64 ? 0xFFFFFFFFu : static_cast<uint32_t>(entry.header_offset));
+        record.insert(record.end(), entry.name.begin(), entry.name.end());
+        if (zip64) {
+            put_le16(record, 0x0001);
+            put_le16(record, 8);
+            put_le64(record, entry.header_offset);
+        }
+        append(record.data(), record.size());
+    }
+
+    uint64_t directory_size = shard_offset() - directory_offset;
+    uint64_t count = entries_.size();
+    bool zip64 = count >= 0xFFFF || directory_offset >= 0xFFFFFFFFu || directory_size >= 0xFFFFFFFFu;
+
+    record.clear();
+    if (zip64) {
+        uint64_t zip64_end_offset = shard_offset();
+        put_le32(record, 0x06064b50);
+        put_le64(record, 44); // Size of the rest of this record
+        put_le16(record, 45);
+        put_le16(record, 45);
+        put_le32(record, 0);
+        put_le32(record, 0);
+        put_le64(record, count);
+        put_le64(record, count);
+        put_le64(record, directory_size);
+        put_le64(record, directory_offset);
+
+        put_le32(record, 0x07064b50); // Locator
+        put_le32(record, 0);
+        put_le64(record, zip64_end_offset);
+        put_le32(record, 1);
+    }
+
+    put_le32(record, 0x06054b50);
+    put_le16(record, 0);
+    put_le16(record, 0);
+    put_le16(record, zip64 ? 0xFFFF : static_cast<uint16_t>(count));
+    put_le16(record, zip64 ? 0xFFFF : static_cast<uint16_t>(count));
+    put_le32(record, zip64 ? 0xFFFFFFFFu : static_cast<uint32_t>(directory_size));
+    put_le32(record, zip64 ? 0xFFFFFFFFu : static_cast<uint32_t>(directory_offset));
+    put_le16(record, 0);
+    append(record.data(), record.size());
+}
+
+} // namespace popplershot
@@ -1,13 +1,37 @@
 #include "batch_processor.h"
+#include "archive_reader.h"
 #include "file_utils.h"
+#include "input_list.h"
 #include <spdlog/spdlog.h>
 #include <algorithm>
 #include <future>
 
 namespace popplershot {
 
+namespace {
+
+// Paths discovered ahead of the workers; bounds memory on huge trees
+constexpr size_t kDiscoveryQueueCapacity = 65536;
+
+// Everything that changes the pages written for a document; a rerun with
+// different settings converts again
+uint32_t options_fingerprint(const PDFConverter::ConversionOptions& options, int layout_levels) {
+    return ConversionIndex::fingerprint(fmt::format(
+        "dpi={} format={} quality={} aspect={} max={}x{} palette={} dither={} gray={} "
+        "level={} adaptive={} range={}-{} ceiling={} max_file={} sink={} s3={} layout={}",
+        options.dpi, options.output_format, options.jpeg_quality, options.preserve_aspect_ratio,
+        options.max_width, options.max_height, options.palette, options.dither, options.grayscale,
+        options.compression_level, options.adaptive_compression, options.min_compression_level,
+        options.max_compression_level, options.size_ceiling, options.max_file_size,
+        static_cast<int>(options.sink.kind), options.sink.s3_url, layout_levels));
+}
+
+} // namespace
+
 BatchProcessor::BatchProcessor(int num_threads) 
-    : num_threads_(num_threads), cancel_requested_(false) {
+    : num_threads_(num_threads), cancel_requested_(false), stop_watching_(false), layout_levels_(0), discovery_threads_(8),
+      pdf_detection_(FileUtils::PdfDetection::Extension), archives_(false),
+      input_order_(InputOrder::Mode::Scan), incremental_(false), resume_(false) {
     if (num_threads_ <= 0) {
         num_threads_ = std::thread::hardware_concurrency();
     }
@@ -38,20 +62,115 @@ BatchProcessor::BatchResult BatchProcessor::process_directory(
     const std::string& output_dir,
     const PDFConverter::ConversionOptions& options,
     ProgressCallback progress_callback) {
-    
-    BatchResult result{0, 0, 0, 0, {}};
-    cancel_requested_ = false;
 
-    // Find all PDF files in the input directory
-    std::vector<std::string> pdf_files = FileUtils::find_pdf_files(input_dir);
-    result.total_pdfs = static_cast<int>(pdf_files.size());
-
-    if (pdf_files.empty()) {
-        spdlog::warn("No PDF files found in directory: {}", input_dir);
+    if (!FileUtils::is_directory(input_dir)) {
+        spdlog::error("Directory does not exist: {}", input_dir);
+        BatchResult result{0, 0, 0, 0, {}, {}, {}, 0, 0, 0, 0, 0, false};
         result.errors.push_back("No PDF files found in input directory");
         return result;
     }
 
+    // Discovery feeds the workers as it goes, so rendering starts with the
+    // first PDF found rather than after the whole scan
+    auto scan = [this, &input_dir](PathQueue& pdf_files) {
+        return FileUtils::scan_pdf_files(input_dir, discovery_threads_, [this, &pdf_files](std::vector<std::string>& files) {
+            std::sort(files.begin(), files.end());
+            for (auto& file : files) {
+                if (!queue_file(pdf_files, std::move(file))) {
+                    return;
+                }
+            }
+        }, pdf_detection_, archives_);
+    };
+    // Placing files on disk needs the whole list, so it waits for the scan
+    auto ordered_scan = [this, &input_dir](PathQueue& pdf_files) {
+        std::vector<std::string> found;
+        std::mutex found_mutex;
+        bool scanned = FileUtils::scan_pdf_files(input_dir, discovery_threads_, [&](std::vector<std::string>& files) {
+            std::lock_guard<std::mutex> lock(found_mutex);
+            found.insert(found.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+        }, pdf_detection_, archives_);
+        spdlog::info("Ordering {} discovered files by their place on disk", found.size());
+        std::sort(found.begin(), found.end());
+        InputOrder::sort(found, input_order_, discovery_threads_);
+        for (auto& file : found) {
+            if (!queue_file(pdf_files, std::move(file))) {
+                break;
+            }
+        }
+        return scanned;
+    };
+    if (input_order_ != InputOrder::Mode::Scan) {
+        return process(input_dir, output_dir, options, progress_callback, ordered_scan, "directory: " + input_dir);
+    }
+    return process(input_dir, output_dir, options, progress_callback, scan, "directory: " + input_dir);
+}
+
+BatchProcessor::BatchResult BatchProcessor::process_file_list(
+    const std::string& source,
+    bool nul_separated,
+    const std::string& input_root,
+    const std::string& output_dir,
+    const PDFConverter::ConversionOptions& options,
+    ProgressCallback progress_callback) {
+
+    auto read = [&](PathQueue& pdf_files) {
+        return InputList::read(source, nul_separated, input_root, pdf_files);
+    };
+    return process(input_root, output_dir, options, progress_callback, read,
+                   "list: " + (source == "-" ? std::string("stdin") : source));
+}
+
+BatchProcessor::BatchResult BatchProcessor::process_watch(
+    const std::string& input_dir,
+    const std::string& output_dir,
+    const PDFConverter::ConversionOptions& options,
+    ProgressCallback progress_callback,
+    const HotFolder::Options& watch) {
+
+    stop_watching_ = false;
+    HotFolder::Options watch_options = watch;
+    watch_options.detection = pdf_detection_;
+    watch_options.archives = archives_;
+    auto watch_folder = [&](PathQueue& pdf_files) {
+        HotFolder folder(input_dir, watch_options);
+        // Subscribe first so files dropped during the scan are not missed
+        if (!folder.start()) {
+            return false;
+        }
+        bool scanned = FileUtils::scan_pdf_files(input_dir, discovery_threads_, [this, &pdf_files](std::vector<std::string>& files) {
+            for (auto& file : files) {
+                if (!queue_file(pdf_files, std::move(file))) {
+                    return;
+                }
+            }
+        }, pdf_detection_, archives_);
+        return scanned && folder.run(pdf_files, stop_watching_);
+    };
+    return process(input_dir, output_dir, options, progress_callback, watch_folder,
+                   "watched directory: " + input_dir);
+}
+
+bool BatchProcessor::queue_file(PathQueue& pdf_files, std::string file) {
+    // Archives are listed on the walker thread that found them
+    if (archives_ && ArchiveReader::has_archive_extension(file.c_str(), file.size())) {
+        return ArchiveReader::queue_members(file, pdf_files);
+    }
+    return pdf_files.push(InputFile{std::move(file), "", "", {}});
+}
+
+BatchProcessor::BatchResult BatchProcessor::process(
+    const std::string& input_root,
+    const std::string& output_dir,
+    const PDFConverter::ConversionOptions& options,
+    ProgressCallback progress_callback,
+    const Producer& produce,
+    const std::string& source) {
+    
+    BatchResult result{0, 0, 0, 0, {}, {}, {}, 0, 0, 0, 0, 0, false};
+    converter_.reset_adaptive_compression(options);
+    cancel_requested_ = false;
+
     // Ensure output directory exists
     if (!FileUtils::ensure_output_directory(output_dir)) {
         spdlog::error("Failed to create output directory: {}", output_dir);
@@ -59,7 +178,73 @@ BatchProcessor::BatchResult BatchProcessor::process_directory(
         return result;
     }
 
-    spdlog::info("Processing {} PDF files using {} threads", pdf_files.size(), num_threads_);
+    std::string index_path = !index_path_.empty() ? index_path_
+                                                  : FileUtils::join_path(output_dir, ".popplershot-index");
+    if (incremental_ && !index_.open(index_path)) {
+        result.errors.push_back("Failed to open conversion index: " + index_path);
+        return result;
+    }
+    uint32_t fingerprint = options_fingerprint(options, layout_levels_);
+
+    // Whatever an interrupted run finished is left alone, down to the page
+    std::string journal_path = !journal_path_.empty() ? journal_path_
+                                                      : FileUtils::join_path(output_dir, ".popplershot-journal");
+    resume_state_ = CheckpointJournal::State();
+    if (resume_) {
+        if (!CheckpointJournal::load(journal_path, resume_state_)) {
+            spdlog::warn("No journal at {}; starting from the beginning", journal_path);
+        } else if (resume_state_.has_options && resume_state_.options != fingerprint) {
+            spdlog::error("Journal {} was written with different options; rerun them or drop --resume",
+                          journal_path);
+            result.errors.push_back("Journal options differ: " + journal_path);
+            return result;
+        } else {
+            spdlog::info("Resuming: {} PDFs finished, {} partly converted",
+                         resume_state_.files.size(), resume_state_.pages.size());
+        }
+    }
+    // Grouped durability leaves pages unsynced until a syncfs, so the journal
+    // holds their lines until it has run one; otherwise lines go straight out
+    std::function<bool()> sync_output;
+    if (options.write_queue.durability == WriteQueue::Durability::Batch ||
+        options.write_queue.durability == WriteQueue::Durability::Document) {
+        sync_output = [this] { return converter_.sync_output(); };
+    }
+    if (!journal_.open(journal_path, resume_, fingerprint, std::move(sync_output))) {
+        result.errors.push_back("Failed to open journal: " + journal_path);
+        return result;
+    }
+
+    OutputSink::Options sink = options.sink;
+    sink.root = output_dir;
+    if (!converter_.configure_output(options.write_queue, sink)) {
+        result.errors.push_back("Failed to configure output");
+        return result;
+    }
+
+    // Documents skipped by a rerun keep their lines from the runs that converted them
+    bool keep_manifests = incremental_ || resume_;
+    if (!manifest_path_.empty() &&
+        !manifest_.open(manifest_path_, output_dir, ManifestWriter::Format::Digest, keep_manifests)) {
+        result.errors.push_back("Failed to open manifest: " + manifest_path_);
+        return result;
+    }
+
+    std::string layout_path = FileUtils::join_path(output_dir, "layout.tsv");
+    if (layout_levels_ > 0 &&
+        !layout_manifest_.open(layout_path, output_dir, ManifestWriter::Format::Layout, keep_manifests)) {
+        result.errors.push_back("Failed to open layout manifest: " + layout_path);
+        return result;
+    }
+
+    spdlog::info("Processing PDF files from {} using {} threads", source, num_threads_);
+
+    PathQueue pdf_files(kDiscoveryQueueCapacity);
+    bool source_ok = true;
+    std::thread discovery([&produce, &pdf_files, &source_ok]() {
+        source_ok = produce(pdf_files);
+        pdf_files.close();
+    });
 
     // Prepare threading variables
     std::mutex result_mutex;
@@ -68,9 +253,9 @@ BatchProcessor::BatchResult BatchProcessor::process_directory(
 
     // Launch worker threads
     for (int i = 0; i < num_threads_ && !cancel_requested_; ++i) {
-        workers.emplace_back([this, &pdf_files, &output_dir, &options, 
+        workers.emplace_back([this, &pdf_files, &input_root, &output_dir, &options, fingerprint,
                              progress_callback, &result, &result_mutex, &file_index]() {
-            worker_thread(pdf_files, output_dir, options, progress_callback, 
+            worker_thread(pdf_files, input_root, output_dir, options, fingerprint, progress_callback,
                          result, result_mutex, file_index);
         });
     }
@@ -81,6 +266,44 @@ BatchProcessor::BatchResult BatchProcessor::process_directory(
             worker.join();
         }
     }
+    // After a cancel the scan may still be running; stop its pushes
+    pdf_files.close();
+    discovery.join();
+
+    result.total_pdfs = static_cast<int>(pdf_files.pushed());
+    if (!source_ok) {
+        result.errors.push_back("Failed to read " + source);
+    }
+    if (result.total_pdfs == 0) {
+        spdlog::warn("No PDF files found in {}", source);
+        result.errors.push_back("No PDF files found in " + source);
+    } else {
+        spdlog::info("Found {} PDF files in {}", result.total_pdfs, source);
+    }
+    // Outputs are completed before the records that point at them
+    if (!converter_.finish_output()) {
+        result.output_failed = true;
+        result.errors.push_back("Failed to complete output archive");
+    }
+    if (!journal_.close()) {
+        result.errors.push_back("Failed to write journal: " + journal_path);
+    }
+    resume_state_ = CheckpointJournal::State();
+    if (incremental_) {
+        spdlog::debug("Conversion index holds {} documents", index_.size());
+        if (!index_.close()) {
+            result.errors.push_back("Failed to write conversion index: " + index_path);
+        }
+    }
+
+    if (manifest_.is_open() && !manifest_.close()) {
+        spdlog::error("Failed to write manifest: {}", manifest_path_);
+        result.errors.push_back("Failed to write manifest: " + manifest_path_);
+    }
+    if (layout_manifest_.is_open() && !layout_manifest_.close()) {
+        spdlog::error("Failed to write layout manifest: {}", layout_path);
+        result.errors.push_back("Failed to write layout manifest: " + layout_path);
+    }
 
     spdlog::info("Batch processing completed. Success: {}/{}, Pages: {}", 
                 result.successful_conversions, result.total_pdfs, result.total_pages_converted);
@@ -89,27 +312,58 @@ BatchProcessor::BatchResult BatchProcessor::process_directory(
 }
 
 void BatchProcessor::worker_thread(
-    const std::vector<std::string>& pdf_files,
+    PathQueue& pdf_files,
+    const std::string& input_root,
     const std::string& output_dir,
     const PDFConverter::ConversionOptions& options,
+    uint32_t fingerprint,
     ProgressCallback progress_callback,
     BatchResult& result,
     std::mutex& result_mutex,
     std::atomic<int>& file_index) {
     
-    while (!cancel_requested_) {
-        int current_index = file_index.fetch_add(1);
-        if (current_index >= static_cast<int>(pdf_files.size())) {
-            break;
+    InputFile input;
+    while (!cancel_requested_ && pdf_files.pop(input)) {
+        // Archive members are named as if the archive were a directory
+        const bool in_archive = !input.member.name.empty();
+        const std::string pdf_file = in_archive ? input.path + "/" + input.member.name : input.path;
+
+        // The key covers everything that places this document's pages;
+        // a member's CRC stands in for hashing its whole archive
+        std::string key = FileUtils::relative_path(input_root, pdf_file) + "\t" + input.output_dir + "\t" + input.pages;
+        if (in_archive) {
+            key += fmt::format("\t{:08x}", input.member.crc32);
+        }
+        if (resume_state_.files.count(key)) {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            result.skipped_completed++;
+            continue;
         }
+        ConversionIndex::FileState state{input.member.mtime_ns, input.member.size};
+        std::string content_path = in_archive ? "" : pdf_file;
+        bool indexed = incremental_ && (in_archive || ConversionIndex::stat_file(pdf_file, state));
+        if (indexed && index_.unchanged(key, content_path, state, fingerprint)) {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            result.skipped_unchanged++;
+            continue;
+        }
+        // Read the whole document in one sweep rather than at the seeks of
+        // the parser; the next worker's document is usually close behind
+        if (input_order_ != InputOrder::Mode::Scan) {
+            if (in_archive) {
+                InputOrder::readahead(input.path, input.member.offset, input.member.stored_size);
+            } else {
+                InputOrder::readahead(pdf_file);
+            }
+        }
+        int current_index = file_index.fetch_add(1);
 
-        const std::string& pdf_file = pdf_files[current_index];
-        
-        // Update progress
+        // Update progress; the total keeps growing until the scan is done
         if (progress_callback) {
             ProgressInfo progress;
             progress.current_file = current_index + 1;
-            progress.total_files = static_cast<int>(pdf_files.size());
+            progress.scanning = !pdf_files.closed();
+            progress.total_files = static_cast<int>(pdf_files.pushed());
             progress.current_filename = FileUtils::get_filename_without_extension(pdf_file);
             
             {
@@ -120,8 +374,50 @@ void BatchProcessor::worker_thread(
             progress_callback(progress);
         }
 
-        // Convert the PDF
-        auto conversion_result = converter_.convert_pdf(pdf_file, output_dir, options);
+        // Convert the PDF into its listed, mirrored or hashed subdirectory
+        std::string file_output_dir =
+            !input.output_dir.empty() ? FileUtils::join_path(output_dir, input.output_dir)
+            : layout_levels_ > 0
+                ? FileUtils::bucket_directory(input_root, pdf_file, output_dir, layout_levels_)
+                : FileUtils::mirror_directory(input_root, pdf_file, output_dir);
+        PDFConverter::ConversionOptions file_options = options;
+        file_options.pages = input.pages;
+        auto partial = resume_state_.pages.find(key);
+        if (partial != resume_state_.pages.end()) {
+            file_options.done_pages = partial->second;
+        }
+        // Listed before journaled, so a run killed mid-document leaves a line
+        // for every page that --resume skips; a page listed twice by a rerun
+        // keeps its latest line
+        std::string document = FileUtils::relative_path(input_root, pdf_file);
+        file_options.page_written = [this, &key, &document](const PDFConverter::PageResult& page) {
+            if (manifest_.is_open()) {
+                manifest_.add({page});
+            }
+            if (layout_manifest_.is_open()) {
+                layout_manifest_.add({page}, document);
+            }
+            journal_.page_done(key, page.page_number);
+        };
+        PDFConverter::ConversionResult conversion_result;
+        if (!in_archive) {
+            conversion_result = converter_.convert_pdf(pdf_file, file_output_dir, file_options);
+        } else if (ArchiveReader::Data data; ArchiveReader::read(input.path, input.member, data)) {
+            conversion_result = converter_.convert_pdf_data(pdf_file, data.data(), data.size(),
+                                                            file_output_dir, file_options);
+        } else {
+            conversion_result = {false, "Failed to read archive member", 0, {}};
+        }
+        // Only a document with every page written counts as done; record
+        // drops it if the file moved off the state seen before converting
+        if (conversion_result.success &&
+            std::all_of(conversion_result.pages.begin(), conversion_result.pages.end(),
+                        [](const PDFConverter::PageResult& page) { return page.success; })) {
+            journal_.file_done(key);
+            if (indexed) {
+                index_.record(key, content_path, state, fingerprint);
+            }
+        }
         
         // Update results
         {
@@ -129,6 +425,19 @@ void BatchProcessor::worker_thread(
             if (conversion_result.success) {
                 result.successful_conversions++;
                 result.total_pages_converted += conversion_result.pages_converted;
+                for (const auto& page : conversion_result.pages) {
+                    if (page.success) {
+                        result.pages_by_encoder[page.encoder]++;
+                        result.pages_by_compression_level[page.compression_level]++;
+                        result.total_encode_attempts += page.encode_attempts;
+                        if (page.encode_attempts > 1) {
+                            result.pages_refit++;
+                        }
+                        if (!page.within_budget) {
+                            result.pages_over_budget++;
+                        }
+                    }
+                }
             } else {
                 result.failed_conversions++;
                 result.errors.push_back(pdf_file + ": " + conversion_result.error_message);
@@ -141,9 +450,47 @@ void BatchProcessor::set_thread_count(int num_threads) {
     num_threads_ = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
 }
 
+void BatchProcessor::set_manifest_path(const std::string& path) {
+    manifest_path_ = path;
+}
+
+void BatchProcessor::set_layout_levels(int levels) {
+    layout_levels_ = levels;
+}
+
+void BatchProcessor::set_discovery_threads(int threads) {
+    discovery_threads_ = threads;
+}
+
+void BatchProcessor::set_pdf_detection(FileUtils::PdfDetection detection) {
+    pdf_detection_ = detection;
+}
+
+void BatchProcessor::set_archives(bool archives) {
+    archives_ = archives;
+}
+
+void BatchProcessor::set_input_order(InputOrder::Mode order) {
+    input_order_ = order;
+}
+
+void BatchProcessor::set_incremental(bool incremental, const std::string& index_path) {
+    incremental_ = incremental;
+    index_path_ = index_path;
+}
+
+void BatchProcessor::set_journal(const std::string& journal_path, bool resume) {
+    journal_path_ = journal_path;
+    resume_ = resume;
+}
+
 void BatchProcessor::cancel_processing() {
     cancel_requested_ = true;
     spdlog::info("Batch processing cancellation requested");
 }
 
+void BatchProcessor::stop_watching() {
+    stop_watching_ = true;
+}
+
 } // namespace popplershot
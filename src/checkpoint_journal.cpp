@@ -0,0 +1,242 @@
+#include "checkpoint_journal.h"
+#include "file_utils.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace popplershot {
+
+namespace {
+
+// Flushes to disk this often; a crash loses only the pages since
+constexpr auto kSyncInterval = std::chrono::seconds(1);
+
+std::string escape_key(const std::string& key) {
+    std::string escaped;
+    escaped.reserve(key.size());
+    for (char c : key) {
+        if (c == '\\') escaped += "\\\\";
+        else if (c == '\n') escaped += "\\n";
+        else escaped += c;
+    }
+    return escaped;
+}
+
+std::string unescape_key(const std::string& text) {
+    std::string key;
+    key.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            key += text[++i] == 'n' ? '\n' : text[i];
+        } else {
+            key += text[i];
+        }
+    }
+    return key;
+}
+
+} // namespace
+
+CheckpointJournal::CheckpointJournal()
+    : file_(nullptr), dirty_(false), stopping_(false), failed_(false) {}
+
+CheckpointJournal::~CheckpointJournal() {
+    close();
+}
+
+bool CheckpointJournal::load(const std::string& path, State& state) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    size_t ignored = 0;
+    while (std::getline(file, line)) {
+        // The last line may have been cut short by the crash
+        if (file.eof()) {
+            break;
+        }
+        if (line.size() < 3 || line[1] != ' ') {
+            ignored++;
+            continue;
+        }
+        if (line[0] == 'O') {
+            state.has_options = true;
+            state.options = static_cast<uint32_t>(std::strtoul(line.c_str() + 2, nullptr, 16));
+        } else if (line[0] == 'F') {
+            std::string key = unescape_key(line.substr(2));
+            state.pages.erase(key);
+            state.files.insert(std::move(key));
+        } else if (line[0] == 'P') {
+            size_t space = line.find(' ', 2);
+            if (space == std::string::npos) {
+                ignored++;
+                continue;
+            }
+            int page = std::atoi(line.c_str() + 2);
+            std::string key = unescape_key(line.substr(space + 1));
+            if (page > 0 && !state.files.count(key)) {
+                state.pages[key].push_back(page);
+            }
+        } else {
+            ignored++;
+        }
+    }
+    if (ignored > 0) {
+        spdlog::warn("Ignored {} malformed lines in journal {}", ignored, path);
+    }
+    for (auto& [key, pages] : state.pages) {
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    }
+    return !file.bad();
+}
+
+bool CheckpointJournal::open(const std::string& path, bool append, uint32_t options,
+                             std::function<bool()> sync_output) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    sync_output_ = std::move(sync_output);
+    held_.clear();
+    dirty_ = false;
+    stopping_ = false;
+    failed_ = false;
+
+    // Drop a torn last line so the next record starts a line of its own
+    if (append && !FileUtils::drop_torn_line(path)) {
+        spdlog::error("Failed to repair journal: {}", path);
+        return false;
+    }
+    file_ = std::fopen(path.c_str(), append ? "ab" : "wb");
+    if (!file_) {
+        spdlog::error("Failed to open journal: {}", path);
+        return false;
+    }
+    write_line(fmt::format("O {:08x}\n", options));
+    flusher_ = std::thread(&CheckpointJournal::flush_loop, this);
+    return !failed_;
+}
+
+bool CheckpointJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) {
+            return true;
+        }
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    bool ok = sync();
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool closed = std::fclose(file_) == 0;
+    ok = ok && closed && !failed_;
+    file_ = nullptr;
+    if (!ok) {
+        spdlog::error("Failed to write journal: {}", path_);
+    }
+    return ok;
+}
+
+void CheckpointJournal::page_done(const std::string& key, int page) {
+    std::string line = fmt::format("P {} {}\n", page, escape_key(key));
+    std::lock_guard<std::mutex> lock(mutex_);
+    record(line);
+}
+
+void CheckpointJournal::file_done(const std::string& key) {
+    std::string line = "F " + escape_key(key) + "\n";
+    std::lock_guard<std::mutex> lock(mutex_);
+    record(line);
+}
+
+void CheckpointJournal::record(const std::string& line) {
+    if (!file_ || failed_) {
+        return;
+    }
+    dirty_ = true;
+    if (sync_output_) {
+        held_ += line;
+    } else {
+        write_line(line);
+    }
+}
+
+void CheckpointJournal::write_line(const std::string& line) {
+    // Handed to the kernel right away so a killed process loses nothing
+    if (std::fwrite(line.data(), 1, line.size(), file_) != line.size() || std::fflush(file_) != 0) {
+        spdlog::error("Failed to append to journal {}; resuming will redo this work", path_);
+        failed_ = true;
+    }
+}
+
+void CheckpointJournal::flush_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // close() does the last sync once this thread has stopped
+        if (wake_.wait_for(lock, kSyncInterval, [this] { return stopping_; })) {
+            return;
+        }
+        if (dirty_ && !failed_) {
+            lock.unlock();
+            sync();
+            lock.lock();
+        }
+    }
+}
+
+bool CheckpointJournal::sync() {
+    std::string held;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirty_ = false;
+        held.swap(held_);
+    }
+    // Pages first: a held line must never reach the disk before its page.
+    // Every page of a held line was written before the line was recorded.
+    if (sync_output_ && !sync_output_()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        return false;
+    }
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!held.empty() && !failed_) {
+            write_line(held);
+        }
+        if (failed_) {
+            return false;
+        }
+#ifdef _WIN32
+        fd = _fileno(file_);
+#else
+        fd = fileno(file_);
+#endif
+    }
+    // Outside the lock, so workers keep appending meanwhile; only close()
+    // closes the file, and it stops this thread first
+#ifdef _WIN32
+    bool ok = _commit(fd) == 0;
+#else
+    bool ok = ::fdatasync(fd) == 0;
+#endif
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+    }
+    return ok;
+}
+
+} // namespace popplershot
@@ -0,0 +1,372 @@
+#include "conversion_index.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace popplershot {
+
+struct ConversionIndex::Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t capacity; // Slots, a power of two
+    uint64_t count;    // Occupied slots
+    uint64_t reserved[4];
+};
+
+struct ConversionIndex::Slot {
+    uint64_t key; // 0 marks an empty slot; stored last
+    int64_t mtime_ns;
+    uint64_t size;
+    uint64_t content_hash;
+    uint32_t options;
+    uint32_t check;
+};
+
+namespace {
+
+constexpr uint64_t kMagic = 0x31584449484d5350ull; // "PSMHIDX1"
+constexpr uint32_t kVersion = 1;
+constexpr uint64_t kInitialCapacity = 1 << 16;
+constexpr uint64_t kCheckSeed = 0x9e3779b97f4a7c15ull;
+
+uint64_t key_hash(const std::string& key) {
+    uint64_t hash = XXH3_64bits(key.data(), key.size());
+    return hash != 0 ? hash : 1;
+}
+
+uint32_t check_hash(const std::string& key) {
+    return static_cast<uint32_t>(XXH3_64bits_withSeed(key.data(), key.size(), kCheckSeed));
+}
+
+} // namespace
+
+ConversionIndex::ConversionIndex()
+    : base_(nullptr), length_(0), header_(nullptr), slots_(nullptr) {}
+
+ConversionIndex::~ConversionIndex() {
+    close();
+}
+
+bool ConversionIndex::supported() {
+#ifdef _WIN32
+    return false;
+#else
+    return true;
+#endif
+}
+
+size_t ConversionIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return header_ ? static_cast<size_t>(header_->count) : 0;
+}
+
+bool ConversionIndex::stat_file(const std::string& path, FileState& state) {
+#ifdef _WIN32
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    state.size = size;
+    state.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    state.size = static_cast<uint64_t>(st.st_size);
+    state.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+uint64_t ConversionIndex::hash_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+    XXH3_state_t* state = XXH3_createState();
+    XXH3_64bits_reset(state);
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        XXH3_64bits_update(state, buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    uint64_t hash = file.bad() ? 0 : XXH3_64bits_digest(state);
+    XXH3_freeState(state);
+    return hash;
+}
+
+uint32_t ConversionIndex::fingerprint(const std::string& settings) {
+    return static_cast<uint32_t>(XXH3_64bits(settings.data(), settings.size()));
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// Maps capacity slots of an index at path, zero-filled if create
+unsigned char* map_file(const std::string& path, uint64_t capacity, bool create, size_t& length) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (create) {
+        length = 64 + capacity * 40;
+        if (::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+    } else {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < 64) {
+            ::close(fd);
+            return nullptr;
+        }
+        length = static_cast<size_t>(st.st_size);
+    }
+    void* base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    return base == MAP_FAILED ? nullptr : static_cast<unsigned char*>(base);
+}
+
+} // namespace
+
+bool ConversionIndex::map(const std::string& path, uint64_t capacity, bool create) {
+    size_t length = 0;
+    unsigned char* base = map_file(path, capacity, create, length);
+    if (!base) {
+        return false;
+    }
+    auto* header = reinterpret_cast<Header*>(base);
+    if (create) {
+        header->version = kVersion;
+        header->slot_size = sizeof(Slot);
+        header->capacity = capacity;
+        header->count = 0;
+        std::atomic_ref<uint64_t>(header->magic).store(kMagic, std::memory_order_release);
+    } else if (header->magic != kMagic || header->version != kVersion ||
+               header->slot_size != sizeof(Slot) || header->capacity == 0 ||
+               (header->capacity & (header->capacity - 1)) != 0 ||
+               length != sizeof(Header) + header->capacity * sizeof(Slot)) {
+        ::munmap(base, length);
+        return false;
+    }
+    base_ = base;
+    length_ = length;
+    header_ = header;
+    slots_ = reinterpret_cast<Slot*>(base + sizeof(Header));
+    return true;
+}
+
+void ConversionIndex::unmap() {
+    if (base_) {
+        ::munmap(base_, length_);
+    }
+    base_ = nullptr;
+    header_ = nullptr;
+    slots_ = nullptr;
+    length_ = 0;
+}
+
+bool ConversionIndex::open(const std::string& path) {
+    static_assert(sizeof(Header) == 64 && sizeof(Slot) == 40, "index layout changed");
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    path_ = path;
+    if (std::filesystem::exists(path) && map(path, 0, false)) {
+        spdlog::info("Conversion index {} holds {} documents", path, header_->count);
+        return true;
+    }
+    if (std::filesystem::exists(path)) {
+        spdlog::warn("Conversion index {} is unreadable; starting a new one", path);
+    }
+    if (!map(path, kInitialCapacity, true)) {
+        spdlog::error("Failed to create conversion index {}: {}", path, std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool ConversionIndex::close() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!base_) {
+        return true;
+    }
+    bool ok = ::msync(base_, length_, MS_SYNC) == 0;
+    if (!ok) {
+        spdlog::error("Failed to write conversion index {}: {}", path_, std::strerror(errno));
+    }
+    unmap();
+    return ok;
+}
+
+ConversionIndex::Slot* ConversionIndex::find(uint64_t key, uint32_t check) const {
+    uint64_t mask = header_->capacity - 1;
+    for (uint64_t i = key & mask;; i = (i + 1) & mask) {
+        Slot* slot = &slots_[i];
+        if (slot->key == 0 || (slot->key == key && slot->check == check)) {
+            return slot;
+        }
+    }
+}
+
+bool ConversionIndex::grow() {
+    uint64_t capacity = header_->capacity * 2;
+    std::string temp = path_ + ".tmp";
+    size_t length = 0;
+    unsigned char* base = map_file(temp, capacity, true, length);
+    if (!base) {
+        spdlog::error("Failed to grow conversion index {}: {}", path_, std::strerror(errno));
+        return false;
+    }
+
+    auto* header = reinterpret_cast<Header*>(base);
+    auto* slots = reinterpret_cast<Slot*>(base + sizeof(Header));
+    header->version = kVersion;
+    header->slot_size = sizeof(Slot);
+    header->capacity = capacity;
+    header->count = header_->count;
+    for (uint64_t i = 0; i < header_->capacity; ++i) {
+        const Slot& old = slots_[i];
+        if (old.key == 0) {
+            continue;
+        }
+        for (uint64_t j = old.key & (capacity - 1);; j = (j + 1) & (capacity - 1)) {
+            if (slots[j].key == 0) {
+                slots[j] = old;
+                break;
+            }
+        }
+    }
+    header->magic = kMagic;
+
+    // The old file stays valid until the rename replaces it
+    if (::rename(temp.c_str(), path_.c_str()) != 0) {
+        spdlog::error("Failed to replace conversion index {}: {}", path_, std::strerror(errno));
+        ::munmap(base, length);
+        ::unlink(temp.c_str());
+        return false;
+    }
+    unmap();
+    base_ = base;
+    length_ = length;
+    header_ = header;
+    slots_ = slots;
+    return true;
+}
+
+bool ConversionIndex::unchanged(const std::string& key, const std::string& path,
+                                const FileState& state, uint32_t options) {
+    uint64_t hash = key_hash(key);
+    uint32_t check = check_hash(key);
+    uint64_t content_hash = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (!base_) {
+            return false;
+        }
+        const Slot* slot = find(hash, check);
+        if (slot->key == 0 || slot->options != options || slot->size != state.size) {
+            return false;
+        }
+        if (slot->mtime_ns == state.mtime_ns) {
+            return true;
+        }
+        content_hash = slot->content_hash;
+    }
+
+    // Touched or copied again; only the bytes can tell
+    if (content_hash == 0 || hash_file(path) != content_hash) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    Slot* slot = find(hash, check);
+    if (slot->key != 0) {
+        slot->mtime_ns = state.mtime_ns;
+    }
+    return true;
+}
+
+void ConversionIndex::record(const std::string& key, const std::string& path,
+                             const FileState& state, uint32_t options) {
+    uint64_t hash = key_hash(key);
+    uint32_t check = check_hash(key);
+    uint64_t content_hash = hash_file(path);
+    // state was taken before converting; an edit since then, or during the
+    // hash, would pair the old state with other bytes, so leave the entry
+    // for the next run to reconvert
+    FileState now;
+    if (!path.empty() && (!stat_file(path, now) || now.mtime_ns != state.mtime_ns || now.size != state.size)) {
+        spdlog::debug("{} changed while it was converted, not indexing it", path);
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!base_) {
+        return;
+    }
+    if ((header_->count + 1) * 4 > header_->capacity * 3 && !grow()) {
+        return;
+    }
+    Slot* slot = find(hash, check);
+    bool inserted = slot->key == 0;
+    slot->mtime_ns = state.mtime_ns;
+    slot->size = state.size;
+    slot->content_hash = content_hash;
+    slot->options = options;
+    slot->check = check;
+    std::atomic_ref<uint64_t>(slot->key).store(hash, std::memory_order_release);
+    if (inserted) {
+        header_->count++;
+    }
+}
+
+#else
+
+bool ConversionIndex::map(const std::string&, uint64_t, bool) {
+    return false;
+}
+
+void ConversionIndex::unmap() {}
+
+bool ConversionIndex::open(const std::string&) {
+    spdlog::error("The conversion index needs memory-mapped files, not available on this platform");
+    return false;
+}
+
+bool ConversionIndex::close() {
+    return true;
+}
+
+ConversionIndex::Slot* ConversionIndex::find(uint64_t, uint32_t) const {
+    return nullptr;
+}
+
+bool ConversionIndex::grow() {
+    return false;
+}
+
+bool ConversionIndex::unchanged(const std::string&, const std::string&, const FileState&, uint32_t) {
+    return false;
+}
+
+void ConversionIndex::record(const std::string&, const std::string&, const FileState&, uint32_t) {}
+
+#endif
+
+} // namespace popplershot
@@ -0,0 +1,71 @@
+#include "cpu_features.h"
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POPPLERSHOT_X86 1
+#include <cpuid.h>
+#endif
+
+namespace popplershot {
+
+namespace {
+
+#ifdef POPPLERSHOT_X86
+uint64_t read_xcr0() {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+#endif
+
+} // namespace
+
+const CpuFeatures& CpuFeatures::get() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+CpuFeatures CpuFeatures::detect() {
+    CpuFeatures features;
+#ifdef POPPLERSHOT_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return features;
+    }
+    features.sse2 = edx & bit_SSE2;
+    features.ssse3 = ecx & bit_SSSE3;
+    features.sse42 = ecx & bit_SSE4_2;
+
+    // AVX registers are only usable if the OS saves them on context switch
+    bool osxsave = ecx & bit_OSXSAVE;
+    uint64_t xcr0 = osxsave ? read_xcr0() : 0;
+    bool ymm_state = (xcr0 & 0x6) == 0x6;
+    bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        features.avx2 = ymm_state && (ebx & bit_AVX2);
+        features.avx512f = zmm_state && (ebx & bit_AVX512F);
+        features.avx512bw = features.avx512f && (ebx & bit_AVX512BW);
+    }
+#endif
+    return features;
+}
+
+std::string CpuFeatures::to_string() const {
+    std::string result;
+    auto append = [&result](bool present, const char* name) {
+        if (present) {
+            result += result.empty() ? "" : " ";
+            result += name;
+        }
+    };
+    append(sse2, "sse2");
+    append(ssse3, "ssse3");
+    append(sse42, "sse4.2");
+    append(avx2, "avx2");
+    append(avx512f, "avx512f");
+    append(avx512bw, "avx512bw");
+    return result.empty() ? "none" : result;
+}
+
+} // namespace popplershot
@@ -0,0 +1,101 @@
+#include "digest.h"
+#include "image_kernels.h"
+#include <fstream>
+#include <vector>
+#include <xxhash.h>
+
+namespace popplershot {
+
+void Digest::XxhStateDeleter::operator()(XXH3_state_s* state) const {
+    XXH3_freeState(state);
+}
+
+Digest::Digest(Algorithm algorithm) : algorithm_(algorithm), crc_(0) {
+    switch (algorithm_) {
+    case Algorithm::Xxh3:
+        xxh_.reset(XXH3_createState());
+        XXH3_64bits_reset(xxh_.get());
+        break;
+    case Algorithm::Sha256:
+        sha_ = std::make_unique<Sha256>();
+        break;
+    default:
+        break;
+    }
+}
+
+Digest::~Digest() = default;
+
+void Digest::update(const void* data, size_t size) {
+    switch (algorithm_) {
+    case Algorithm::Xxh3:
+        XXH3_64bits_update(xxh_.get(), data, size);
+        break;
+    case Algorithm::Crc32c:
+        crc_ = ImageKernels::get().crc32c(crc_, static_cast<const uint8_t*>(data), size);
+        break;
+    case Algorithm::Sha256:
+        sha_->update(data, size);
+        break;
+    case Algorithm::None:
+        break;
+    }
+}
+
+std::string Digest::finish() {
+    switch (algorithm_) {
+    case Algorithm::Xxh3: {
+        // Canonical (big-endian) form, matching xxhsum output
+        XXH64_canonical_t canonical;
+        XXH64_canonicalFromHash(&canonical, XXH3_64bits_digest(xxh_.get()));
+        return Sha256::to_hex(canonical.digest, sizeof(canonical.digest));
+    }
+    case Algorithm::Crc32c: {
+        const uint8_t bytes[4] = {static_cast<uint8_t>(crc_ >> 24), static_cast<uint8_t>(crc_ >> 16),
+                                  static_cast<uint8_t>(crc_ >> 8), static_cast<uint8_t>(crc_)};
+        return Sha256::to_hex(bytes, sizeof(bytes));
+    }
+    case Algorithm::Sha256: {
+        auto hash = sha_->finish();
+        return Sha256::to_hex(hash.data(), hash.size());
+    }
+    case Algorithm::None:
+        break;
+    }
+    return {};
+}
+
+bool Digest::parse_algorithm(const std::string& name, Algorithm& algorithm) {
+    if (name == "none") algorithm = Algorithm::None;
+    else if (name == "xxh3") algorithm = Algorithm::Xxh3;
+    else if (name == "crc32c") algorithm = Algorithm::Crc32c;
+    else if (name == "sha256") algorithm = Algorithm::Sha256;
+    else return false;
+    return true;
+}
+
+const char* Digest::to_string(Algorithm algorithm) {
+    switch (algorithm) {
+    case Algorithm::Xxh3: return "xxh3";
+    case Algorithm::Crc32c: return "crc32c";
+    case Algorithm::Sha256: return "sha256";
+    case Algorithm::None: break;
+    }
+    return "none";
+}
+
+bool Digest::of_file(const std::string& path, Algorithm algorithm, std::string& hex) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    Digest digest(algorithm);
+    std::vector<char> chunk(1 << 16);
+    while (in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || in.gcount() > 0) {
+        digest.update(chunk.data(), static_cast<size_t>(in.gcount()));
+    }
+    hex = digest.finish();
+    return true;
+}
+
+} // namespace popplershot
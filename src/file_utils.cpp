@@ -1,38 +1,114 @@
 #include "file_utils.h"
+#include "archive_reader.h"
+#include "digest.h"
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string_view>
 #include <spdlog/spdlog.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace popplershot {
 
-std::vector<std::string> FileUtils::find_pdf_files(const std::string& directory) {
+std::vector<std::string> FileUtils::find_pdf_files(const std::string& directory, int threads,
+                                                   PdfDetection detection) {
     std::vector<std::string> pdf_files;
-    
-    if (!is_directory(directory)) {
-        spdlog::error("Directory does not exist: {}", directory);
+    std::mutex files_mutex;
+    auto collect = [&](std::vector<std::string>& files) {
+        std::lock_guard<std::mutex> lock(files_mutex);
+        std::move(files.begin(), files.end(), std::back_inserter(pdf_files));
+    };
+    if (!scan_pdf_files(directory, threads, collect, detection)) {
         return pdf_files;
     }
+    // Threads finish directories in any order; keep runs reproducible
+    std::sort(pdf_files.begin(), pdf_files.end());
 
-    try {
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
-            if (entry.is_regular_file()) {
-                std::string filepath = entry.path().string();
-                std::string extension = entry.path().extension().string();
-                
-                // Convert extension to lowercase for comparison
-                std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-                
-                if (extension == ".pdf") {
-                    pdf_files.push_back(filepath);
-                }
+    spdlog::info("Found {} PDF files in directory: {}", pdf_files.size(), directory);
+    return pdf_files;
+}
+
+bool FileUtils::scan_pdf_files(const std::string& directory, int threads,
+                               const DirectoryWalker::Visitor& visit, PdfDetection detection,
+                               bool archives) {
+    DirectoryWalker walker(threads);
+    if (detection == PdfDetection::Extension) {
+        if (archives) {
+            auto pdf_or_archive = [](const char* name, size_t length) {
+                return has_pdf_extension(name, length) || ArchiveReader::has_archive_extension(name, length);
+            };
+            return walker.walk(directory, pdf_or_archive, visit);
+        }
+        return walker.walk(directory, has_pdf_extension, visit);
+    }
+
+    // Every file is a candidate; its header is read on the walker thread
+    // that listed it, so the reads overlap and non-PDFs never get queued
+    std::atomic<size_t> rejected{0};
+    auto any_file = [](const char*, size_t) { return true; };
+    auto check_headers = [&](std::vector<std::string>& files) {
+        auto not_pdf = [&](const std::string& file) {
+            if ((archives && ArchiveReader::has_archive_extension(file.c_str(), file.size())) ||
+                has_pdf_header(file)) {
+                return false;
             }
+            spdlog::debug("Skipping {}: no PDF header", file);
+            rejected++;
+            return true;
+        };
+        files.erase(std::remove_if(files.begin(), files.end(), not_pdf), files.end());
+        if (!files.empty()) {
+            visit(files);
         }
-    } catch (const std::filesystem::filesystem_error& ex) {
-        spdlog::error("Error reading directory {}: {}", directory, ex.what());
+    };
+    bool ok = walker.walk(directory, any_file, check_headers);
+    if (rejected > 0) {
+        spdlog::info("Skipped {} files without a PDF header in {}", rejected.load(), directory);
     }
+    return ok;
+}
 
-    spdlog::info("Found {} PDF files in directory: {}", pdf_files.size(), directory);
-    return pdf_files;
+bool FileUtils::has_pdf_extension(const char* name, size_t length) {
+    return length > 4 && name[length - 4] == '.' &&
+           std::tolower(static_cast<unsigned char>(name[length - 3])) == 'p' &&
+           std::tolower(static_cast<unsigned char>(name[length - 2])) == 'd' &&
+           std::tolower(static_cast<unsigned char>(name[length - 1])) == 'f';
+}
+
+bool FileUtils::has_pdf_header(const std::string& path) {
+    constexpr size_t kHeaderWindow = 1024;
+    char header[kHeaderWindow];
+    size_t size = 0;
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    file.read(header, kHeaderWindow);
+    size = static_cast<size_t>(file.gcount());
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t bytes = ::pread(fd, header, kHeaderWindow, 0);
+    ::close(fd);
+    size = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+#endif
+    std::string_view window(header, size);
+    return window.find("%PDF-") != std::string_view::npos;
+}
+
+bool FileUtils::parse_pdf_detection(const std::string& name, PdfDetection& detection) {
+    if (name == "extension") detection = PdfDetection::Extension;
+    else if (name == "magic") detection = PdfDetection::Magic;
+    else return false;
+    return true;
 }
 
 bool FileUtils::create_directories(const std::string& path) {
@@ -48,6 +124,40 @@ bool FileUtils::file_exists(const std::string& path) {
     return std::filesystem::exists(path) && std::filesystem::is_regular_file(path);
 }
 
+bool FileUtils::drop_torn_line(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return true;
+    }
+    std::streamoff end = file.tellg();
+    std::streamoff keep = end;
+    char buffer[4096];
+    while (keep > 0) {
+        std::streamoff start = std::max<std::streamoff>(0, keep - static_cast<std::streamoff>(sizeof(buffer)));
+        file.seekg(start);
+        file.read(buffer, keep - start);
+        if (!file) {
+            return false;
+        }
+        std::streamoff i = keep - start;
+        while (i > 0 && buffer[i - 1] != '\n') {
+            --i;
+        }
+        if (i > 0) {
+            keep = start + i;
+            break;
+        }
+        keep = start;
+    }
+    file.close();
+    if (keep == end) {
+        return true;
+    }
+    std::error_code ec;
+    std::filesystem::resize_file(path, static_cast<uintmax_t>(keep), ec);
+    return !ec;
+}
+
 bool FileUtils::is_directory(const std::string& path) {
     return std::filesystem::exists(path) && std::filesystem::is_directory(path);
 }
@@ -82,4 +192,44 @@ bool FileUtils::ensure_output_directory(const std::string& output_dir) {
     }
 }
 
+std::string FileUtils::mirror_directory(const std::string& input_root,
+                                        const std::string& file,
+                                        const std::string& output_root) {
+    std::filesystem::path parent = std::filesystem::path(file).parent_path();
+    std::filesystem::path relative = parent.lexically_normal()
+                                         .lexically_relative(std::filesystem::path(input_root).lexically_normal());
+    // Files outside the input root (or at its top) go straight into output_root
+    if (relative.empty() || relative == "." || *relative.begin() == "..") {
+        return output_root;
+    }
+    return (std::filesystem::path(output_root) / relative).string();
+}
+
+std::string FileUtils::relative_path(const std::string& input_root, const std::string& file) {
+    std::filesystem::path relative = std::filesystem::path(file).lexically_normal()
+                                         .lexically_relative(std::filesystem::path(input_root).lexically_normal());
+    if (relative.empty() || *relative.begin() == "..") {
+        return std::filesystem::path(file).filename().generic_string();
+    }
+    return relative.generic_string();
+}
+
+std::string FileUtils::bucket_directory(const std::string& input_root,
+                                        const std::string& file,
+                                        const std::string& output_root,
+                                        int levels) {
+    std::string relative = relative_path(input_root, file);
+    Digest digest(Digest::Algorithm::Xxh3);
+    digest.update(relative.data(), relative.size());
+    std::string hash = digest.finish();
+
+    std::filesystem::path dir(output_root);
+    for (int level = 0; level < levels; ++level) {
+        dir /= hash.substr(level * 2, 2);
+    }
+    // The hash suffix keeps same-named documents apart within a bucket
+    dir /= std::filesystem::path(file).stem().string() + "-" + hash.substr(levels * 2, 8);
+    return dir.string();
+}
+
 } // namespace popplershot
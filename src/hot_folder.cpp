@@ -0,0 +1,343 @@
+#include "hot_folder.h"
+#include "archive_reader.h"
+#include <algorithm>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace popplershot {
+
+namespace {
+
+constexpr int kPollIntervalMs = 100; // How often stop is checked while idle
+constexpr size_t kEventBufferSize = 64 * 1024;
+
+} // namespace
+
+HotFolder::HotFolder(const std::string& root, const Options& options)
+    : root_(root), options_(options), fd_(-1), mount_fd_(-1) {
+    while (root_.size() > 1 && root_.back() == '/') {
+        root_.pop_back();
+    }
+}
+
+HotFolder::~HotFolder() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (mount_fd_ >= 0) {
+        ::close(mount_fd_);
+    }
+#endif
+}
+
+bool HotFolder::supported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HotFolder::parse_backend(const std::string& name, Backend& backend) {
+    if (name == "inotify") backend = Backend::Inotify;
+    else if (name == "fanotify") backend = Backend::Fanotify;
+    else return false;
+    return true;
+}
+
+bool HotFolder::wanted(const std::string& path) const {
+    if (options_.detection == FileUtils::PdfDetection::Magic) {
+        return true; // Decided from the header once the file has settled
+    }
+    std::string name = std::filesystem::path(path).filename().string();
+    return FileUtils::has_pdf_extension(name.c_str(), name.size()) ||
+           (options_.archives && ArchiveReader::has_archive_extension(name.c_str(), name.size()));
+}
+
+void HotFolder::touch(const std::string& path, bool closed) {
+    if (!wanted(path)) {
+        return;
+    }
+    Candidate& candidate = candidates_[path];
+    candidate.deadline = Clock::now() + std::chrono::milliseconds(options_.settle_ms);
+    candidate.closed = closed;
+}
+
+void HotFolder::touch_existing(const std::string& dir) {
+    std::error_code ec;
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (std::filesystem::recursive_directory_iterator it(dir, options, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            touch(it->path().string(), true);
+        }
+    }
+}
+
+bool HotFolder::release(PathQueue& queue, Clock::time_point now) {
+    for (auto it = candidates_.begin(); it != candidates_.end();) {
+        if (!it->second.closed || it->second.deadline > now) {
+            ++it;
+            continue;
+        }
+        std::string path = it->first;
+        it = candidates_.erase(it);
+
+        // Gone again, or not a PDF after all
+        if (!FileUtils::file_exists(path)) {
+            continue;
+        }
+        if (options_.archives && ArchiveReader::has_archive_extension(path.c_str(), path.size())) {
+            if (!ArchiveReader::queue_members(path, queue)) {
+                return false;
+            }
+            continue;
+        }
+        if (options_.detection == FileUtils::PdfDetection::Magic && !FileUtils::has_pdf_header(path)) {
+            spdlog::debug("Skipping {}: no PDF header", path);
+            continue;
+        }
+        spdlog::debug("Queueing {}", path);
+        if (!queue.push(InputFile{path, "", "", {}})) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+bool HotFolder::start() {
+    if (options_.backend == Backend::Fanotify) {
+        fd_ = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                            O_RDONLY | O_LARGEFILE);
+        if (fd_ < 0) {
+            spdlog::error("fanotify_init failed: {} (needs CAP_SYS_ADMIN and Linux 5.9+; "
+                          "try --watch-backend inotify)", std::strerror(errno));
+            return false;
+        }
+        uint64_t mask = FAN_CLOSE_WRITE | FAN_MOVED_TO | FAN_MODIFY | FAN_ONDIR;
+        if (fanotify_mark(fd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, root_.c_str()) != 0) {
+            spdlog::error("fanotify_mark {} failed: {}", root_, std::strerror(errno));
+            return false;
+        }
+        mount_fd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        std::error_code ec;
+        canonical_root_ = std::filesystem::canonical(root_, ec).string();
+        if (mount_fd_ < 0 || ec) {
+            spdlog::error("Failed to open watched directory: {}", root_);
+            return false;
+        }
+        spdlog::info("Watching {} with fanotify", root_);
+        return true;
+    }
+
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+        spdlog::error("inotify_init1 failed: {}", std::strerror(errno));
+        return false;
+    }
+    if (!add_watches(root_)) {
+        return false;
+    }
+    spdlog::info("Watching {} with inotify ({} directories)", root_, watches_.size());
+    return true;
+}
+
+bool HotFolder::add_watches(const std::string& dir) {
+    constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE | IN_ONLYDIR;
+    auto add = [this](const std::string& path) {
+        int wd = inotify_add_watch(fd_, path.c_str(), mask);
+        if (wd < 0) {
+            if (errno == ENOSPC) {
+                spdlog::error("Out of inotify watches at {}; raise fs.inotify.max_user_watches "
+                              "or use --watch-backend fanotify", path);
+            } else {
+                spdlog::warn("Cannot watch {}: {}", path, std::strerror(errno));
+            }
+            return errno != ENOSPC;
+        }
+        watches_[wd] = path;
+        return true;
+    };
+
+    if (!add(dir)) {
+        return false;
+    }
+    std::error_code ec;
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (std::filesystem::recursive_directory_iterator it(dir, options, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec) && !add(it->path().string())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HotFolder::handle_inotify_events() {
+    alignas(inotify_event) char buffer[kEventBufferSize];
+    for (;;) {
+        ssize_t bytes = ::read(fd_, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            return;
+        }
+        for (char* p = buffer; p < buffer + bytes;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                spdlog::warn("inotify queue overflowed; rescanning {}", root_);
+                touch_existing(root_);
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(event->wd);
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end() || event->len == 0) {
+                continue;
+            }
+            std::string path = watch->second + "/" + event->name;
+
+            if (event->mask & IN_ISDIR) {
+                // A new or moved-in directory may already hold files
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    add_watches(path);
+                    touch_existing(path);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                touch(path, true);
+            } else if (event->mask & IN_MODIFY) {
+                touch(path, false);
+            }
+        }
+    }
+}
+
+void HotFolder::handle_fanotify_events() {
+    alignas(fanotify_event_metadata) char buffer[kEventBufferSize];
+    for (;;) {
+        ssize_t bytes = ::read(fd_, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            return;
+        }
+        auto* event = reinterpret_cast<fanotify_event_metadata*>(buffer);
+        for (; FAN_EVENT_OK(event, bytes); event = FAN_EVENT_NEXT(event, bytes)) {
+            if (event->mask & FAN_Q_OVERFLOW) {
+                spdlog::warn("fanotify queue overflowed; rescanning {}", root_);
+                touch_existing(root_);
+                continue;
+            }
+            auto* info = reinterpret_cast<fanotify_event_info_fid*>(event + 1);
+            if (event->event_len < sizeof(*event) + sizeof(*info) ||
+                info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                continue;
+            }
+            auto* handle = reinterpret_cast<file_handle*>(info->handle);
+            const char* name = reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes);
+
+            // The event names a directory handle; resolve it to a path
+            int dir_fd = open_by_handle_at(mount_fd_, handle, O_PATH | O_CLOEXEC);
+            if (dir_fd < 0) {
+                continue; // Directory already gone
+            }
+            char dir[PATH_MAX];
+            std::string link = "/proc/self/fd/" + std::to_string(dir_fd);
+            ssize_t length = ::readlink(link.c_str(), dir, sizeof(dir) - 1);
+            ::close(dir_fd);
+            if (length <= 0) {
+                continue;
+            }
+            std::string dir_path(dir, static_cast<size_t>(length));
+
+            // The mark covers the whole filesystem; keep events below root
+            if (dir_path != canonical_root_ &&
+                dir_path.compare(0, canonical_root_.size() + 1, canonical_root_ + "/") != 0) {
+                continue;
+            }
+            std::string path = root_ + dir_path.substr(canonical_root_.size()) + "/" + name;
+
+            if (event->mask & FAN_ONDIR) {
+                if (event->mask & FAN_MOVED_TO) {
+                    touch_existing(path);
+                }
+            } else if (event->mask & (FAN_CLOSE_WRITE | FAN_MOVED_TO)) {
+                touch(path, true);
+            } else if (event->mask & FAN_MODIFY) {
+                touch(path, false);
+            }
+        }
+    }
+}
+
+bool HotFolder::run(PathQueue& queue, const std::atomic<bool>& stop) {
+    while (!stop) {
+        // Wake for the next settling file, or to check stop
+        int timeout = kPollIntervalMs;
+        auto now = Clock::now();
+        for (const auto& [path, candidate] : candidates_) {
+            if (candidate.closed) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(candidate.deadline - now);
+                timeout = std::clamp(static_cast<int>(wait.count()) + 1, 0, timeout);
+            }
+        }
+
+        pollfd poll_fd{fd_, POLLIN, 0};
+        int ready = ::poll(&poll_fd, 1, timeout);
+        if (ready < 0 && errno != EINTR) {
+            spdlog::error("Waiting for file events failed: {}", std::strerror(errno));
+            return false;
+        }
+        if (ready > 0) {
+            if (options_.backend == Backend::Fanotify) {
+                handle_fanotify_events();
+            } else {
+                handle_inotify_events();
+            }
+        }
+        if (!release(queue, Clock::now())) {
+            break;
+        }
+    }
+    if (!candidates_.empty()) {
+        spdlog::info("Stopped watching with {} files still arriving", candidates_.size());
+    }
+    return true;
+}
+
+#else
+
+bool HotFolder::start() {
+    spdlog::error("Watching directories is only supported on Linux");
+    return false;
+}
+
+bool HotFolder::add_watches(const std::string&) {
+    return false;
+}
+
+void HotFolder::handle_inotify_events() {}
+
+void HotFolder::handle_fanotify_events() {}
+
+bool HotFolder::run(PathQueue&, const std::atomic<bool>&) {
+    return false;
+}
+
+#endif
+
+} // namespace popplershot
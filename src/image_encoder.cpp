@@ -0,0 +1,357 @@
+#include "image_encoder.h"
+#include "image_kernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csetjmp>
+#include <spdlog/spdlog.h>
+#include <png.h>
+#include <jpeglib.h>
+
+namespace popplershot {
+
+namespace {
+
+void png_write_to_vector(png_structp png, png_bytep data, png_size_t length) {
+    auto* out = static_cast<std::vector<unsigned char>*>(png_get_io_ptr(png));
+    out->insert(out->end(), data, data + length);
+}
+
+void png_flush_noop(png_structp) {}
+
+void png_log_warning(png_structp, png_const_charp message) {
+    spdlog::debug("libpng warning: {}", message);
+}
+
+void png_log_error(png_structp png, png_const_charp message) {
+    spdlog::error("libpng error: {}", message);
+    png_longjmp(png, 1);
+}
+
+int bit_depth_for_palette(size_t palette_size) {
+    if (palette_size <= 2) return 1;
+    if (palette_size <= 4) return 2;
+    if (palette_size <= 16) return 4;
+    return 8;
+}
+
+bool is_opaque(const Raster& raster) {
+    if (raster.channels != 4) {
+        return true;
+    }
+    const auto all_opaque = ImageKernels::get().all_opaque;
+    for (int y = 0; y < raster.height; ++y) {
+        if (!all_opaque(raster.row(y), static_cast<size_t>(raster.width))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int Channels>
+void pack_bilevel_row(const uint8_t* src, png_bytep row, int width) {
+    std::memset(row, 0, (static_cast<size_t>(width) + 7) / 8);
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* p = src + static_cast<size_t>(x) * Channels;
+        int luma = Channels == 1 ? p[0] : (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+        if (luma >= 128) {
+            row[x / 8] |= static_cast<png_byte>(0x80 >> (x % 8));
+        }
+    }
+}
+
+using BilevelPacker = void (*)(const uint8_t*, png_bytep, int);
+
+// Kept free of objects with destructors so the libpng longjmp cannot skip them
+bool write_indexed_png(png_structp png, png_infop info,
+                       const PaletteQuantizer::Result& quantized,
+                       int width, int height, int bit_depth, int compression_level,
+                       const png_color* colors, int color_count,
+                       const png_byte* alpha, int alpha_count,
+                       png_bytep row) {
+    if (setjmp(png_jmpbuf(png))) {
+        return false;
+    }
+
+    png_set_IHDR(png, info, width, height, bit_depth, PNG_COLOR_TYPE_PALETTE,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_PLTE(png, info, colors, color_count);
+    if (alpha_count > 0) {
+        png_set_tRNS(png, info, alpha, alpha_count, nullptr);
+    }
+    // Filtering rarely helps palette data and costs encode time
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+    png_set_compression_level(png, compression_level);
+    png_write_info(png, info);
+
+    int pixels_per_byte = 8 / bit_depth;
+    size_t row_bytes = (static_cast<size_t>(width) + pixels_per_byte - 1) / pixels_per_byte;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* indices = quantized.indices.data() + static_cast<size_t>(y) * width;
+        if (bit_depth == 8) {
+            std::memcpy(row, indices, width);
+        } else {
+            std::memset(row, 0, row_bytes);
+            for (int x = 0; x < width; ++x) {
+                int shift = 8 - bit_depth * (x % pixels_per_byte + 1);
+                row[x / pixels_per_byte] |= static_cast<png_byte>(indices[x] << shift);
+            }
+        }
+        png_write_row(png, row);
+    }
+
+    png_write_end(png, info);
+    return true;
+}
+
+bool write_bilevel_png(png_structp png, png_infop info, const Raster& raster,
+                       BilevelPacker pack, int compression_level, png_bytep row) {
+    if (setjmp(png_jmpbuf(png))) {
+        return false;
+    }
+
+    png_set_IHDR(png, info, raster.width, raster.height, 1, PNG_COLOR_TYPE_GRAY,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+    png_set_compression_level(png, compression_level);
+    png_write_info(png, info);
+
+    for (int y = 0; y < raster.height; ++y) {
+        pack(raster.row(y), row, raster.width);
+        png_write_row(png, row);
+    }
+
+    png_write_end(png, info);
+    return true;
+}
+
+bool write_truecolor_png(png_structp png, png_infop info, const Raster& raster, bool drop_alpha,
+                         int compression_level, png_bytep row) {
+    if (setjmp(png_jmpbuf(png))) {
+        return false;
+    }
+
+    int color_type = raster.channels == 1 ? PNG_COLOR_TYPE_GRAY
+                   : raster.channels == 3 || drop_alpha ? PNG_COLOR_TYPE_RGB
+                   : PNG_COLOR_TYPE_RGBA;
+    png_set_IHDR(png, info, raster.width, raster.height, 8, color_type,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Adaptive filtering is the expensive part at low zlib levels
+    png_set_filter(png, PNG_FILTER_TYPE_BASE,
+                   compression_level <= 3 ? PNG_FILTER_SUB : PNG_ALL_FILTERS);
+    png_set_compression_level(png, compression_level);
+    png_write_info(png, info);
+
+    for (int y = 0; y < raster.height; ++y) {
+        const uint8_t* src = raster.row(y);
+        if (drop_alpha) {
+            for (int x = 0; x < raster.width; ++x) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            png_write_row(png, row);
+        } else {
+            // libpng does not modify rows it is given
+            png_write_row(png, const_cast<png_bytep>(src));
+        }
+    }
+
+    png_write_end(png, info);
+    return true;
+}
+
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+};
+
+void jpeg_log_error(j_common_ptr cinfo) {
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    spdlog::error("libjpeg error: {}", message);
+    longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+// Same longjmp rule as the PNG writers: no destructible locals past setjmp
+bool write_jpeg(jpeg_compress_struct* cinfo, JpegErrorManager* error, const Raster& raster,
+                int quality, int effort, JSAMPROW row,
+                unsigned char** buffer, unsigned long* size) {
+    if (setjmp(error->jump)) {
+        return false;
+    }
+
+    jpeg_mem_dest(cinfo, buffer, size);
+    cinfo->image_width = static_cast<JDIMENSION>(raster.width);
+    cinfo->image_height = static_cast<JDIMENSION>(raster.height);
+    if (raster.channels == 1) {
+        cinfo->input_components = 1;
+        cinfo->in_color_space = JCS_GRAYSCALE;
+    } else {
+        cinfo->input_components = 3;
+        cinfo->in_color_space = JCS_RGB;
+#ifdef JCS_EXTENSIONS
+        // libjpeg-turbo reads RGBX rows directly
+        if (raster.channels == 4) {
+            cinfo->input_components = 4;
+            cinfo->in_color_space = JCS_EXT_RGBX;
+        }
+#endif
+    }
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, std::clamp(quality, 1, 100), TRUE);
+    cinfo->dct_method = effort < 4 ? JDCT_IFAST : JDCT_ISLOW;
+    cinfo->optimize_coding = effort >= 7 ? TRUE : FALSE;
+    jpeg_start_compress(cinfo, TRUE);
+
+    bool repack = raster.channels == 4 && cinfo->input_components == 3;
+    while (cinfo->next_scanline < cinfo->image_height) {
+        const uint8_t* src = raster.row(static_cast<int>(cinfo->next_scanline));
+        JSAMPROW scanline = const_cast<JSAMPROW>(src);
+        if (repack) {
+            for (int x = 0; x < raster.width; ++x) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            scanline = row;
+        }
+        jpeg_write_scanlines(cinfo, &scanline, 1);
+    }
+
+    jpeg_finish_compress(cinfo);
+    return true;
+}
+
+png_structp create_png_writer(png_infop& info, std::vector<unsigned char>& out) {
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                              png_log_error, png_log_warning);
+    if (!png) {
+        return nullptr;
+    }
+    info = png_create_info_struct(png);
+    if (!info) {
+        png_destroy_write_struct(&png, nullptr);
+        return nullptr;
+    }
+    out.clear();
+    png_set_write_fn(png, &out, png_write_to_vector, png_flush_noop);
+    return png;
+}
+
+} // namespace
+
+bool ImageEncoder::encode_png(const Raster& raster, int compression_level,
+                              std::vector<unsigned char>& out) {
+    if (!raster.data || raster.width <= 0 || raster.height <= 0) {
+        return false;
+    }
+
+    png_infop info = nullptr;
+    png_structp png = create_png_writer(info, out);
+    if (!png) {
+        return false;
+    }
+    out.reserve(static_cast<size_t>(raster.width) * raster.height);
+
+    bool drop_alpha = raster.channels == 4 && is_opaque(raster);
+    std::vector<png_byte> row(drop_alpha ? static_cast<size_t>(raster.width) * 3 : 0);
+    bool ok = write_truecolor_png(png, info, raster, drop_alpha,
+                                  std::clamp(compression_level, 0, 9), row.data());
+
+    png_destroy_write_struct(&png, &info);
+    return ok;
+}
+
+bool ImageEncoder::encode_indexed_png(const PaletteQuantizer::Result& quantized,
+                                      int width, int height, int compression_level,
+                                      std::vector<unsigned char>& out) {
+    size_t color_count = quantized.palette.size() / 4;
+    if (color_count == 0 || color_count > 256 ||
+        quantized.indices.size() != static_cast<size_t>(width) * height) {
+        return false;
+    }
+
+    std::vector<png_color> colors(color_count);
+    std::vector<png_byte> alpha(color_count);
+    int alpha_count = 0;
+    for (size_t i = 0; i < color_count; ++i) {
+        colors[i].red = quantized.palette[i * 4 + 0];
+        colors[i].green = quantized.palette[i * 4 + 1];
+        colors[i].blue = quantized.palette[i * 4 + 2];
+        alpha[i] = quantized.palette[i * 4 + 3];
+        if (alpha[i] != 255) {
+            alpha_count = static_cast<int>(i) + 1;
+        }
+    }
+
+    png_infop info = nullptr;
+    png_structp png = create_png_writer(info, out);
+    if (!png) {
+        return false;
+    }
+    out.reserve(static_cast<size_t>(width) * height / 4);
+
+    std::vector<png_byte> row(static_cast<size_t>(width));
+    bool ok = write_indexed_png(png, info, quantized, width, height,
+                                bit_depth_for_palette(color_count),
+                                std::clamp(compression_level, 0, 9),
+                                colors.data(), static_cast<int>(color_count),
+                                alpha.data(), alpha_count, row.data());
+
+    png_destroy_write_struct(&png, &info);
+    return ok;
+}
+
+bool ImageEncoder::encode_bilevel_png(const Raster& raster, int compression_level,
+                                      std::vector<unsigned char>& out) {
+    if (!raster.data || raster.width <= 0 || raster.height <= 0) {
+        return false;
+    }
+
+    BilevelPacker pack = raster.channels == 1 ? pack_bilevel_row<1>
+                       : raster.channels == 3 ? pack_bilevel_row<3>
+                       : pack_bilevel_row<4>;
+
+    png_infop info = nullptr;
+    png_structp png = create_png_writer(info, out);
+    if (!png) {
+        return false;
+    }
+    out.reserve(static_cast<size_t>(raster.width) * raster.height / 32);
+
+    std::vector<png_byte> row((static_cast<size_t>(raster.width) + 7) / 8);
+    bool ok = write_bilevel_png(png, info, raster, pack,
+                                std::clamp(compression_level, 0, 9), row.data());
+
+    png_destroy_write_struct(&png, &info);
+    return ok;
+}
+
+bool ImageEncoder::encode_jpeg(const Raster& raster, int quality, int effort,
+                               std::vector<unsigned char>& out) {
+    if (!raster.data || raster.width <= 0 || raster.height <= 0) {
+        return false;
+    }
+
+    jpeg_compress_struct cinfo;
+    JpegErrorManager error;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpeg_log_error;
+    jpeg_create_compress(&cinfo);
+
+    std::vector<JSAMPLE> row(static_cast<size_t>(raster.width) * 3);
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    bool ok = write_jpeg(&cinfo, &error, raster, quality, effort, row.data(), &buffer, &size);
+
+    jpeg_destroy_compress(&cinfo);
+    if (ok) {
+        out.assign(buffer, buffer + size);
+    }
+    std::free(buffer);
+    return ok;
+}
+
+} // namespace popplershot
@@ -0,0 +1,651 @@
+#include "image_kernels.h"
+#include "cpu_features.h"
+#include <array>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POPPLERSHOT_X86 1
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace popplershot {
+
+namespace {
+
+// Scalar reference implementations, also the fallback on non-x86 hosts
+
+void argb32_to_rgba_scalar(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        uint32_t v;
+        std::memcpy(&v, src + static_cast<size_t>(x) * 4, sizeof(v));
+        uint8_t* d = dst + static_cast<size_t>(x) * 4;
+        d[0] = static_cast<uint8_t>(v >> 16);
+        d[1] = static_cast<uint8_t>(v >> 8);
+        d[2] = static_cast<uint8_t>(v);
+        d[3] = static_cast<uint8_t>(v >> 24);
+    }
+}
+
+void argb32_to_rgb_scalar(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        uint32_t v;
+        std::memcpy(&v, src + static_cast<size_t>(x) * 4, sizeof(v));
+        uint8_t* d = dst + static_cast<size_t>(x) * 3;
+        d[0] = static_cast<uint8_t>(v >> 16);
+        d[1] = static_cast<uint8_t>(v >> 8);
+        d[2] = static_cast<uint8_t>(v);
+    }
+}
+
+void argb32_to_luma_scalar(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        uint32_t v;
+        std::memcpy(&v, src + static_cast<size_t>(x) * 4, sizeof(v));
+        uint32_t r = (v >> 16) & 0xff, g = (v >> 8) & 0xff, b = v & 0xff;
+        dst[x] = static_cast<uint8_t>((r * 77 + g * 150 + b * 29) >> 8);
+    }
+}
+
+bool all_opaque_scalar(const uint8_t* rgba, size_t pixel_count) {
+    for (size_t i = 0; i < pixel_count; ++i) {
+        if (rgba[i * 4 + 3] != 255) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr std::array<uint32_t, 256> make_crc32c_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr auto kCrc32cTable = make_crc32c_table();
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t* data, size_t size) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = (crc >> 8) ^ kCrc32cTable[(crc ^ data[i]) & 0xff];
+    }
+    return ~crc;
+}
+
+inline uint8_t average(uint8_t a, uint8_t b) {
+    return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+void downsample_2x_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    for (int x = 0; x < dst_width; ++x) {
+        const uint8_t* a = row0 + static_cast<size_t>(x) * 8;
+        const uint8_t* b = row1 + static_cast<size_t>(x) * 8;
+        for (int c = 0; c < 4; ++c) {
+            dst[static_cast<size_t>(x) * 4 + c] = average(average(a[c], b[c]), average(a[c + 4], b[c + 4]));
+        }
+    }
+}
+
+void histogram_keys_scalar(const uint8_t* rgba, uint32_t* keys, size_t pixel_count) {
+    for (size_t i = 0; i < pixel_count; ++i) {
+        const uint8_t* p = rgba + i * 4;
+        keys[i] = (static_cast<uint32_t>(p[0] >> 3) << 13) | (static_cast<uint32_t>(p[1] >> 3) << 8) |
+                  (static_cast<uint32_t>(p[2] >> 3) << 3) | static_cast<uint32_t>(p[3] >> 5);
+    }
+}
+
+#ifdef POPPLERSHOT_X86
+
+// 0xAARRGGBB -> 0xAABBGGRR in every 32-bit lane
+TARGET("sse2") void argb32_to_rgba_sse2(const uint8_t* src, uint8_t* dst, int width) {
+    const __m128i ag_mask = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+    const __m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        __m128i rb = _mm_and_si128(v, rb_mask);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),
+                         _mm_or_si128(_mm_and_si128(v, ag_mask), rb));
+    }
+    argb32_to_rgba_scalar(src + x * 4, dst + x * 4, width - x);
+}
+
+TARGET("avx2") void argb32_to_rgba_avx2(const uint8_t* src, uint8_t* dst, int width) {
+    const __m256i ag_mask = _mm256_set1_epi32(static_cast<int>(0xFF00FF00u));
+    const __m256i rb_mask = _mm256_set1_epi32(0x00FF00FF);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        __m256i rb = _mm256_and_si256(v, rb_mask);
+        rb = _mm256_or_si256(_mm256_slli_epi32(rb, 16), _mm256_srli_epi32(rb, 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4),
+                            _mm256_or_si256(_mm256_and_si256(v, ag_mask), rb));
+    }
+    argb32_to_rgba_sse2(src + x * 4, dst + x * 4, width - x);
+}
+
+TARGET("avx512f") void argb32_to_rgba_avx512(const uint8_t* src, uint8_t* dst, int width) {
+    const __m512i ag_mask = _mm512_set1_epi32(static_cast<int>(0xFF00FF00u));
+    const __m512i rb_mask = _mm512_set1_epi32(0x00FF00FF);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m512i v = _mm512_loadu_si512(src + x * 4);
+        // AVX-512 has a native rotate, which swaps R and B in one step
+        __m512i rb = _mm512_maskz_rol_epi32(0xFFFF, _mm512_and_si512(v, rb_mask), 16);
+        _mm512_storeu_si512(dst + x * 4, _mm512_or_si512(_mm512_and_si512(v, ag_mask), rb));
+    }
+    argb32_to_rgba_avx2(src + x * 4, dst + x * 4, width - x);
+}
+
+// In memory an ARGB32 pixel is B, G, R, A; keep R, G, B of each
+TARGET("ssse3") void argb32_to_rgb_ssse3(const uint8_t* src, uint8_t* dst, int width) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    int x = 0;
+    // Each store writes 16 bytes for 12, so stop while the extra 4 still land in the row
+    for (; x + 6 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm_shuffle_epi8(v, shuffle));
+    }
+    argb32_to_rgb_scalar(src + x * 4, dst + x * 3, width - x);
+}
+
+TARGET("avx2") void argb32_to_rgb_avx2(const uint8_t* src, uint8_t* dst, int width) {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    // Closes the gap between the 12 bytes packed in each 128-bit lane
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    int x = 0;
+    for (; x + 11 <= width; x += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4)),
+                                        shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 3), _mm256_permutevar8x32_epi32(v, pack));
+    }
+    argb32_to_rgb_ssse3(src + x * 4, dst + x * 3, width - x);
+}
+
+// Luma of 4 pixels in 32-bit lanes; the weights sum to 256, so the 16-bit
+// products and their sums never overflow
+TARGET("ssse3") inline __m128i luma4_ssse3(__m128i v, __m128i weights) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights);
+    return _mm_srli_epi32(_mm_hadd_epi32(lo, hi), 8);
+}
+
+TARGET("ssse3") void argb32_to_luma_ssse3(const uint8_t* src, uint8_t* dst, int width) {
+    const __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const auto* in = reinterpret_cast<const __m128i*>(src + x * 4);
+        __m128i a = luma4_ssse3(_mm_loadu_si128(in), weights);
+        __m128i b = luma4_ssse3(_mm_loadu_si128(in + 1), weights);
+        __m128i c = luma4_ssse3(_mm_loadu_si128(in + 2), weights);
+        __m128i d = luma4_ssse3(_mm_loadu_si128(in + 3), weights);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                         _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+    argb32_to_luma_scalar(src + x * 4, dst + x, width - x);
+}
+
+TARGET("avx2") inline __m256i luma8_avx2(__m256i v, __m256i weights) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(v, zero), weights);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(v, zero), weights);
+    return _mm256_srli_epi32(_mm256_hadd_epi32(lo, hi), 8);
+}
+
+TARGET("avx2") void argb32_to_luma_avx2(const uint8_t* src, uint8_t* dst, int width) {
+    const __m256i weights = _mm256_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0,
+                                              29, 150, 77, 0, 29, 150, 77, 0);
+    // The packs interleave 128-bit lanes; this puts the 4-pixel groups back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const auto* in = reinterpret_cast<const __m256i*>(src + x * 4);
+        __m256i a = luma8_avx2(_mm256_loadu_si256(in), weights);
+        __m256i b = luma8_avx2(_mm256_loadu_si256(in + 1), weights);
+        __m256i c = luma8_avx2(_mm256_loadu_si256(in + 2), weights);
+        __m256i d = luma8_avx2(_mm256_loadu_si256(in + 3), weights);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    argb32_to_luma_ssse3(src + x * 4, dst + x, width - x);
+}
+
+TARGET("sse2") bool all_opaque_sse2(const uint8_t* rgba, size_t pixel_count) {
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    size_t i = 0;
+    for (; i + 4 <= pixel_count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha), alpha)) != 0xFFFF) {
+            return false;
+        }
+    }
+    return all_opaque_scalar(rgba + i * 4, pixel_count - i);
+}
+
+TARGET("avx2") bool all_opaque_avx2(const uint8_t* rgba, size_t pixel_count) {
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+    size_t i = 0;
+    for (; i + 8 <= pixel_count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(v, alpha), alpha)) != -1) {
+            return false;
+        }
+    }
+    return all_opaque_sse2(rgba + i * 4, pixel_count - i);
+}
+
+TARGET("avx512f") bool all_opaque_avx512(const uint8_t* rgba, size_t pixel_count) {
+    const __m512i alpha = _mm512_set1_epi32(static_cast<int>(0xFF000000u));
+    size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16) {
+        __m512i v = _mm512_loadu_si512(rgba + i * 4);
+        if (_mm512_cmpneq_epi32_mask(_mm512_and_si512(v, alpha), alpha) != 0) {
+            return false;
+        }
+    }
+    return all_opaque_avx2(rgba + i * 4, pixel_count - i);
+}
+
+TARGET("sse4.2") uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t size) {
+    crc = ~crc;
+    size_t i = 0;
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; i + 4 <= size; i += 4) {
+        uint32_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; i < size; ++i) {
+        crc = _mm_crc32_u8(crc, data[i]);
+    }
+    return ~crc;
+}
+
+TARGET("sse2") void downsample_2x_sse2(const uint8_t* row0, const uint8_t* row1,
+                                       uint8_t* dst, int dst_width) {
+    int x = 0;
+    for (; x + 4 <= dst_width; x += 4) {
+        const uint8_t* a = row0 + x * 8;
+        const uint8_t* b = row1 + x * 8;
+        __m128i v0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+        __m128i v1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16)));
+        __m128 f0 = _mm_castsi128_ps(v0);
+        __m128 f1 = _mm_castsi128_ps(v1);
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_avg_epu8(even, odd));
+    }
+    downsample_2x_scalar(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x);
+}
+
+TARGET("avx2") void downsample_2x_avx2(const uint8_t* row0, const uint8_t* row1,
+                                       uint8_t* dst, int dst_width) {
+    int x = 0;
+    for (; x + 8 <= dst_width; x += 8) {
+        const uint8_t* a = row0 + x * 8;
+        const uint8_t* b = row1 + x * 8;
+        __m256i v0 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+        __m256i v1 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 32)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32)));
+        __m256 f0 = _mm256_castsi256_ps(v0);
+        __m256 f1 = _mm256_castsi256_ps(v1);
+        // Shuffles stay within 128-bit lanes; the permute restores pixel order
+        __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i result = _mm256_permute4x64_epi64(_mm256_avg_epu8(even, odd), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), result);
+    }
+    downsample_2x_sse2(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x);
+}
+
+TARGET("avx512f,avx512bw") void downsample_2x_avx512(const uint8_t* row0, const uint8_t* row1,
+                                                     uint8_t* dst, int dst_width) {
+    const __m512i even_index = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16,
+                                                14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd_index = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17,
+                                               15, 13, 11, 9, 7, 5, 3, 1);
+    int x = 0;
+    for (; x + 16 <= dst_width; x += 16) {
+        const uint8_t* a = row0 + x * 8;
+        const uint8_t* b = row1 + x * 8;
+        __m512i v0 = _mm512_avg_epu8(_mm512_loadu_si512(a), _mm512_loadu_si512(b));
+        __m512i v1 = _mm512_avg_epu8(_mm512_loadu_si512(a + 64), _mm512_loadu_si512(b + 64));
+        __m512i even = _mm512_permutex2var_epi32(v0, even_index, v1);
+        __m512i odd = _mm512_permutex2var_epi32(v0, odd_index, v1);
+        _mm512_storeu_si512(dst + x * 4, _mm512_avg_epu8(even, odd));
+    }
+    downsample_2x_avx2(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x);
+}
+
+// With RGBA little-endian in a word: r << 13 is (v & 0xf8) << 10, g << 8 is
+// (v & 0xf800) >> 3, b << 3 is (v >> 16) & 0xf8 and a is v >> 29
+TARGET("sse2") void histogram_keys_sse2(const uint8_t* rgba, uint32_t* keys, size_t pixel_count) {
+    const __m128i low5 = _mm_set1_epi32(0xf8);
+    const __m128i green5 = _mm_set1_epi32(0xf800);
+    size_t i = 0;
+    for (; i + 4 <= pixel_count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+        __m128i rg = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, low5), 10),
+                                  _mm_srli_epi32(_mm_and_si128(v, green5), 3));
+        __m128i ba = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low5), _mm_srli_epi32(v, 29));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(keys + i), _mm_or_si128(rg, ba));
+    }
+    histogram_keys_scalar(rgba + i * 4, keys + i, pixel_count - i);
+}
+
+TARGET("avx2") void histogram_keys_avx2(const uint8_t* rgba, uint32_t* keys, size_t pixel_count) {
+    const __m256i low5 = _mm256_set1_epi32(0xf8);
+    const __m256i green5 = _mm256_set1_epi32(0xf800);
+    size_t i = 0;
+    for (; i + 8 <= pixel_count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+        __m256i rg = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, low5), 10),
+                                     _mm256_srli_epi32(_mm256_and_si256(v, green5), 3));
+        __m256i ba = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(v, 16), low5),
+                                     _mm256_srli_epi32(v, 29));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(keys + i), _mm256_or_si256(rg, ba));
+    }
+    histogram_keys_sse2(rgba + i * 4, keys + i, pixel_count - i);
+}
+
+TARGET("avx512f") void histogram_keys_avx512(const uint8_t* rgba, uint32_t* keys, size_t pixel_count) {
+    const __m512i low5 = _mm512_set1_epi32(0xf8);
+    const __m512i green5 = _mm512_set1_epi32(0xf800);
+    size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16) {
+        __m512i v = _mm512_loadu_si512(rgba + i * 4);
+        __m512i rg = _mm512_or_si512(_mm512_slli_epi32(_mm512_and_si512(v, low5), 10),
+                                     _mm512_srli_epi32(_mm512_and_si512(v, green5), 3));
+        __m512i ba = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi32(v, 16), low5),
+                                     _mm512_srli_epi32(v, 29));
+        _mm512_storeu_si512(keys + i, _mm512_or_si512(rg, ba));
+    }
+    histogram_keys_avx2(rgba + i * 4, keys + i, pixel_count - i);
+}
+
+#endif // POPPLERSHOT_X86
+
+template <typename Fn>
+struct Variant {
+    const char* name;
+    bool (*supported)(const CpuFeatures&);
+    Fn fn;
+};
+
+bool always(const CpuFeatures&) { return true; }
+#ifdef POPPLERSHOT_X86
+bool has_sse2(const CpuFeatures& f) { return f.sse2; }
+bool has_ssse3(const CpuFeatures& f) { return f.ssse3; }
+bool has_sse42(const CpuFeatures& f) { return f.sse42; }
+bool has_avx2(const CpuFeatures& f) { return f.avx2; }
+bool has_avx512f(const CpuFeatures& f) { return f.avx512f; }
+bool has_avx512bw(const CpuFeatures& f) { return f.avx512bw; }
+#endif
+
+// Best first; the scalar entry always terminates the list
+const Variant<ImageKernels::SwizzleFn> kSwizzleVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"avx512", has_avx512f, argb32_to_rgba_avx512},
+    {"avx2", has_avx2, argb32_to_rgba_avx2},
+    {"sse2", has_sse2, argb32_to_rgba_sse2},
+#endif
+    {"scalar", always, argb32_to_rgba_scalar},
+};
+
+const Variant<ImageKernels::SwizzleFn> kRgbVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"avx2", has_avx2, argb32_to_rgb_avx2},
+    {"ssse3", has_ssse3, argb32_to_rgb_ssse3},
+#endif
+    {"scalar", always, argb32_to_rgb_scalar},
+};
+
+const Variant<ImageKernels::SwizzleFn> kLumaVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"avx2", has_avx2, argb32_to_luma_avx2},
+    {"ssse3", has_ssse3, argb32_to_luma_ssse3},
+#endif
+    {"scalar", always, argb32_to_luma_scalar},
+};
+
+const Variant<ImageKernels::OpaqueFn> kOpaqueVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"avx512", has_avx512f, all_opaque_avx512},
+    {"avx2", has_avx2, all_opaque_avx2},
+    {"sse2", has_sse2, all_opaque_sse2},
+#endif
+    {"scalar", always, all_opaque_scalar},
+};
+
+const Variant<ImageKernels::Crc32cFn> kCrc32cVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"sse4.2", has_sse42, crc32c_sse42},
+#endif
+    {"scalar", always, crc32c_scalar},
+};
+
+const Variant<ImageKernels::Downsample2xFn> kDownsampleVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"avx512", has_avx512bw, downsample_2x_avx512},
+    {"avx2", has_avx2, downsample_2x_avx2},
+    {"sse2", has_sse2, downsample_2x_sse2},
+#endif
+    {"scalar", always, downsample_2x_scalar},
+};
+
+const Variant<ImageKernels::HistogramKeysFn> kHistogramKeyVariants[] = {
+#ifdef POPPLERSHOT_X86
+    {"avx512", has_avx512f, histogram_keys_avx512},
+    {"avx2", has_avx2, histogram_keys_avx2},
+    {"sse2", has_sse2, histogram_keys_sse2},
+#endif
+    {"scalar", always, histogram_keys_scalar},
+};
+
+template <typename Fn, size_t N>
+const Variant<Fn>& select(const Variant<Fn> (&variants)[N], const CpuFeatures& features) {
+    for (const auto& variant : variants) {
+        if (variant.supported(features)) {
+            return variant;
+        }
+    }
+    return variants[N - 1];
+}
+
+ImageKernels make_kernels(const CpuFeatures& features) {
+    const auto& swizzle = select(kSwizzleVariants, features);
+    const auto& rgb = select(kRgbVariants, features);
+    const auto& luma = select(kLumaVariants, features);
+    const auto& opaque = select(kOpaqueVariants, features);
+    const auto& crc = select(kCrc32cVariants, features);
+    const auto& downsample = select(kDownsampleVariants, features);
+    const auto& keys = select(kHistogramKeyVariants, features);
+    return {swizzle.fn, rgb.fn, luma.fn, opaque.fn, crc.fn, downsample.fn, keys.fn,
+            swizzle.name, rgb.name, luma.name, opaque.name, crc.name, downsample.name, keys.name};
+}
+
+// Deterministic test data so a mismatch reproduces across runs
+std::vector<uint8_t> make_test_bytes(size_t size, uint32_t seed) {
+    std::vector<uint8_t> bytes(size);
+    uint32_t state = seed;
+    for (auto& byte : bytes) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = static_cast<uint8_t>(state);
+    }
+    return bytes;
+}
+
+// Widths around every vector size plus a long row
+constexpr int kTestWidths[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1027};
+
+// Byte offsets every buffer is also tried at, since rows of odd widths and
+// slices of larger buffers start anywhere
+constexpr size_t kTestShifts[] = {0, 1, 3, 7};
+
+// Bytes past the end of every output that a kernel must leave untouched
+constexpr size_t kGuardBytes = 64;
+
+template <typename Fn, size_t N, typename Check>
+bool verify_kernel(std::ostream& out, const char* kernel, const Variant<Fn> (&variants)[N],
+                   const CpuFeatures& features, Check check) {
+    bool all_ok = true;
+    const Fn reference = variants[N - 1].fn;
+    for (const auto& variant : variants) {
+        out << "  " << kernel << " [" << variant.name << "]: ";
+        if (!variant.supported(features)) {
+            out << "not supported\n";
+            continue;
+        }
+        bool ok = check(variant.fn, reference);
+        out << (ok ? "ok" : "MISMATCH") << "\n";
+        all_ok = all_ok && ok;
+    }
+    return all_ok;
+}
+
+} // namespace
+
+const ImageKernels& ImageKernels::get() {
+    static const ImageKernels kernels = make_kernels(CpuFeatures::get());
+    return kernels;
+}
+
+bool ImageKernels::verify(std::ostream& out) {
+    const CpuFeatures& features = CpuFeatures::get();
+    const ImageKernels& selected = get();
+
+    out << "CPU features: " << features.to_string() << "\n";
+    out << "Selected kernels:\n";
+    out << "  argb32_to_rgba: " << selected.argb32_to_rgba_variant << "\n";
+    out << "  argb32_to_rgb: " << selected.argb32_to_rgb_variant << "\n";
+    out << "  argb32_to_luma: " << selected.argb32_to_luma_variant << "\n";
+    out << "  all_opaque: " << selected.all_opaque_variant << "\n";
+    out << "  crc32c: " << selected.crc32c_variant << "\n";
+    out << "  downsample_2x: " << selected.downsample_2x_variant << "\n";
+    out << "  histogram_keys: " << selected.histogram_keys_variant << "\n";
+    out << "Cross-checking variants against scalar:\n";
+
+    bool ok = true;
+
+    // Row converters from ARGB32 to dst_channels bytes per pixel
+    auto check_rows = [](int dst_channels) {
+        return [dst_channels](SwizzleFn fn, SwizzleFn reference) {
+            for (int width : kTestWidths) {
+                for (size_t shift : kTestShifts) {
+                    auto src = make_test_bytes(shift + static_cast<size_t>(width) * 4, 0x9e3779b9u + width);
+                    std::vector<uint8_t> expected(shift + static_cast<size_t>(width) * dst_channels + kGuardBytes,
+                                                  0xa5);
+                    std::vector<uint8_t> actual(expected);
+                    reference(src.data() + shift, expected.data() + shift, width);
+                    fn(src.data() + shift, actual.data() + shift, width);
+                    if (expected != actual) return false;
+                }
+            }
+            return true;
+        };
+    };
+    ok &= verify_kernel(out, "argb32_to_rgba", kSwizzleVariants, features, check_rows(4));
+    ok &= verify_kernel(out, "argb32_to_rgb", kRgbVariants, features, check_rows(3));
+    ok &= verify_kernel(out, "argb32_to_luma", kLumaVariants, features, check_rows(1));
+
+    ok &= verify_kernel(out, "all_opaque", kOpaqueVariants, features,
+                        [](OpaqueFn fn, OpaqueFn reference) {
+        for (int width : kTestWidths) {
+            for (size_t shift : kTestShifts) {
+                // Translucent guard pixels around the row must not be read
+                std::vector<uint8_t> buffer(shift + static_cast<size_t>(width) * 4 + kGuardBytes, 0);
+                uint8_t* rgba = buffer.data() + shift;
+                std::memset(rgba, 255, static_cast<size_t>(width) * 4);
+                if (fn(rgba, width) != reference(rgba, width)) return false;
+                // A single translucent pixel in every position, including the tails
+                for (int hole = 0; hole < width; ++hole) {
+                    rgba[static_cast<size_t>(hole) * 4 + 3] = 254;
+                    bool same = fn(rgba, width) == reference(rgba, width);
+                    rgba[static_cast<size_t>(hole) * 4 + 3] = 255;
+                    if (!same) return false;
+                }
+            }
+        }
+        return true;
+    });
+
+    ok &= verify_kernel(out, "crc32c", kCrc32cVariants, features,
+                        [](Crc32cFn fn, Crc32cFn reference) {
+        // Known answer for "123456789"
+        const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+        if (fn(0, check, sizeof(check)) != 0xE3069283u) return false;
+        for (int width : kTestWidths) {
+            for (size_t shift : kTestShifts) {
+                auto buffer = make_test_bytes(shift + static_cast<size_t>(width) * 3, 0x85ebca6bu + width);
+                const uint8_t* data = buffer.data() + shift;
+                size_t size = buffer.size() - shift;
+                uint32_t expected = reference(0, data, size);
+                if (fn(0, data, size) != expected) return false;
+                // Incremental updates must equal one pass, whatever the split
+                for (size_t split : {size / 2, size / 3, size > 0 ? size - 1 : 0}) {
+                    if (fn(fn(0, data, split), data + split, size - split) != expected) return false;
+                }
+            }
+        }
+        return true;
+    });
+
+    ok &= verify_kernel(out, "downsample_2x", kDownsampleVariants, features,
+                        [](Downsample2xFn fn, Downsample2xFn reference) {
+        for (int width : kTestWidths) {
+            for (size_t shift : kTestShifts) {
+                size_t row_size = static_cast<size_t>(width) * 8;
+                auto row0 = make_test_bytes(shift + row_size, 0xc2b2ae35u + width);
+                auto row1 = make_test_bytes(shift + row_size, 0x27d4eb2fu + width);
+                std::vector<uint8_t> expected(shift + static_cast<size_t>(width) * 4 + kGuardBytes, 0xa5);
+                std::vector<uint8_t> actual(expected);
+                reference(row0.data() + shift, row1.data() + shift, expected.data() + shift, width);
+                fn(row0.data() + shift, row1.data() + shift, actual.data() + shift, width);
+                if (expected != actual) return false;
+            }
+        }
+        return true;
+    });
+
+    ok &= verify_kernel(out, "histogram_keys", kHistogramKeyVariants, features,
+                        [](HistogramKeysFn fn, HistogramKeysFn reference) {
+        for (int width : kTestWidths) {
+            for (size_t shift : kTestShifts) {
+                auto rgba = make_test_bytes(shift + static_cast<size_t>(width) * 4, 0x165667b1u + width);
+                std::vector<uint32_t> expected(static_cast<size_t>(width) + kGuardBytes, 0xa5a5a5a5u);
+                std::vector<uint32_t> actual(expected);
+                reference(rgba.data() + shift, expected.data(), width);
+                fn(rgba.data() + shift, actual.data(), width);
+                if (expected != actual) return false;
+            }
+        }
+        return true;
+    });
+
+    return ok;
+}
+
+} // namespace popplershot
@@ -0,0 +1,112 @@
+#include "image_resampler.h"
+#include "image_kernels.h"
+#include <algorithm>
+#include <cstring>
+
+namespace popplershot {
+
+namespace {
+
+Raster halve_rgba(const Raster& source, std::vector<uint8_t>& storage) {
+    int width = source.width / 2;
+    int height = source.height / 2;
+    size_t stride = static_cast<size_t>(width) * 4;
+    storage.resize(stride * height);
+    const auto downsample = ImageKernels::get().downsample_2x;
+    for (int y = 0; y < height; ++y) {
+        downsample(source.row(y * 2), source.row(y * 2 + 1), storage.data() + y * stride, width);
+    }
+    return {storage.data(), width, height, stride, 4};
+}
+
+// Source span [begin, end) covered by each destination column or row
+std::vector<int> box_bounds(int source_size, int target_size) {
+    std::vector<int> bounds(target_size + 1);
+    for (int i = 0; i <= target_size; ++i) {
+        bounds[i] = static_cast<int>(static_cast<int64_t>(i) * source_size / target_size);
+    }
+    return bounds;
+}
+
+Raster box_downscale(const Raster& source, int width, int height, std::vector<uint8_t>& storage) {
+    const int channels = source.channels;
+    const size_t stride = static_cast<size_t>(width) * channels;
+    storage.resize(stride * height);
+
+    auto columns = box_bounds(source.width, width);
+    auto rows = box_bounds(source.height, height);
+    std::vector<uint32_t> sums(static_cast<size_t>(source.width) * channels);
+
+    for (int y = 0; y < height; ++y) {
+        // Sum the source rows of this band, then reduce each column span
+        std::fill(sums.begin(), sums.end(), 0);
+        int row_begin = rows[y];
+        int row_end = std::max(rows[y + 1], row_begin + 1);
+        for (int sy = row_begin; sy < row_end; ++sy) {
+            const uint8_t* src = source.row(sy);
+            for (size_t i = 0; i < sums.size(); ++i) {
+                sums[i] += src[i];
+            }
+        }
+
+        uint8_t* dst = storage.data() + y * stride;
+        for (int x = 0; x < width; ++x) {
+            int col_begin = columns[x];
+            int col_end = std::max(columns[x + 1], col_begin + 1);
+            uint32_t count = static_cast<uint32_t>((col_end - col_begin) * (row_end - row_begin));
+            for (int c = 0; c < channels; ++c) {
+                uint32_t total = 0;
+                for (int sx = col_begin; sx < col_end; ++sx) {
+                    total += sums[static_cast<size_t>(sx) * channels + c];
+                }
+                dst[static_cast<size_t>(x) * channels + c] = static_cast<uint8_t>((total + count / 2) / count);
+            }
+        }
+    }
+    return {storage.data(), width, height, stride, channels};
+}
+
+} // namespace
+
+Raster ImageResampler::downscale(const Raster& source, int width, int height,
+                                 std::vector<uint8_t>& storage) {
+    width = std::clamp(width, 1, source.width);
+    height = std::clamp(height, 1, source.height);
+
+    Raster current = source;
+    std::vector<uint8_t> halved;
+    while (current.channels == 4 && width * 2 <= current.width && height * 2 <= current.height) {
+        std::vector<uint8_t> next;
+        current = halve_rgba(current, next);
+        halved.swap(next);
+    }
+
+    if (!halved.empty() && current.width == width && current.height == height) {
+        storage.swap(halved);
+        return {storage.data(), width, height, current.stride, current.channels};
+    }
+    return box_downscale(current, width, height, storage);
+}
+
+Raster ImageResampler::to_rgba(const Raster& source, std::vector<uint8_t>& storage) {
+    const size_t stride = static_cast<size_t>(source.width) * 4;
+    storage.resize(stride * source.height);
+    for (int y = 0; y < source.height; ++y) {
+        const uint8_t* src = source.row(y);
+        uint8_t* dst = storage.data() + y * stride;
+        switch (source.channels) {
+        case 1:
+            pixel::convert_row<pixel::Gray8, pixel::Rgba8>(src, dst, source.width);
+            break;
+        case 3:
+            pixel::convert_row<pixel::Rgb24, pixel::Rgba8>(src, dst, source.width);
+            break;
+        default:
+            std::memcpy(dst, src, stride);
+            break;
+        }
+    }
+    return {storage.data(), source.width, source.height, stride, 4};
+}
+
+} // namespace popplershot
@@ -0,0 +1,84 @@
+#include "input_list.h"
+#include "pdf_converter.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+bool InputList::read(const std::string& source, bool nul_separated, const std::string& input_root,
+                     PathQueue& queue) {
+    std::ifstream file;
+    if (source != "-") {
+        file.open(source, std::ios::binary);
+        if (!file) {
+            spdlog::error("Failed to open input list: {}", source);
+            return false;
+        }
+    }
+    std::istream& in = source == "-" ? std::cin : file;
+
+    char separator = nul_separated ? '\0' : '\n';
+    std::string record;
+    size_t number = 0;
+    while (std::getline(in, record, separator)) {
+        number++;
+        if (!nul_separated && !record.empty() && record.back() == '\r') {
+            record.pop_back();
+        }
+        if (record.empty()) {
+            continue;
+        }
+        InputFile input;
+        if (!parse_record(record, input_root, input)) {
+            spdlog::warn("Skipping malformed input list record {}: {}", number, record);
+            continue;
+        }
+        if (!queue.push(std::move(input))) {
+            break; // Cancelled
+        }
+    }
+    if (in.bad()) {
+        spdlog::error("Failed to read input list: {}", source);
+        return false;
+    }
+    return true;
+}
+
+bool InputList::parse_record(const std::string& record, const std::string& input_root, InputFile& file) {
+    size_t tab = record.find('\t');
+    file.path = record.substr(0, tab);
+    file.output_dir.clear();
+    file.pages.clear();
+    if (tab != std::string::npos) {
+        size_t second = record.find('\t', tab + 1);
+        file.output_dir = record.substr(tab + 1, second == std::string::npos ? std::string::npos : second - tab - 1);
+        if (second != std::string::npos) {
+            file.pages = record.substr(second + 1);
+        }
+    }
+    if (file.path.empty()) {
+        return false;
+    }
+
+    std::filesystem::path path(file.path);
+    if (path.is_relative() && !input_root.empty()) {
+        file.path = (std::filesystem::path(input_root) / path).string();
+    }
+
+    // Pages must stay below the output root
+    if (!file.output_dir.empty()) {
+        std::filesystem::path output_dir = std::filesystem::path(file.output_dir).lexically_normal();
+        if (output_dir.is_absolute() || output_dir.has_root_name() ||
+            (!output_dir.empty() && *output_dir.begin() == "..")) {
+            return false;
+        }
+        file.output_dir = output_dir.string();
+    }
+
+    std::vector<int> pages;
+    return PDFConverter::select_pages(file.pages, 0, pages);
+}
+
+} // namespace popplershot
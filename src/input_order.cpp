@@ -0,0 +1,229 @@
+#include "input_order.h"
+#include "file_utils.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <fmt/format.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace popplershot {
+
+namespace {
+
+// Read ahead of a document at most; enough for all but the largest scans
+constexpr uint64_t kReadaheadLimit = 64ull << 20;
+
+// Keys of files the filesystem could not place sort after the placed ones
+constexpr uint64_t kUnplaced = 1ull << 63;
+
+#ifdef __linux__
+// Physical byte offset of path's first extent, or false if the filesystem
+// does not report extents (tmpfs, most network filesystems) or has none yet
+bool first_extent(int fd, uint64_t& physical) {
+    // The header followed by room for the one extent asked for
+    alignas(struct fiemap) unsigned char request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+    auto* map = reinterpret_cast<struct fiemap*>(request);
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    if (::ioctl(fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0 ||
+        (map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE))) {
+        return false;
+    }
+    physical = map->fm_extents[0].fe_physical;
+    return true;
+}
+
+// Whether the block device holding dir reports itself as rotational
+std::string device_kind(const std::string& dir) {
+    struct stat st;
+    if (::stat(dir.c_str(), &st) != 0) {
+        return "unknown device";
+    }
+    // A partition has no queue of its own; its disk's is one level up
+    std::string base = fmt::format("/sys/dev/block/{}:{}/", major(st.st_dev), minor(st.st_dev));
+    for (const char* queue : {"queue/rotational", "../queue/rotational"}) {
+        std::ifstream file(base + queue);
+        int rotational = 0;
+        if (file >> rotational) {
+            return rotational ? "rotational device" : "non-rotational device";
+        }
+    }
+    return "device of unknown type";
+}
+#endif
+
+} // namespace
+
+bool InputOrder::parse_mode(const std::string& name, Mode& mode) {
+    if (name == "scan") mode = Mode::Scan;
+    else if (name == "inode") mode = Mode::Inode;
+    else if (name == "extent") mode = Mode::Extent;
+    else return false;
+    return true;
+}
+
+uint64_t InputOrder::physical_key(const std::string& path, Mode mode) {
+#ifdef _WIN32
+    (void)path;
+    (void)mode;
+    return 0;
+#else
+    if (mode == Mode::Scan) {
+        return 0;
+    }
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    uint64_t key = 0;
+#ifdef __linux__
+    uint64_t physical = 0;
+    if (mode == Mode::Extent && first_extent(fd, physical)) {
+        key = physical & ~kUnplaced;
+    }
+#endif
+    struct stat st;
+    if (key == 0 && ::fstat(fd, &st) == 0) {
+        key = static_cast<uint64_t>(st.st_ino) | (mode == Mode::Extent ? kUnplaced : 0);
+    }
+    ::close(fd);
+    return key;
+#endif
+}
+
+void InputOrder::sort(std::vector<std::string>& files, Mode mode, int threads) {
+    if (mode == Mode::Scan || files.size() < 2) {
+        return;
+    }
+    // Each key costs an open and a stat or ioctl, so read them in parallel
+    std::vector<uint64_t> keys(files.size());
+    size_t count = std::clamp<size_t>(static_cast<size_t>(std::max(threads, 1)), 1, files.size());
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < count; ++t) {
+        readers.emplace_back([&, t] {
+            for (size_t i = t; i < files.size(); i += count) {
+                keys[i] = physical_key(files[i], mode);
+            }
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    std::vector<std::string> sorted;
+    sorted.reserve(files.size());
+    for (size_t i : order) {
+        sorted.push_back(std::move(files[i]));
+    }
+    files = std::move(sorted);
+}
+
+void InputOrder::readahead(const std::string& path, uint64_t offset, uint64_t length) {
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // The pages are queued for reading now and survive the close
+    ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(std::min(length, kReadaheadLimit)),
+                    POSIX_FADV_WILLNEED);
+    ::close(fd);
+#else
+    (void)path;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+void InputOrder::benchmark(const std::string& dir, std::ostream& out) {
+#ifndef __linux__
+    out << "The ordering benchmark needs Linux page cache control\n";
+    (void)dir;
+#else
+    std::vector<std::string> files = FileUtils::find_pdf_files(dir, 8);
+    if (files.empty()) {
+        out << fmt::format("No PDFs below {}\n", dir);
+        return;
+    }
+    out << fmt::format("Reading {} PDFs below {} ({})\n", files.size(), dir, device_kind(dir));
+
+    // Drops each file's cached pages, so every run reads from the device;
+    // only clean pages go, which is all a read-only benchmark leaves
+    auto evict = [&files] {
+        for (const auto& file : files) {
+            int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                ::fdatasync(fd);
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                ::close(fd);
+            }
+        }
+    };
+
+    // Reads every file whole, one at a time, as a single worker would
+    std::vector<char> buffer(1 << 20);
+    auto read_all = [&buffer](const std::vector<std::string>& order, bool ahead) {
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (ahead && i + 1 < order.size()) {
+                readahead(order[i + 1]);
+            }
+            int fd = ::open(order[i].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            ssize_t n;
+            while ((n = ::read(fd, buffer.data(), buffer.size())) > 0) {
+                bytes += static_cast<uint64_t>(n);
+            }
+            ::close(fd);
+        }
+        return bytes;
+    };
+
+    // Directory order on many filesystems is effectively a hash; a fixed
+    // shuffle stands in for it
+    std::vector<std::string> shuffled = files;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+    std::vector<std::string> by_inode = files;
+    sort(by_inode, Mode::Inode, 8);
+    std::vector<std::string> by_extent = files;
+    sort(by_extent, Mode::Extent, 8);
+
+    struct Run {
+        const char* name;
+        const std::vector<std::string>* order;
+        bool ahead;
+    };
+    for (const Run& run : {Run{"shuffled", &shuffled, false}, Run{"path", &files, false},
+                           Run{"inode", &by_inode, false}, Run{"extent", &by_extent, false},
+                           Run{"extent+readahead", &by_extent, true}}) {
+        evict();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t bytes = read_all(*run.order, run.ahead);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        out << fmt::format("  {:<18} {:>9.3f} s {:>9.1f} MiB/s {:>9.0f} PDFs/s\n", run.name, seconds,
+                           bytes / seconds / (1 << 20), files.size() / seconds);
+    }
+#endif
+}
+
+} // namespace popplershot
@@ -0,0 +1,190 @@
+#include "lmdb_sink.h"
+
+#ifdef POPPLERSHOT_HAVE_LMDB
+
+#include <filesystem>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+LmdbSink::LmdbSink(const Options& options)
+    : options_(options), env_(nullptr), pages_(0), meta_(0), map_size_(options.map_size),
+      queued_bytes_(0), finishing_(false), failed_(false) {
+    path_ = (std::filesystem::path(options_.root) / (options_.shard_prefix + ".mdb")).string();
+    if (!open()) {
+        failed_ = true;
+        close();
+        return;
+    }
+    writer_ = std::thread([this] { run(); });
+}
+
+LmdbSink::~LmdbSink() {
+    if (writer_.joinable()) {
+        spdlog::warn("LMDB output {} was not finished", path_);
+        finish();
+    }
+}
+
+bool LmdbSink::open() {
+    int rc = mdb_env_create(&env_);
+    if (rc != MDB_SUCCESS) {
+        spdlog::error("Failed to create LMDB environment: {}", mdb_strerror(rc));
+        env_ = nullptr;
+        return false;
+    }
+    mdb_env_set_maxdbs(env_, 2);
+    mdb_env_set_mapsize(env_, map_size_);
+
+    // Durability comes from the single sync in finish(), not every commit
+    rc = mdb_env_open(env_, path_.c_str(), MDB_NOSUBDIR | MDB_NOSYNC | MDB_NOMETASYNC, 0644);
+    if (rc != MDB_SUCCESS) {
+        spdlog::error("Failed to open LMDB output {}: {}", path_, mdb_strerror(rc));
+        return false;
+    }
+
+    MDB_txn* txn = nullptr;
+    rc = mdb_txn_begin(env_, nullptr, 0, &txn);
+    if (rc == MDB_SUCCESS) rc = mdb_dbi_open(txn, "pages", MDB_CREATE, &pages_);
+    if (rc == MDB_SUCCESS) rc = mdb_dbi_open(txn, "meta", MDB_CREATE, &meta_);
+    if (rc == MDB_SUCCESS) {
+        rc = mdb_txn_commit(txn);
+    } else if (txn) {
+        mdb_txn_abort(txn);
+    }
+    if (rc != MDB_SUCCESS) {
+        spdlog::error("Failed to create LMDB databases in {}: {}", path_, mdb_strerror(rc));
+        return false;
+    }
+    spdlog::debug("Writing pages to LMDB {}", path_);
+    return true;
+}
+
+void LmdbSink::close() {
+    if (env_) {
+        mdb_env_close(env_);
+        env_ = nullptr;
+    }
+}
+
+bool LmdbSink::write(const std::string& name, EncodedPage page) {
+    std::string dir = std::filesystem::path(name).parent_path().generic_string();
+    Record record;
+    record.key = fmt::format("{}{}{}/{}", dir, dir.empty() ? "" : "/", page.source, page.page_number);
+    record.meta = fmt::format("name={}\tencoder={}\twidth={}\theight={}\tbytes={}",
+                              name, page.encoder, page.width, page.height, page.data.size());
+    record.data = std::move(page.data);
+    size_t bytes = record.data.size();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Keep at most about two transactions' worth queued
+    space_.wait(lock, [&] {
+        return failed_ || queue_.empty() || queued_bytes_ + bytes <= 2 * options_.batch_bytes;
+    });
+    if (failed_ || finishing_) {
+        return false;
+    }
+    queued_bytes_ += bytes;
+    queue_.push_back(std::move(record));
+    ready_.notify_one();
+    return true;
+}
+
+void LmdbSink::run() {
+    std::vector<Record> batch;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [&] { return finishing_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            size_t bytes = 0;
+            while (!queue_.empty() && batch.size() < options_.batch_pages &&
+                   (batch.empty() || bytes + queue_.front().data.size() <= options_.batch_bytes)) {
+                bytes += queue_.front().data.size();
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+            queued_bytes_ -= bytes;
+            space_.notify_all();
+        }
+
+        bool ok = commit(batch);
+        batch.clear();
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed_ = true;
+            queue_.clear();
+            queued_bytes_ = 0;
+            space_.notify_all();
+            return;
+        }
+    }
+}
+
+bool LmdbSink::commit(const std::vector<Record>& batch) {
+    for (;;) {
+        MDB_txn* txn = nullptr;
+        int rc = mdb_txn_begin(env_, nullptr, 0, &txn);
+        for (size_t i = 0; rc == MDB_SUCCESS && i < batch.size(); ++i) {
+            const Record& record = batch[i];
+            MDB_val key{record.key.size(), const_cast<char*>(record.key.data())};
+            MDB_val data{record.data.size(), const_cast<unsigned char*>(record.data.data())};
+            MDB_val meta{record.meta.size(), const_cast<char*>(record.meta.data())};
+            rc = mdb_put(txn, pages_, &key, &data, 0);
+            if (rc == MDB_SUCCESS) {
+                rc = mdb_put(txn, meta_, &key, &meta, 0);
+            }
+        }
+        if (rc == MDB_SUCCESS) {
+            rc = mdb_txn_commit(txn);
+        } else if (txn) {
+            mdb_txn_abort(txn);
+        }
+
+        if (rc == MDB_SUCCESS) {
+            return true;
+        }
+        if (rc != MDB_MAP_FULL) {
+            spdlog::error("Failed to write {} pages to {}: {}", batch.size(), path_, mdb_strerror(rc));
+            return false;
+        }
+        // No transaction is open here, so the map may grow; retry the batch
+        map_size_ *= 2;
+        rc = mdb_env_set_mapsize(env_, map_size_);
+        if (rc != MDB_SUCCESS) {
+            spdlog::error("Failed to grow LMDB map of {} to {} bytes: {}", path_, map_size_,
+                          mdb_strerror(rc));
+            return false;
+        }
+        spdlog::debug("Grew LMDB map of {} to {} bytes", path_, map_size_);
+    }
+}
+
+bool LmdbSink::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finishing_ = true;
+        ready_.notify_one();
+    }
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (!env_) {
+        return false;
+    }
+
+    int rc = mdb_env_sync(env_, 1);
+    if (rc != MDB_SUCCESS) {
+        spdlog::error("Failed to sync LMDB output {}: {}", path_, mdb_strerror(rc));
+        failed_ = true;
+    }
+    close();
+    return !failed_;
+}
+
+} // namespace popplershot
+
+#endif // POPPLERSHOT_HAVE_LMDB
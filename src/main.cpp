@@ -1,19 +1,29 @@
 #include <iostream>
 #include <string>
 #include <chrono>
+#include <csignal>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <fmt/format.h>
 
 #include "batch_processor.h"
+#include "conversion_index.h"
 #include "pdf_converter.h"
 #include "file_utils.h"
+#include "image_kernels.h"
+#include "pixel_pipeline.h"
+#include "directory_walker.h"
+#include "input_order.h"
+#include "output_sink.h"
+#include "write_queue.h"
 
 void print_usage(const char* program_name) {
     std::cout << "PopplerShot - Efficient batch PDF to PNG converter\n\n";
-    std::cout << "Usage: " << program_name << " [OPTIONS] INPUT_DIR OUTPUT_DIR\n\n";
+    std::cout << "Usage: " << program_name << " [OPTIONS] INPUT_DIR OUTPUT_DIR\n";
+    std::cout << "       " << program_name << " [OPTIONS] --files-from LIST [INPUT_DIR] OUTPUT_DIR\n\n";
     std::cout << "Arguments:\n";
-    std::cout << "  INPUT_DIR    Directory containing PDF files to convert\n";
+    std::cout << "  INPUT_DIR    Directory containing PDF files to convert; with --files-from,\n";
+    std::cout << "               the base for relative listed paths (default: .)\n";
     std::cout << "  OUTPUT_DIR   Directory where PNG files will be saved\n\n";
     std::cout << "Options:\n";
     std::cout << "  -h, --help           Show this help message\n";
@@ -21,10 +31,83 @@ void print_usage(const char* program_name) {
     std::cout << "  -q, --quiet          Suppress progress output\n";
     std::cout << "  -j, --jobs N         Number of parallel threads (default: auto)\n";
     std::cout << "  -d, --dpi N          Output DPI resolution (default: 150)\n";
-    std::cout << "  -f, --format FORMAT  Output format: png, jpg (default: png)\n";
+    std::cout << "  -f, --format FORMAT  Output format: png, jpg, auto, raw (default: png); raw\n";
+    std::cout << "                       publishes unencoded pixels and needs --sink shm\n";
+    std::cout << "  --quality N          JPEG quality 1-100 (default: 85)\n";
     std::cout << "  --max-width N        Maximum output width in pixels\n";
     std::cout << "  --max-height N       Maximum output height in pixels\n";
-    std::cout << "  --no-aspect-ratio    Don't preserve aspect ratio when scaling\n\n";
+    std::cout << "  --no-aspect-ratio    Don't preserve aspect ratio when scaling\n";
+    std::cout << "  --palette            Write PNGs as 8-bit indexed images (256 colors max)\n";
+    std::cout << "  --dither             Dither pages that need more than 256 colors\n";
+    std::cout << "  --gray               Render and encode grayscale images\n";
+    std::cout << "  --compression N      PNG deflate level / JPEG effort 0-9 (default: 6)\n";
+    std::cout << "  --adaptive-compression MIN:MAX\n";
+    std::cout << "                       Tune compression within MIN:MAX from render vs encode load\n";
+    std::cout << "  --size-ceiling N     Average page size in bytes adaptive mode must stay under\n";
+    std::cout << "  --max-file-size N    Per-page byte budget (K/M suffixes allowed); lowers JPEG\n";
+    std::cout << "                       quality, palettizes PNGs, then downscales to fit\n";
+    std::cout << "  --digest ALG         Checksum each page while writing: xxh3, crc32c, sha256\n";
+    std::cout << "  --hash-levels N      Spread documents over N levels of hex bucket directories\n";
+    std::cout << "                       instead of mirroring the input tree, and write\n";
+    std::cout << "                       OUTPUT_DIR/layout.tsv mapping pages to paths (0-4, default: 0)\n";
+    std::cout << "  --manifest FILE      Write \"<digest>  <path>\" lines for every page (default digest: sha256)\n";
+    std::cout << "  --io-backend NAME    Page writes: auto, io_uring, threads, sync (default: auto)\n";
+    std::cout << "  --io-threads N       Writer threads for the thread-pool backend (default: 4)\n";
+    std::cout << "  --fsync              Flush every page to stable storage before closing it\n";
+    std::cout << "  --durability MODE    none, file (same as --fsync), batch (syncfs every\n";
+    std::cout << "                       --sync-every pages) or document (default: none)\n";
+    std::cout << "  --sync-every N       Pages per filesystem sync in batch mode (default: 1000)\n";
+    std::cout << "  --no-atomic-writes   Write pages in place instead of via a renamed temp file\n";
+    std::cout << "  --sink KIND          Page output: dir, tar, zip, lmdb, objects, shm, s3\n";
+    std::cout << "                       (default: dir)\n";
+    std::cout << "                       archives get a .idx sidecar of member offsets and sizes,\n";
+    std::cout << "                       objects stores each distinct image once by its hash\n";
+    std::cout << "  --shard-size N       Start a new archive shard beyond N bytes (default: 1G)\n";
+    std::cout << "  --lmdb-batch N       Pages per LMDB write transaction (default: 1024)\n";
+    std::cout << "  --shm-name NAME      Shared-memory object for --sink shm (default: /popplershot)\n";
+    std::cout << "  --shm-size N         Shared-memory ring size, a power of two (default: 256M)\n";
+    std::cout << "  --s3-url URL         Bucket and key prefix for --sink s3, e.g.\n";
+    std::cout << "                       http://localhost:9000/bucket/prefix; credentials come\n";
+    std::cout << "                       from AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY\n";
+    std::cout << "  --s3-region R        Signing region for --sink s3 (default: us-east-1)\n";
+    std::cout << "  --upload-threads N   Concurrent S3 connections (default: 16)\n";
+    std::cout << "  --s3-part-size N     Upload larger pages in parts of N bytes, 5M to 5G\n";
+    std::cout << "                       (default: 8M)\n";
+    std::cout << "  --files-from LIST    Convert the PDFs listed in LIST (- for stdin) instead of\n";
+    std::cout << "                       scanning INPUT_DIR; one \"path[TAB outdir[TAB pages]]\"\n";
+    std::cout << "                       record per line, outdir below OUTPUT_DIR, pages like 1-3,7\n";
+    std::cout << "  --null               LIST records end with NUL instead of newline\n";
+    std::cout << "  --watch              Keep running and convert PDFs as they arrive in INPUT_DIR\n";
+    std::cout << "                       (after the ones already there) until Ctrl-C\n";
+    std::cout << "  --watch-backend B    inotify, or fanotify for very large trees (needs\n";
+    std::cout << "                       CAP_SYS_ADMIN) (default: inotify)\n";
+    std::cout << "  --settle-ms N        Quiet time after a file is written before converting it\n";
+    std::cout << "                       (default: 250)\n";
+    std::cout << "  --incremental        Skip PDFs unchanged since an earlier run with the same\n";
+    std::cout << "                       options (by mtime and size, then content hash)\n";
+    std::cout << "  --index FILE         Index used by --incremental\n";
+    std::cout << "                       (default: OUTPUT_DIR/.popplershot-index)\n";
+    std::cout << "  --resume             Continue an interrupted run from its journal, skipping\n";
+    std::cout << "                       finished PDFs and the finished pages of partial ones\n";
+    std::cout << "  --journal FILE       Journal of finished pages and PDFs\n";
+    std::cout << "                       (default: OUTPUT_DIR/.popplershot-journal)\n";
+    std::cout << "  --detect MODE        Find PDFs by extension (*.pdf) or by magic (a %PDF-\n";
+    std::cout << "                       header in the first 1 KiB of any file) (default: extension)\n";
+    std::cout << "  --archives           Also convert the PDFs inside .zip and .tar files, without\n";
+    std::cout << "                       extracting them; outputs go to <archive>/<member dir>\n";
+    std::cout << "  --order MODE         Dispatch a scan as found (scan), or once listed in inode\n";
+    std::cout << "                       or physical extent order with readahead, for rotational\n";
+    std::cout << "                       and cold storage (default: scan)\n";
+    std::cout << "  --discovery-threads N\n";
+    std::cout << "                       Threads listing the input tree, worth raising on network\n";
+    std::cout << "                       filesystems (default: 8)\n";
+    std::cout << "  --benchmark-pipeline Time pixel conversion and encoding, specialized vs generic\n";
+    std::cout << "  --benchmark-io DIR   Measure small-file write throughput per backend in DIR\n";
+    std::cout << "  --benchmark-discovery DIR\n";
+    std::cout << "                       Time PDF discovery below DIR, sequential vs parallel walker\n";
+    std::cout << "  --benchmark-order DIR\n";
+    std::cout << "                       Time cold reads of the PDFs below DIR in each input order\n";
+    std::cout << "  --print-cpu-features Show detected CPU features and self-check image kernels\n\n";
     std::cout << "Examples:\n";
     std::cout << "  " << program_name << " /data /output\n";
     std::cout << "  " << program_name << " -j 8 -d 200 /pdfs /images\n";
@@ -46,6 +129,15 @@ void setup_logging(bool verbose, bool quiet) {
     spdlog::set_pattern("[%H:%M:%S] [%^%l%$] %v");
 }
 
+popplershot::BatchProcessor* watched_processor = nullptr;
+
+void stop_watching(int signal) {
+    std::signal(signal, SIG_DFL);
+    if (watched_processor) {
+        watched_processor->stop_watching();
+    }
+}
+
 void show_progress(const popplershot::BatchProcessor::ProgressInfo& progress) {
     static auto start_time = std::chrono::steady_clock::now();
     auto current_time = std::chrono::steady_clock::now();
@@ -53,10 +145,12 @@ void show_progress(const popplershot::BatchProcessor::ProgressInfo& progress) {
     
     double progress_percent = (double)progress.current_file / progress.total_files * 100.0;
     
-    fmt::print("\r[{:3.0f}%] Processing file {}/{}: {} (Pages: {}) [{:02d}:{:02d}]",
-               progress_percent,
+    // While discovery runs the total is only a lower bound
+    fmt::print("\r[{}] Processing file {}/{}{}: {} (Pages: {}) [{:02d}:{:02d}]",
+               progress.scanning ? std::string("scan") : fmt::format("{:3.0f}%", progress_percent),
                progress.current_file,
                progress.total_files,
+               progress.scanning ? "+" : "",
                progress.current_filename,
                progress.pages_processed,
                elapsed.count() / 60,
@@ -64,15 +158,63 @@ void show_progress(const popplershot::BatchProcessor::ProgressInfo& progress) {
     std::cout.flush();
 }
 
+// Parses a byte count with an optional K, M or G suffix (powers of 1024); 0 on error
+size_t parse_byte_size(const std::string& text) {
+    size_t digits = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(text, &digits);
+    } catch (const std::exception&) {
+        return 0;
+    }
+    std::string suffix = text.substr(digits);
+    if (suffix.empty() || suffix == "B") return value;
+    if (suffix == "K" || suffix == "k") return value << 10;
+    if (suffix == "M" || suffix == "m") return value << 20;
+    if (suffix == "G" || suffix == "g") return value << 30;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     std::string input_dir, output_dir;
     int num_threads = 0;
     double dpi = 300.0;
     std::string format = "png";
+    int jpeg_quality = 85;
     int max_width = 0;
     int max_height = 0;
     bool preserve_aspect_ratio = true;
+    bool palette = false;
+    bool dither = false;
+    bool grayscale = false;
+    int compression_level = 6;
+    bool adaptive_compression = false;
+    int min_compression_level = 1;
+    int max_compression_level = 9;
+    size_t size_ceiling = 0;
+    size_t max_file_size = 0;
+    popplershot::Digest::Algorithm digest = popplershot::Digest::Algorithm::None;
+    std::string manifest_path;
+    int layout_levels = 0;
+    popplershot::WriteQueue::Options write_queue;
+    write_queue.backend = popplershot::WriteQueue::Backend::Auto;
+    popplershot::OutputSink::Options sink;
+    std::string benchmark_dir;
+    std::string benchmark_discovery_dir;
+    std::string benchmark_order_dir;
+    std::string files_from;
+    bool watch = false;
+    popplershot::HotFolder::Options watch_options;
+    bool nul_separated = false;
+    bool archives = false;
+    popplershot::InputOrder::Mode input_order = popplershot::InputOrder::Mode::Scan;
+    bool incremental = false;
+    std::string index_path;
+    bool resume = false;
+    std::string journal_path;
+    int discovery_threads = 8;
+    popplershot::FileUtils::PdfDetection pdf_detection = popplershot::FileUtils::PdfDetection::Extension;
     bool verbose = false;
     bool quiet = false;
     
@@ -82,6 +224,170 @@ int main(int argc, char* argv[]) {
         if (arg == "-h" || arg == "--help") {
             print_usage(argv[0]);
             return 0;
+        } else if (arg == "--print-cpu-features") {
+            return popplershot::ImageKernels::verify(std::cout) ? 0 : 1;
+        } else if (arg == "--benchmark-pipeline") {
+            setup_logging(false, true);
+            popplershot::PixelPipeline::benchmark(std::cout);
+            return 0;
+        } else if (arg == "--benchmark-io") {
+            if (i + 1 < argc) {
+                benchmark_dir = argv[++i];
+            }
+        } else if (arg == "--benchmark-discovery") {
+            if (i + 1 < argc) {
+                benchmark_discovery_dir = argv[++i];
+            }
+        } else if (arg == "--benchmark-order") {
+            if (i + 1 < argc) {
+                benchmark_order_dir = argv[++i];
+            }
+        } else if (arg == "--files-from") {
+            if (i + 1 < argc) {
+                files_from = argv[++i];
+            }
+        } else if (arg == "--null") {
+            nul_separated = true;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--watch-backend") {
+            if (i + 1 < argc && !popplershot::HotFolder::parse_backend(argv[++i], watch_options.backend)) {
+                std::cerr << "Unknown watch backend: " << argv[i] << " (expected inotify or fanotify)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--settle-ms") {
+            if (i + 1 < argc) {
+                watch_options.settle_ms = std::stoi(argv[++i]);
+                if (watch_options.settle_ms < 0) {
+                    std::cerr << "Invalid settle time: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--incremental") {
+            incremental = true;
+        } else if (arg == "--index") {
+            if (i + 1 < argc) {
+                index_path = argv[++i];
+            }
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--journal") {
+            if (i + 1 < argc) {
+                journal_path = argv[++i];
+            }
+        } else if (arg == "--detect") {
+            if (i + 1 < argc && !popplershot::FileUtils::parse_pdf_detection(argv[++i], pdf_detection)) {
+                std::cerr << "Unknown detection mode: " << argv[i] << " (expected extension or magic)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--archives") {
+            archives = true;
+        } else if (arg == "--order") {
+            if (i + 1 < argc && !popplershot::InputOrder::parse_mode(argv[++i], input_order)) {
+                std::cerr << "Unknown input order: " << argv[i] << " (expected scan, inode or extent)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--discovery-threads") {
+            if (i + 1 < argc) {
+                discovery_threads = std::stoi(argv[++i]);
+                if (discovery_threads < 1) {
+                    std::cerr << "Invalid discovery thread count: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--io-backend") {
+            if (i + 1 < argc && !popplershot::WriteQueue::parse_backend(argv[++i], write_queue.backend)) {
+                std::cerr << "Unknown I/O backend: " << argv[i] << " (expected auto, io_uring, threads or sync)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--io-threads") {
+            if (i + 1 < argc) {
+                write_queue.threads = std::stoi(argv[++i]);
+            }
+        } else if (arg == "--fsync") {
+            write_queue.durability = popplershot::WriteQueue::Durability::File;
+        } else if (arg == "--durability") {
+            if (i + 1 < argc && !popplershot::WriteQueue::parse_durability(argv[++i], write_queue.durability)) {
+                std::cerr << "Unknown durability mode: " << argv[i]
+                          << " (expected none, file, batch or document)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--sync-every") {
+            if (i + 1 < argc) {
+                int interval = std::stoi(argv[++i]);
+                if (interval < 1) {
+                    std::cerr << "Invalid sync interval: " << argv[i] << std::endl;
+                    return 1;
+                }
+                write_queue.sync_interval = static_cast<size_t>(interval);
+            }
+        } else if (arg == "--no-atomic-writes") {
+            write_queue.atomic = false;
+        } else if (arg == "--sink") {
+            if (i + 1 < argc && !popplershot::OutputSink::parse_kind(argv[++i], sink.kind)) {
+                std::cerr << "Unknown sink: " << argv[i] << " (expected dir, tar, zip, lmdb, objects, shm or s3)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--shard-size") {
+            if (i + 1 < argc) {
+                sink.shard_size = parse_byte_size(argv[++i]);
+                if (sink.shard_size == 0) {
+                    std::cerr << "Invalid shard size: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--lmdb-batch") {
+            if (i + 1 < argc) {
+                int batch = std::stoi(argv[++i]);
+                if (batch < 1) {
+                    std::cerr << "Invalid LMDB batch size: " << argv[i] << std::endl;
+                    return 1;
+                }
+                sink.batch_pages = static_cast<size_t>(batch);
+            }
+        } else if (arg == "--shm-name") {
+            if (i + 1 < argc) {
+                sink.shm_name = argv[++i];
+                if (sink.shm_name.empty() || sink.shm_name[0] != '/') {
+                    sink.shm_name = "/" + sink.shm_name;
+                }
+            }
+        } else if (arg == "--shm-size") {
+            if (i + 1 < argc) {
+                sink.shm_size = parse_byte_size(argv[++i]);
+                // Record sizes are 32-bit, and positions wrap with a mask
+                if (sink.shm_size < (1u << 16) || sink.shm_size > (size_t{1} << 31) ||
+                    (sink.shm_size & (sink.shm_size - 1)) != 0) {
+                    std::cerr << "Invalid shared-memory size: " << argv[i]
+                              << " (expected a power of two from 64K to 2G)" << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--s3-url") {
+            if (i + 1 < argc) {
+                sink.s3_url = argv[++i];
+            }
+        } else if (arg == "--s3-region") {
+            if (i + 1 < argc) {
+                sink.s3_region = argv[++i];
+            }
+        } else if (arg == "--upload-threads") {
+            if (i + 1 < argc) {
+                sink.upload_threads = std::stoi(argv[++i]);
+                if (sink.upload_threads < 1) {
+                    std::cerr << "Invalid upload thread count: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--s3-part-size") {
+            if (i + 1 < argc) {
+                sink.part_size = parse_byte_size(argv[++i]);
+                // S3 rejects parts other than the last under 5 MiB, and any over 5 GiB
+                if (sink.part_size < (size_t{5} << 20) || sink.part_size > (size_t{5} << 30)) {
+                    std::cerr << "Invalid S3 part size: " << argv[i] << " (expected 5M to 5G)" << std::endl;
+                    return 1;
+                }
+            }
         } else if (arg == "-v" || arg == "--verbose") {
             verbose = true;
         } else if (arg == "-q" || arg == "--quiet") {
@@ -98,6 +404,10 @@ int main(int argc, char* argv[]) {
             if (i + 1 < argc) {
                 format = argv[++i];
             }
+        } else if (arg == "--quality") {
+            if (i + 1 < argc) {
+                jpeg_quality = std::stoi(argv[++i]);
+            }
         } else if (arg == "--max-width") {
             if (i + 1 < argc) {
                 max_width = std::stoi(argv[++i]);
@@ -108,6 +418,57 @@ int main(int argc, char* argv[]) {
             }
         } else if (arg == "--no-aspect-ratio") {
             preserve_aspect_ratio = false;
+        } else if (arg == "--palette") {
+            palette = true;
+        } else if (arg == "--dither") {
+            dither = true;
+        } else if (arg == "--gray") {
+            grayscale = true;
+        } else if (arg == "--compression") {
+            if (i + 1 < argc) {
+                compression_level = std::stoi(argv[++i]);
+            }
+        } else if (arg == "--adaptive-compression") {
+            if (i + 1 < argc) {
+                std::string range = argv[++i];
+                size_t colon = range.find(':');
+                if (colon == std::string::npos) {
+                    std::cerr << "Invalid compression range: " << range << " (expected MIN:MAX)" << std::endl;
+                    return 1;
+                }
+                min_compression_level = std::stoi(range.substr(0, colon));
+                max_compression_level = std::stoi(range.substr(colon + 1));
+                adaptive_compression = true;
+            }
+        } else if (arg == "--size-ceiling") {
+            if (i + 1 < argc) {
+                size_ceiling = std::stoull(argv[++i]);
+            }
+        } else if (arg == "--digest") {
+            if (i + 1 < argc && !popplershot::Digest::parse_algorithm(argv[++i], digest)) {
+                std::cerr << "Unknown digest: " << argv[i] << " (expected xxh3, crc32c or sha256)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--hash-levels") {
+            if (i + 1 < argc) {
+                layout_levels = std::stoi(argv[++i]);
+                if (layout_levels < 0 || layout_levels > 4) {
+                    std::cerr << "Hash levels must be between 0 and 4" << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--manifest") {
+            if (i + 1 < argc) {
+                manifest_path = argv[++i];
+            }
+        } else if (arg == "--max-file-size") {
+            if (i + 1 < argc) {
+                max_file_size = parse_byte_size(argv[++i]);
+                if (max_file_size == 0) {
+                    std::cerr << "Invalid file size: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
         } else if (arg[0] == '-') {
             std::cerr << "Unknown option: " << arg << std::endl;
             print_usage(argv[0]);
@@ -122,6 +483,30 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (!benchmark_dir.empty()) {
+        setup_logging(verbose, quiet);
+        popplershot::WriteQueue::benchmark(
+            benchmark_dir, 2000, 64 * 1024,
+            write_queue.durability == popplershot::WriteQueue::Durability::File, std::cout);
+        return 0;
+    }
+    if (!benchmark_discovery_dir.empty()) {
+        setup_logging(verbose, true);
+        popplershot::DirectoryWalker::benchmark(benchmark_discovery_dir, std::cout);
+        return 0;
+    }
+    if (!benchmark_order_dir.empty()) {
+        setup_logging(verbose, true);
+        popplershot::InputOrder::benchmark(benchmark_order_dir, std::cout);
+        return 0;
+    }
+
+    // A list needs only OUTPUT_DIR; INPUT_DIR then just anchors relative paths
+    if (!files_from.empty() && output_dir.empty()) {
+        output_dir = input_dir;
+        input_dir = ".";
+    }
+
     // Validate arguments
     if (input_dir.empty() || output_dir.empty()) {
         std::cerr << "Error: Both input and output directories must be specified\n\n";
@@ -129,6 +514,55 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    if (watch && (!files_from.empty() || !popplershot::HotFolder::supported())) {
+        std::cerr << "Error: --watch needs Linux and cannot be combined with --files-from" << std::endl;
+        return 1;
+    }
+    // Lists keep the order they were given in, and a watch dispatches as files arrive
+    if (input_order != popplershot::InputOrder::Mode::Scan && (watch || !files_from.empty())) {
+        std::cerr << "Error: --order applies to directory scans, not --watch or --files-from" << std::endl;
+        return 1;
+    }
+
+    // Archive shards and the ring are rewritten from scratch on every run,
+    // so skipped documents would go missing from them; LMDB, object store
+    // and S3 sinks accept pages before storing them, so a killed run could
+    // record pages that never landed
+    if ((incremental || resume) && sink.kind != popplershot::OutputSink::Kind::Directory) {
+        std::cerr << "Error: --incremental and --resume need --sink dir" << std::endl;
+        return 1;
+    }
+    if (incremental && !popplershot::ConversionIndex::supported()) {
+        std::cerr << "Error: --incremental is not supported on this platform" << std::endl;
+        return 1;
+    }
+
+    // Poppler writes other formats to disk itself, bypassing the sink
+    if (sink.kind != popplershot::OutputSink::Kind::Directory && format != "raw" &&
+        format != "png" && format != "jpg" && format != "jpeg" && format != "auto") {
+        std::cerr << "Error: --sink other than dir supports png, jpg and auto formats only" << std::endl;
+        return 1;
+    }
+    // Raw pixels carry no dimensions of their own; only the ring records them
+    if (format == "raw" && (sink.kind != popplershot::OutputSink::Kind::Shm || max_file_size > 0)) {
+        std::cerr << "Error: --format raw needs --sink shm and no --max-file-size" << std::endl;
+        return 1;
+    }
+    if (sink.kind == popplershot::OutputSink::Kind::Lmdb && !popplershot::OutputSink::lmdb_supported()) {
+        std::cerr << "Error: this build has no LMDB support" << std::endl;
+        return 1;
+    }
+    if (sink.kind == popplershot::OutputSink::Kind::S3) {
+        if (!popplershot::OutputSink::s3_supported()) {
+            std::cerr << "Error: this build has no S3 support" << std::endl;
+            return 1;
+        }
+        if (sink.s3_url.empty()) {
+            std::cerr << "Error: --sink s3 needs --s3-url" << std::endl;
+            return 1;
+        }
+    }
+
     // Setup logging
     setup_logging(verbose, quiet);
     
@@ -142,27 +576,73 @@ int main(int argc, char* argv[]) {
     popplershot::PDFConverter::ConversionOptions options;
     options.dpi = dpi;
     options.output_format = format;
+    options.jpeg_quality = jpeg_quality;
     options.max_width = max_width;
     options.max_height = max_height;
     options.preserve_aspect_ratio = preserve_aspect_ratio;
+    options.palette = palette;
+    options.dither = dither;
+    options.grayscale = grayscale;
+    options.compression_level = compression_level;
+    options.adaptive_compression = adaptive_compression;
+    options.min_compression_level = min_compression_level;
+    options.max_compression_level = max_compression_level;
+    options.size_ceiling = size_ceiling;
+    options.max_file_size = max_file_size;
+    if (!manifest_path.empty() && digest == popplershot::Digest::Algorithm::None) {
+        digest = popplershot::Digest::Algorithm::Sha256;
+    }
+    options.digest = digest;
+    options.write_queue = write_queue;
+    options.sink = sink;
     
     // Initialize batch processor
     popplershot::BatchProcessor processor(num_threads);
+    processor.set_manifest_path(manifest_path);
+    processor.set_layout_levels(layout_levels);
+    processor.set_discovery_threads(discovery_threads);
+    processor.set_pdf_detection(pdf_detection);
+    processor.set_archives(archives);
+    processor.set_input_order(input_order);
+    processor.set_incremental(incremental, index_path);
+    processor.set_journal(journal_path, resume);
     
     spdlog::info("PopplerShot starting conversion");
+    if (!files_from.empty()) {
+        spdlog::info("Input list: {}", files_from == "-" ? "stdin" : files_from);
+    }
     spdlog::info("Input directory: {}", input_dir);
     spdlog::info("Output directory: {}", output_dir);
     spdlog::info("DPI: {}", dpi);
-    spdlog::info("Format: {}", format);
+    spdlog::info("Format: {}{}", format, palette ? " (indexed palette)" : "");
+    if (adaptive_compression) {
+        spdlog::info("Compression: adaptive {}-{}", min_compression_level, max_compression_level);
+    }
+    if (!manifest_path.empty()) {
+        spdlog::info("Manifest: {} ({})", manifest_path, popplershot::Digest::to_string(digest));
+    }
     if (num_threads > 0) {
         spdlog::info("Threads: {}", num_threads);
     }
     
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    // Process directory
+    // Process the listed files, the whole directory, or watch it
     auto progress_callback = quiet ? nullptr : show_progress;
-    auto result = processor.process_directory(input_dir, output_dir, options, progress_callback);
+    popplershot::BatchProcessor::BatchResult result;
+    if (watch) {
+        // The first Ctrl-C finishes queued files; a second one kills
+        watched_processor = &processor;
+        std::signal(SIGINT, stop_watching);
+        std::signal(SIGTERM, stop_watching);
+        spdlog::info("Watching {} for new PDFs; press Ctrl-C to stop", input_dir);
+        result = processor.process_watch(input_dir, output_dir, options, progress_callback, watch_options);
+    } else if (!files_from.empty()) {
+        result = processor.process_file_list(files_from, nul_separated, input_dir, output_dir,
+                                             options, progress_callback);
+    } else {
+        result = processor.process_directory(input_dir, output_dir, options, progress_callback);
+    }
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
@@ -174,7 +654,30 @@ int main(int argc, char* argv[]) {
     // Print results
     spdlog::info("Conversion completed in {:.2f} seconds", duration.count() / 1000.0);
     spdlog::info("PDFs processed: {}/{}", result.successful_conversions, result.total_pdfs);
+    if (incremental) {
+        spdlog::info("Skipped {} unchanged PDFs", result.skipped_unchanged);
+    }
+    if (resume) {
+        spdlog::info("Skipped {} PDFs finished before the interruption", result.skipped_completed);
+    }
     spdlog::info("Total pages converted: {}", result.total_pages_converted);
+    if (result.pages_by_encoder.size() > 1 || format == "auto") {
+        for (const auto& [encoder, pages] : result.pages_by_encoder) {
+            spdlog::info("  {}: {} pages", encoder, pages);
+        }
+    }
+    if (adaptive_compression) {
+        for (const auto& [level, pages] : result.pages_by_compression_level) {
+            spdlog::info("  compression level {}: {} pages", level, pages);
+        }
+    }
+    if (max_file_size > 0) {
+        spdlog::info("Size budget {} bytes: {} pages re-encoded, {} encode attempts total",
+                     max_file_size, result.pages_refit, result.total_encode_attempts);
+        if (result.pages_over_budget > 0) {
+            spdlog::warn("Pages still over budget: {}", result.pages_over_budget);
+        }
+    }
     
     if (result.failed_conversions > 0) {
         spdlog::warn("Failed conversions: {}", result.failed_conversions);
@@ -185,7 +688,16 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    if (result.successful_conversions == 0) {
+    // Pages the sink accepted but never stored make the run a failure
+    if (result.output_failed) {
+        spdlog::error("Some pages could not be stored; the output is incomplete");
+        return 1;
+    }
+
+    // A rerun with nothing new to do is a success
+    if (result.successful_conversions == 0 &&
+        (result.skipped_unchanged + result.skipped_completed == 0 || result.failed_conversions > 0 ||
+         !result.errors.empty())) {
         spdlog::error("No PDFs were successfully converted");
         return 1;
     }
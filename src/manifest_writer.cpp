@@ -0,0 +1,108 @@
+#include "manifest_writer.h"
+#include "file_utils.h"
+#include <filesystem>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+bool ManifestWriter::open(const std::string& manifest_path, const std::string& output_root,
+                          Format format, bool keep_existing) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A killed run may have left half a line at the end
+    if (keep_existing && !FileUtils::drop_torn_line(manifest_path)) {
+        spdlog::error("Failed to repair manifest: {}", manifest_path);
+        return false;
+    }
+    file_.open(manifest_path, keep_existing ? std::ios::app : std::ios::trunc);
+    if (!file_) {
+        spdlog::error("Failed to open manifest: {}", manifest_path);
+        return false;
+    }
+    path_ = manifest_path;
+    keep_existing_ = keep_existing;
+    output_root_ = output_root;
+    format_ = format;
+    return true;
+}
+
+void ManifestWriter::add(const std::vector<PDFConverter::PageResult>& pages,
+                         const std::string& document) {
+    std::string lines;
+    for (const auto& page : pages) {
+        if (!page.success || (format_ == Format::Digest && page.digest.empty())) {
+            continue;
+        }
+        std::string path = std::filesystem::path(page.output_path)
+                               .lexically_relative(output_root_).generic_string();
+        if (format_ == Format::Layout) {
+            lines += document + "\t" + std::to_string(page.page_number) + "\t" + path + "\n";
+        } else {
+            lines += page.digest + "  " + path + "\n";
+        }
+    }
+
+    // Handed to the kernel before the caller journals the pages
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_.is_open()) {
+        file_ << lines << std::flush;
+    }
+}
+
+bool ManifestWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open()) {
+        return true;
+    }
+    file_.close();
+    if (file_.fail()) {
+        return false;
+    }
+    return !keep_existing_ || compact();
+}
+
+bool ManifestWriter::compact() {
+    std::vector<std::string> lines;
+    std::vector<std::string> keys;
+    std::unordered_map<std::string, size_t> latest; // Output path -> index of its last line
+    {
+        std::ifstream in(path_, std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            // The path follows the digest's two spaces or the layout's second tab
+            size_t at = format_ == Format::Layout ? line.find('\t', line.find('\t') + 1) : line.find("  ");
+            if (at == std::string::npos) {
+                continue;
+            }
+            keys.push_back(line.substr(at + (format_ == Format::Layout ? 1 : 2)));
+            latest[keys.back()] = lines.size();
+            lines.push_back(std::move(line));
+        }
+        if (in.bad()) {
+            spdlog::error("Failed to read manifest: {}", path_);
+            return false;
+        }
+    }
+    if (latest.size() == lines.size()) {
+        return true;
+    }
+
+    // Replaced whole, so a crash leaves either the old manifest or the new one
+    std::string temp = path_ + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (latest[keys[i]] == i) {
+            out << lines[i] << '\n';
+        }
+    }
+    out.close();
+    std::error_code ec;
+    if (out.fail() || (std::filesystem::rename(temp, path_, ec), ec)) {
+        spdlog::error("Failed to rewrite manifest: {}", path_);
+        std::filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace popplershot
@@ -0,0 +1,139 @@
+#include "object_store_sink.h"
+#include "digest.h"
+#include "write_queue.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace popplershot {
+
+ObjectStoreSink::ObjectStoreSink(const Options& options)
+    : options_(options), temp_counter_(0), objects_written_(0), objects_reused_(0),
+      failed_(false) {}
+
+bool ObjectStoreSink::ensure_shard(const std::string& dir) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shards_.count(dir)) {
+            return true;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec && !std::filesystem::is_directory(dir)) {
+        spdlog::error("Failed to create object directory {}: {}", dir, ec.message());
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_.insert(dir);
+    return true;
+}
+
+bool ObjectStoreSink::publish(const std::string& temp, const std::string& path) {
+#ifdef _WIN32
+    // rename() never replaces an existing file here
+    if (std::rename(temp.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+    bool exists = std::filesystem::exists(path);
+    std::remove(temp.c_str());
+    return exists;
+#else
+    // link() fails with EEXIST instead of replacing, so racing writers of the
+    // same object both succeed and exactly one copy is published
+    int rc = ::link(temp.c_str(), path.c_str());
+    int error = errno;
+    ::unlink(temp.c_str());
+    if (rc != 0 && error != EEXIST) {
+        spdlog::error("Failed to publish object {}: {}", path, std::strerror(error));
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool ObjectStoreSink::write(const std::string& name, EncodedPage page) {
+    Digest digest(Digest::Algorithm::Sha256);
+    digest.update(page.data.data(), page.data.size());
+    std::string hash = digest.finish();
+
+    std::string object = fmt::format("objects/{}/{}{}", hash.substr(0, 2), hash.substr(2),
+                                     std::filesystem::path(name).extension().string());
+    std::filesystem::path shard = std::filesystem::path(options_.root) / "objects" / hash.substr(0, 2);
+    std::string path = (std::filesystem::path(options_.root) / object).string();
+
+    bool ok = true;
+    if (std::filesystem::exists(path)) {
+        objects_reused_++;
+    } else if (!ensure_shard(shard.string())) {
+        ok = false;
+    } else {
+        std::string temp = (shard / fmt::format(".tmp-{}-{}", hash.substr(0, 16), temp_counter_++)).string();
+        ok = WriteQueue::write_file(temp, page.data, false) && publish(temp, path);
+        if (ok) {
+            objects_written_++;
+        }
+    }
+
+    std::string dir = std::filesystem::path(name).parent_path().generic_string();
+    std::string manifest = (std::filesystem::path(options_.root) / dir /
+                            (std::filesystem::path(page.source).stem().string() + ".objects")).string();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok) {
+        failed_ = true;
+        return false;
+    }
+    documents_[manifest][page.page_number] = object;
+    return true;
+}
+
+bool ObjectStoreSink::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [manifest, pages] : documents_) {
+        std::string contents;
+        for (const auto& [page_number, object] : pages) {
+            contents += fmt::format("{}\t{}\n", page_number, object);
+        }
+
+        // Leave unchanged manifests alone so a rerun writes nothing
+        std::ifstream existing(manifest, std::ios::binary);
+        if (existing) {
+            std::ostringstream previous;
+            previous << existing.rdbuf();
+            if (previous.str() == contents) {
+                continue;
+            }
+        }
+        existing.close();
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(manifest).parent_path(), ec);
+        std::vector<unsigned char> bytes(contents.begin(), contents.end());
+        std::string temp = manifest + ".tmp";
+        if (!WriteQueue::write_file(temp, bytes, false)) {
+            failed_ = true;
+            continue;
+        }
+        std::filesystem::rename(temp, manifest, ec);
+        if (ec) {
+            spdlog::error("Failed to write object manifest {}: {}", manifest, ec.message());
+            failed_ = true;
+        }
+    }
+    documents_.clear();
+
+    spdlog::info("Object store: {} objects written, {} pages deduplicated",
+                 objects_written_.load(), objects_reused_.load());
+    return !failed_;
+}
+
+} // namespace popplershot
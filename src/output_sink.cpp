@@ -0,0 +1,92 @@
+#include "output_sink.h"
+#include "archive_sink.h"
+#include "lmdb_sink.h"
+#include "object_store_sink.h"
+#include "s3_sink.h"
+#include "shm_sink.h"
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+std::unique_ptr<OutputSink> OutputSink::create(const Options& options) {
+    switch (options.kind) {
+    case Kind::Tar:
+        return std::make_unique<TarSink>(options);
+    case Kind::Zip:
+        return std::make_unique<ZipSink>(options);
+    case Kind::Objects:
+        return std::make_unique<ObjectStoreSink>(options);
+    case Kind::Shm:
+#ifndef _WIN32
+    {
+        auto sink = std::make_unique<ShmSink>(options);
+        if (sink->is_open()) {
+            return sink;
+        }
+        break;
+    }
+#else
+        spdlog::error("Shared-memory output needs POSIX shared memory");
+        break;
+#endif
+    case Kind::Lmdb:
+#ifdef POPPLERSHOT_HAVE_LMDB
+    {
+        auto sink = std::make_unique<LmdbSink>(options);
+        if (sink->is_open()) {
+            return sink;
+        }
+        break;
+    }
+#else
+        spdlog::error("LMDB output is not available in this build");
+        break;
+#endif
+    case Kind::S3:
+#ifdef POPPLERSHOT_HAVE_CURL
+    {
+        auto sink = std::make_unique<S3Sink>(options);
+        if (sink->is_open()) {
+            return sink;
+        }
+        break;
+    }
+#else
+        spdlog::error("S3 output is not available in this build");
+        break;
+#endif
+    case Kind::Directory:
+        break;
+    }
+    return nullptr;
+}
+
+bool OutputSink::parse_kind(const std::string& name, Kind& kind) {
+    if (name == "dir" || name == "directory") kind = Kind::Directory;
+    else if (name == "tar") kind = Kind::Tar;
+    else if (name == "zip") kind = Kind::Zip;
+    else if (name == "lmdb") kind = Kind::Lmdb;
+    else if (name == "objects" || name == "cas") kind = Kind::Objects;
+    else if (name == "shm") kind = Kind::Shm;
+    else if (name == "s3") kind = Kind::S3;
+    else return false;
+    return true;
+}
+
+bool OutputSink::lmdb_supported() {
+#ifdef POPPLERSHOT_HAVE_LMDB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool OutputSink::s3_supported() {
+#ifdef POPPLERSHOT_HAVE_CURL
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace popplershot
@@ -0,0 +1,160 @@
+#include "output_writer.h"
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+OutputWriter::OutputWriter() : pages_since_sync_(0), sync_failed_(false) {}
+
+OutputWriter::~OutputWriter() = default;
+
+bool OutputWriter::configure(const WriteQueue::Options& options, const OutputSink::Options& sink) {
+    queue_.reset();
+    options_ = options;
+    queue_ = WriteQueue::create(options);
+    root_ = sink.root;
+    // Sinks open their files right away, so the root has to exist first
+    sink_.reset();
+    if (sink.kind != OutputSink::Kind::Directory && ensure_directory(sink.root)) {
+        sink_ = OutputSink::create(sink);
+    }
+    pages_since_sync_ = 0;
+    sync_failed_ = false;
+    spdlog::debug("Output writes: {}{}{}", backend_name(), options.atomic ? ", atomic" : "",
+                  options.durability == WriteQueue::Durability::File ? " with fsync" : "");
+    return sink.kind == OutputSink::Kind::Directory || sink_ != nullptr;
+}
+
+const char* OutputWriter::backend_name() const {
+    if (sink_) {
+        return "sink";
+    }
+    return queue_ ? queue_->name() : "sync";
+}
+
+bool OutputWriter::ensure_directory(const std::string& dir) {
+    // Archive members carry their directories in their names
+    if (dir.empty() || (sink_ && dir != root_)) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (known_directories_.count(dir)) {
+            return true;
+        }
+    }
+
+    // Racing threads may both get here; create_directories tolerates that
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec && !std::filesystem::is_directory(dir)) {
+        spdlog::error("Failed to create directory {}: {}", dir, ec.message());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    known_directories_.insert(dir);
+    return true;
+}
+
+void OutputWriter::forget_directory(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    known_directories_.erase(dir);
+}
+
+std::future<bool> OutputWriter::write(EncodedPage page, Digest& digest) {
+    if (sink_) {
+        digest.update(page.data.data(), page.data.size());
+        std::string name = std::filesystem::path(page.path).lexically_relative(root_).generic_string();
+        return sink_->submit(name, std::move(page));
+    }
+
+    std::promise<bool> written;
+    std::future<bool> result = written.get_future();
+
+    std::string parent = std::filesystem::path(page.path).parent_path().string();
+    if (!ensure_directory(parent)) {
+        written.set_value(false);
+        return result;
+    }
+    digest.update(page.data.data(), page.data.size());
+
+    if (queue_) {
+        auto promise = std::make_shared<std::promise<bool>>(std::move(written));
+        queue_->submit(std::move(page), [this, promise](bool ok) {
+            promise->set_value(ok);
+            if (ok) {
+                page_written();
+            }
+        });
+        return result;
+    }
+
+    bool fsync = options_.durability == WriteQueue::Durability::File;
+    bool ok = WriteQueue::write_file(page.path, page.data, fsync, options_.atomic);
+    // The directory may have been removed behind the cache's back; retry once
+    if (!ok && !std::filesystem::is_directory(parent)) {
+        forget_directory(parent);
+        ok = ensure_directory(parent) &&
+             WriteQueue::write_file(page.path, page.data, fsync, options_.atomic);
+    }
+    written.set_value(ok);
+    if (ok) {
+        page_written();
+    }
+    return result;
+}
+
+void OutputWriter::page_written() {
+    if (options_.durability != WriteQueue::Durability::Batch ||
+        pages_since_sync_.fetch_add(1) + 1 < options_.sync_interval) {
+        return;
+    }
+    pages_since_sync_ = 0;
+    sync_output();
+}
+
+void OutputWriter::document_finished() {
+    if (options_.durability == WriteQueue::Durability::Document && !sink_) {
+        sync_output();
+    }
+}
+
+bool OutputWriter::sync() {
+    if (sink_ || options_.durability == WriteQueue::Durability::None ||
+        options_.durability == WriteQueue::Durability::File) {
+        return true;
+    }
+    return sync_output();
+}
+
+bool OutputWriter::sync_output() {
+    // One syncfs covers every page completed before it starts
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    if (!WriteQueue::sync_filesystem(root_.empty() ? "." : root_)) {
+        sync_failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+void OutputWriter::drain() {
+    if (queue_) {
+        queue_->drain();
+    }
+}
+
+bool OutputWriter::finish() {
+    drain();
+    if (sink_) {
+        return sink_->finish();
+    }
+    if (options_.durability == WriteQueue::Durability::Batch ||
+        options_.durability == WriteQueue::Durability::Document) {
+        sync_output();
+    }
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    return !sync_failed_;
+}
+
+} // namespace popplershot
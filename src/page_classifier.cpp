@@ -0,0 +1,107 @@
+#include "page_classifier.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+namespace popplershot {
+
+namespace {
+
+// Sample every Nth pixel of every Nth row, roughly 1/16 of the page
+constexpr int kSampleStep = 4;
+constexpr int kMaxTrackedColors = 256;
+constexpr int kEdgeThreshold = 48;
+constexpr int kGrayTolerance = 8;
+
+inline int luma(const uint8_t* p) {
+    return (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+}
+
+} // namespace
+
+PageClassifier::Classification PageClassifier::classify(const uint8_t* rgba, int width, int height) {
+    Classification result{PageClass::Palette, 0, 0.0, 1.0, true};
+    if (!rgba || width < 2 || height < 1) {
+        return result;
+    }
+
+    // Small open addressing set, only needs to tell "<= 256" from "more"
+    constexpr size_t kTableSize = 1024;
+    std::array<uint32_t, kTableSize> colors;
+    std::array<bool, kTableSize> used{};
+
+    std::array<uint64_t, 16> luma_histogram{};
+    uint64_t samples = 0;
+    uint64_t extreme_samples = 0;
+    uint64_t edges = 0;
+
+    for (int y = 0; y < height; y += kSampleStep) {
+        const uint8_t* row = rgba + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x + 1 < width; x += kSampleStep) {
+            const uint8_t* p = row + static_cast<size_t>(x) * 4;
+
+            if (result.sampled_colors <= kMaxTrackedColors) {
+                uint32_t color;
+                std::memcpy(&color, p, sizeof(color));
+                size_t slot = ((color * 2654435761u) >> 22) & (kTableSize - 1);
+                while (used[slot] && colors[slot] != color) {
+                    slot = (slot + 1) & (kTableSize - 1);
+                }
+                if (!used[slot]) {
+                    used[slot] = true;
+                    colors[slot] = color;
+                    result.sampled_colors++;
+                }
+            }
+
+            if (std::abs(p[0] - p[1]) > kGrayTolerance || std::abs(p[1] - p[2]) > kGrayTolerance) {
+                result.grayscale = false;
+            }
+
+            int l = luma(p);
+            luma_histogram[l >> 4]++;
+            if (l < 48 || l > 207) {
+                extreme_samples++;
+            }
+            // Compare with the right-hand neighbor at full resolution
+            if (std::abs(l - luma(p + 4)) > kEdgeThreshold) {
+                edges++;
+            }
+            samples++;
+        }
+    }
+
+    if (samples == 0) {
+        return result;
+    }
+
+    result.edge_density = static_cast<double>(edges) / samples;
+    result.dominant_fraction =
+        static_cast<double>(*std::max_element(luma_histogram.begin(), luma_histogram.end())) / samples;
+    double extreme_fraction = static_cast<double>(extreme_samples) / samples;
+
+    if (result.grayscale && extreme_fraction >= 0.97) {
+        result.page_class = PageClass::Bilevel;
+    } else if (result.sampled_colors <= kMaxTrackedColors) {
+        result.page_class = PageClass::Palette;
+    } else if (result.dominant_fraction < 0.5 && result.edge_density < 0.2) {
+        // No paper-colored background and few hard edges: continuous tone
+        result.page_class = PageClass::Photo;
+    } else {
+        result.page_class = PageClass::Palette;
+    }
+
+    return result;
+}
+
+const char* PageClassifier::to_string(PageClass page_class) {
+    switch (page_class) {
+    case PageClass::Bilevel: return "bilevel";
+    case PageClass::Palette: return "palette";
+    case PageClass::Photo: return "photo";
+    }
+    return "unknown";
+}
+
+} // namespace popplershot
@@ -0,0 +1,321 @@
+#include "palette_quantizer.h"
+#include "image_kernels.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace popplershot {
+
+namespace {
+
+// Histogram key: 5 bits per color channel plus 3 bits of alpha
+constexpr int kHistogramBits = 18;
+constexpr size_t kHistogramSize = size_t(1) << kHistogramBits;
+// Pixels keyed per call of the dispatched kernel; small enough to stay in L1
+constexpr size_t kKeyBlock = 4096;
+
+inline uint32_t load_pixel(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t histogram_key(int r, int g, int b, int a) {
+    return (static_cast<uint32_t>(r >> 3) << 13) |
+           (static_cast<uint32_t>(g >> 3) << 8) |
+           (static_cast<uint32_t>(b >> 3) << 3) |
+           static_cast<uint32_t>(a >> 5);
+}
+
+// RGBA value at the center of a histogram bucket, for buckets no pixel fell in
+inline std::array<int, 4> bucket_center(uint32_t key) {
+    return {static_cast<int>(((key >> 13) & 31) << 3 | 4),
+            static_cast<int>(((key >> 8) & 31) << 3 | 4),
+            static_cast<int>(((key >> 3) & 31) << 3 | 4),
+            static_cast<int>((key & 7) << 5 | 16)};
+}
+
+struct HistogramEntry {
+    std::array<int, 4> color;      // Mean of the bucket's pixels, for splitting
+    std::array<uint64_t, 4> sums;  // Of the bucket's real pixel values
+    uint32_t count;
+};
+
+struct Box {
+    size_t begin;
+    size_t end;
+    int split_channel;
+    int range;
+    uint64_t population;
+};
+
+Box make_box(std::vector<HistogramEntry>& entries, size_t begin, size_t end) {
+    std::array<int, 4> lo{255, 255, 255, 255};
+    std::array<int, 4> hi{0, 0, 0, 0};
+    uint64_t population = 0;
+    for (size_t i = begin; i < end; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            lo[c] = std::min(lo[c], entries[i].color[c]);
+            hi[c] = std::max(hi[c], entries[i].color[c]);
+        }
+        population += entries[i].count;
+    }
+
+    Box box{begin, end, 0, 0, population};
+    for (int c = 0; c < 4; ++c) {
+        if (hi[c] - lo[c] > box.range) {
+            box.range = hi[c] - lo[c];
+            box.split_channel = c;
+        }
+    }
+    return box;
+}
+
+int nearest_palette_index(const std::vector<uint8_t>& palette, int r, int g, int b, int a) {
+    int best = 0;
+    int best_distance = 0x7fffffff;
+    for (size_t i = 0; i < palette.size() / 4; ++i) {
+        int dr = r - palette[i * 4 + 0];
+        int dg = g - palette[i * 4 + 1];
+        int db = b - palette[i * 4 + 2];
+        int da = a - palette[i * 4 + 3];
+        int distance = dr * dr + dg * dg + db * db + da * da;
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+// Convenience overload with default options
+PaletteQuantizer::Result PaletteQuantizer::quantize(const uint8_t* rgba, int width, int height) {
+    Options default_options;
+    return quantize(rgba, width, height, default_options);
+}
+
+PaletteQuantizer::Result PaletteQuantizer::quantize(const uint8_t* rgba, int width, int height,
+                                                    const Options& options) {
+    Result result{{}, {}, false};
+    if (!rgba || width <= 0 || height <= 0) {
+        return result;
+    }
+
+    int max_colors = std::clamp(options.max_colors, 2, 256);
+    size_t pixel_count = static_cast<size_t>(width) * height;
+
+    // Business documents rarely exceed a few dozen colors, so try the lossless path first
+    if (build_exact_palette(rgba, pixel_count, max_colors, result)) {
+        result.exact = true;
+        return result;
+    }
+
+    median_cut(rgba, width, height, options, result);
+    return result;
+}
+
+bool PaletteQuantizer::build_exact_palette(const uint8_t* rgba, size_t pixel_count,
+                                           int max_colors, Result& result) {
+    // Open addressing table, sized to stay under half full at 256 colors
+    constexpr size_t kTableSize = 1024;
+    std::array<uint32_t, kTableSize> keys;
+    std::array<int16_t, kTableSize> slots;
+    slots.fill(-1);
+
+    result.palette.clear();
+    result.indices.resize(pixel_count);
+
+    int color_count = 0;
+    uint32_t last_color = 0;
+    uint8_t last_index = 0;
+    bool have_last = false;
+
+    for (size_t i = 0; i < pixel_count; ++i) {
+        uint32_t color = load_pixel(rgba + i * 4);
+
+        // Runs of identical pixels dominate rendered pages
+        if (have_last && color == last_color) {
+            result.indices[i] = last_index;
+            continue;
+        }
+
+        size_t slot = ((color * 2654435761u) >> 22) & (kTableSize - 1);
+        while (slots[slot] >= 0 && keys[slot] != color) {
+            slot = (slot + 1) & (kTableSize - 1);
+        }
+
+        if (slots[slot] < 0) {
+            if (color_count == max_colors) {
+                result.palette.clear();
+                result.indices.clear();
+                return false;
+            }
+            keys[slot] = color;
+            slots[slot] = static_cast<int16_t>(color_count++);
+            const uint8_t* p = rgba + i * 4;
+            result.palette.insert(result.palette.end(), p, p + 4);
+        }
+
+        last_color = color;
+        last_index = static_cast<uint8_t>(slots[slot]);
+        have_last = true;
+        result.indices[i] = last_index;
+    }
+
+    return true;
+}
+
+void PaletteQuantizer::median_cut(const uint8_t* rgba, int width, int height,
+                                  const Options& options, Result& result) {
+    int max_colors = std::clamp(options.max_colors, 2, 256);
+    size_t pixel_count = static_cast<size_t>(width) * height;
+
+    // Build a reduced-precision histogram so the cut works on buckets, not
+    // pixels; the real values are summed per bucket so the palette keeps
+    // exact colors such as opaque alpha and white paper
+    std::vector<uint32_t> histogram(kHistogramSize, 0);
+    std::vector<std::array<uint64_t, 4>> bucket_sums(kHistogramSize, {0, 0, 0, 0});
+    // Keys come a block at a time from the CPU-dispatched kernel; the counting
+    // is a scatter into random buckets and stays scalar
+    const auto histogram_keys = ImageKernels::get().histogram_keys;
+    std::vector<uint32_t> keys(std::min(pixel_count, kKeyBlock));
+    for (size_t begin = 0; begin < pixel_count; begin += kKeyBlock) {
+        size_t count = std::min(kKeyBlock, pixel_count - begin);
+        histogram_keys(rgba + begin * 4, keys.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* p = rgba + (begin + i) * 4;
+            uint32_t key = keys[i];
+            histogram[key]++;
+            for (int c = 0; c < 4; ++c) {
+                bucket_sums[key][c] += p[c];
+            }
+        }
+    }
+
+    // Mean of the pixels in a bucket, or its center if it is empty
+    auto bucket_color = [&](uint32_t key) {
+        uint32_t count = histogram[key];
+        if (count == 0) {
+            return bucket_center(key);
+        }
+        std::array<int, 4> color;
+        for (int c = 0; c < 4; ++c) {
+            color[c] = static_cast<int>((bucket_sums[key][c] + count / 2) / count);
+        }
+        return color;
+    };
+
+    std::vector<HistogramEntry> entries;
+    for (uint32_t key = 0; key < kHistogramSize; ++key) {
+        if (histogram[key] > 0) {
+            entries.push_back({bucket_color(key), bucket_sums[key], histogram[key]});
+        }
+    }
+
+    // Repeatedly split the box with the widest channel range at its weighted median
+    std::vector<Box> boxes;
+    boxes.push_back(make_box(entries, 0, entries.size()));
+    while (static_cast<int>(boxes.size()) < max_colors) {
+        auto widest = std::max_element(boxes.begin(), boxes.end(), [](const Box& a, const Box& b) {
+            return a.range < b.range;
+        });
+        if (widest->range == 0 || widest->end - widest->begin < 2) {
+            break;
+        }
+
+        Box box = *widest;
+        int channel = box.split_channel;
+        std::sort(entries.begin() + box.begin, entries.begin() + box.end,
+                  [channel](const HistogramEntry& a, const HistogramEntry& b) {
+                      return a.color[channel] < b.color[channel];
+                  });
+
+        uint64_t half = box.population / 2;
+        uint64_t accumulated = 0;
+        size_t split = box.begin;
+        while (split < box.end - 1 && accumulated + entries[split].count <= half) {
+            accumulated += entries[split].count;
+            ++split;
+        }
+        if (split == box.begin) {
+            ++split;
+        }
+
+        *widest = make_box(entries, box.begin, split);
+        boxes.push_back(make_box(entries, split, box.end));
+    }
+
+    // Each palette entry is the population-weighted mean of its box
+    result.palette.clear();
+    result.palette.reserve(boxes.size() * 4);
+    for (const Box& box : boxes) {
+        std::array<uint64_t, 4> sums{0, 0, 0, 0};
+        for (size_t i = box.begin; i < box.end; ++i) {
+            for (int c = 0; c < 4; ++c) {
+                sums[c] += entries[i].sums[c];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            uint64_t mean = box.population > 0 ? (sums[c] + box.population / 2) / box.population : 0;
+            result.palette.push_back(static_cast<uint8_t>(std::min<uint64_t>(mean, 255)));
+        }
+    }
+
+    // Lazily filled bucket -> palette index map, shared by the plain and dithered paths
+    std::vector<int16_t> index_cache(kHistogramSize, -1);
+    auto lookup_key = [&](uint32_t key) -> uint8_t {
+        if (index_cache[key] < 0) {
+            auto color = bucket_color(key);
+            index_cache[key] = static_cast<int16_t>(
+                nearest_palette_index(result.palette, color[0], color[1], color[2], color[3]));
+        }
+        return static_cast<uint8_t>(index_cache[key]);
+    };
+    auto lookup = [&](int r, int g, int b, int a) { return lookup_key(histogram_key(r, g, b, a)); };
+
+    result.indices.resize(pixel_count);
+
+    if (!options.dither) {
+        for (size_t begin = 0; begin < pixel_count; begin += kKeyBlock) {
+            size_t count = std::min(kKeyBlock, pixel_count - begin);
+            histogram_keys(rgba + begin * 4, keys.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                result.indices[begin + i] = lookup_key(keys[i]);
+            }
+        }
+        return;
+    }
+
+    // Floyd-Steinberg: carry quantization error into the current and next row
+    std::vector<int> current_error(static_cast<size_t>(width + 2) * 4, 0);
+    std::vector<int> next_error(static_cast<size_t>(width + 2) * 4, 0);
+    for (int y = 0; y < height; ++y) {
+        std::fill(next_error.begin(), next_error.end(), 0);
+        for (int x = 0; x < width; ++x) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            const uint8_t* p = rgba + i * 4;
+            int* err = &current_error[static_cast<size_t>(x + 1) * 4];
+
+            std::array<int, 4> value;
+            for (int c = 0; c < 4; ++c) {
+                value[c] = std::clamp(p[c] + err[c] / 16, 0, 255);
+            }
+
+            uint8_t index = lookup(value[0], value[1], value[2], value[3]);
+            result.indices[i] = index;
+
+            for (int c = 0; c < 4; ++c) {
+                int e = value[c] - result.palette[index * 4 + c];
+                err[4 + c] += e * 7;
+                next_error[static_cast<size_t>(x) * 4 + c] += e * 3;
+                next_error[static_cast<size_t>(x + 1) * 4 + c] += e * 5;
+                next_error[static_cast<size_t>(x + 2) * 4 + c] += e;
+            }
+        }
+        std::swap(current_error, next_error);
+    }
+}
+
+} // namespace popplershot
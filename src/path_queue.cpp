@@ -0,0 +1,50 @@
+#include "path_queue.h"
+#include <algorithm>
+
+namespace popplershot {
+
+PathQueue::PathQueue(size_t capacity)
+    : capacity_(std::max<size_t>(1, capacity)), pushed_(0), closed_(false) {}
+
+bool PathQueue::push(InputFile file) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || files_.size() < capacity_; });
+    if (closed_) {
+        return false;
+    }
+    files_.push_back(std::move(file));
+    pushed_++;
+    not_empty_.notify_one();
+    return true;
+}
+
+bool PathQueue::pop(InputFile& file) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !files_.empty(); });
+    if (files_.empty()) {
+        return false;
+    }
+    file = std::move(files_.front());
+    files_.pop_front();
+    not_full_.notify_one();
+    return true;
+}
+
+void PathQueue::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+}
+
+size_t PathQueue::pushed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pushed_;
+}
+
+bool PathQueue::closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+} // namespace popplershot
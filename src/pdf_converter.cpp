@@ -1,6 +1,17 @@
 #include "pdf_converter.h"
 #include "progress_bar.h"
+#include "image_encoder.h"
+#include "palette_quantizer.h"
+#include "page_classifier.h"
+#include "pixel_pipeline.h"
+#include "image_resampler.h"
+#include "size_fitter.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <spdlog/spdlog.h>
 #include <poppler-image.h>
@@ -33,35 +44,85 @@ PDFConverter::ConversionResult PDFConverter::convert_pdf(const std::string& pdf_
 PDFConverter::ConversionResult PDFConverter::convert_pdf(const std::string& pdf_path, 
                                                        const std::string& output_dir,
                                                        const ConversionOptions& options) {
-    ConversionResult result{false, "", 0};
-    
-    auto doc = load_document(pdf_path);
+    return convert_document(load_document(pdf_path), pdf_path, output_dir, options);
+}
+
+PDFConverter::ConversionResult PDFConverter::convert_pdf_data(const std::string& pdf_path,
+                                                            const char* data,
+                                                            size_t size,
+                                                            const std::string& output_dir,
+                                                            const ConversionOptions& options) {
+    std::unique_ptr<poppler::document> doc;
+    if (size <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+        doc.reset(poppler::document::load_from_raw_data(data, static_cast<int>(size)));
+    }
+    if (!doc || doc->is_locked()) {
+        spdlog::error("Failed to load PDF: {}", pdf_path);
+        doc.reset();
+    }
+    return convert_document(std::move(doc), pdf_path, output_dir, options);
+}
+
+PDFConverter::ConversionResult PDFConverter::convert_document(std::unique_ptr<poppler::document> doc,
+                                                            const std::string& pdf_path,
+                                                            const std::string& output_dir,
+                                                            const ConversionOptions& options) {
+    ConversionResult result{false, "", 0, {}};
     if (!doc) {
         result.error_message = "Failed to load PDF document";
         return result;
     }
 
     int page_count = doc->pages();
-    spdlog::info("Converting PDF: {} ({} pages)", pdf_path, page_count);
+    std::vector<int> selected;
+    if (!select_pages(options.pages, page_count, selected)) {
+        result.error_message = "Invalid page ranges: " + options.pages;
+        return result;
+    }
+    if (selected.empty()) {
+        result.error_message = "No pages selected";
+        return result;
+    }
+    if (!options.done_pages.empty()) {
+        std::erase_if(selected, [&options](int page) {
+            return std::binary_search(options.done_pages.begin(), options.done_pages.end(), page);
+        });
+        if (selected.empty()) {
+            spdlog::info("All selected pages of {} were already written", pdf_path);
+            result.success = true;
+            return result;
+        }
+    }
+    spdlog::info("Converting PDF: {} ({} of {} pages)", pdf_path, selected.size(), page_count);
+
+    // Pre-create output directory; pages then only hit the writer's cache
+    if (!writer_.ensure_directory(output_dir)) {
+        result.error_message = "Failed to create output directory";
+        return result;
+    }
 
-    // Pre-create output directory to avoid repeated filesystem calls
-    std::filesystem::create_directories(output_dir);
+    // Resolve format, pixel layout and encoder once instead of per page
+    const PixelPipeline pipeline = PixelPipeline::resolve(
+        PixelPipeline::parse_format(options.output_format), options.palette, options.grayscale);
 
     // Create progress bar for page conversion
-    ProgressBar progress_bar(page_count, 40, "█", "░");
+    ProgressBar progress_bar(static_cast<int>(selected.size()), 40, "█", "░");
     progress_bar.set_description("Converting pages");
 
     // Use controlled parallel processing for pages to prevent memory exhaustion
     // Limit concurrent page conversions to prevent OOM kills on large PDFs
     const int max_concurrent_pages = std::min(8, std::max(2, static_cast<int>(std::thread::hardware_concurrency())));
     std::counting_semaphore<> page_semaphore(max_concurrent_pages);
-    std::vector<std::future<bool>> futures;
+    std::vector<std::future<PageResult>> futures;
+    // Writes may still be queued when a page task returns
+    std::vector<std::future<bool>> writes(selected.size());
     std::mutex doc_mutex; // Protect document access
     
     spdlog::info("Using {} concurrent page conversions (max memory safety)", max_concurrent_pages);
     
-    for (int i = 0; i < page_count; ++i) {
-        auto future = std::async(std::launch::async, [&, i]() -> bool {
+    for (size_t slot = 0; slot < selected.size(); ++slot) {
+        int i = selected[slot] - 1;
+        auto future = std::async(std::launch::async, [&, i, slot]() -> PageResult {
             // Acquire semaphore before processing page (blocks if at limit)
             page_semaphore.acquire();
             
@@ -72,6 +133,7 @@ PDFConverter::ConversionResult PDFConverter::convert_pdf(const std::string& pdf_
                 ~SemaphoreGuard() { sem.release(); }
             } guard(page_semaphore);
             
+            PageResult page_result{i + 1, false, "", "", "", 0, 0, 1.0, true, 0, ""};
             std::unique_ptr<poppler::page> page;
             {
                 std::lock_guard<std::mutex> lock(doc_mutex);
@@ -81,37 +143,50 @@ PDFConverter::ConversionResult PDFConverter::convert_pdf(const std::string& pdf_
             if (!page) {
                 spdlog::warn("Failed to create page {}", i + 1);
                 progress_bar.update();
-                return false;
+                return page_result;
             }
 
-            std::string output_filename = generate_output_filename(pdf_path, i + 1, options.output_format);
+            // Auto mode swaps the extension once the page has been classified
+            std::string extension = pipeline.format == OutputFormat::Auto ? "png" : options.output_format;
+            std::string output_filename = generate_output_filename(pdf_path, i + 1, extension);
             std::string output_path = std::filesystem::path(output_dir) / output_filename;
 
-            bool success = save_page_as_image(page.get(), output_path, options);
-            if (success) {
-                spdlog::debug("Converted page {} to {}", i + 1, output_path);
+            page_result.success = save_page_as_image(page.get(), pdf_path, output_path, options,
+                                                     pipeline, page_result, writes[slot]);
+            if (page_result.success) {
+                spdlog::debug("Converted page {} to {}", i + 1, page_result.output_path);
             } else {
                 spdlog::warn("Failed to convert page {} of {}", i + 1, pdf_path);
             }
             
             // Update progress bar after page completion
             progress_bar.update();
-            return success;
+            return page_result;
         });
         
         futures.push_back(std::move(future));
     }
 
     // Collect results
-    for (auto& future : futures) {
+    for (size_t i = 0; i < futures.size(); ++i) {
         try {
-            if (future.get()) {
+            PageResult page_result = futures[i].get();
+            if (page_result.success && writes[i].valid() && !writes[i].get()) {
+                spdlog::warn("Failed to write page {} of {}", page_result.page_number, pdf_path);
+                page_result.success = false;
+            }
+            if (page_result.success) {
                 result.pages_converted++;
+                if (options.page_written) {
+                    options.page_written(page_result);
+                }
             }
+            result.pages.push_back(std::move(page_result));
         } catch (const std::exception& e) {
             spdlog::error("Exception during page conversion: {}", e.what());
         }
     }
+    writer_.document_finished();
     
     // Finish progress bar
     progress_bar.finish();
@@ -136,7 +211,7 @@ PDFConverter::ConversionResult PDFConverter::convert_page(const std::string& pdf
                                                       int page_number,
                                                       const std::string& output_path,
                                                       const ConversionOptions& options) {
-    ConversionResult result{false, "", 0};
+    ConversionResult result{false, "", 0, {}};
     
     auto doc = load_document(pdf_path);
     if (!doc) {
@@ -155,7 +230,15 @@ PDFConverter::ConversionResult PDFConverter::convert_page(const std::string& pdf
         return result;
     }
 
-    if (save_page_as_image(page.get(), output_path, options)) {
+    const PixelPipeline pipeline = PixelPipeline::resolve(
+        PixelPipeline::parse_format(options.output_format), options.palette, options.grayscale);
+    PageResult page_result{page_number, false, "", "", "", 0, 0, 1.0, true, 0, ""};
+    std::future<bool> written;
+    page_result.success = save_page_as_image(page.get(), pdf_path, output_path, options, pipeline,
+                                             page_result, written) &&
+                          (!written.valid() || written.get());
+    result.pages.push_back(page_result);
+    if (page_result.success) {
         result.success = true;
         result.pages_converted = 1;
     } else {
@@ -166,13 +249,18 @@ PDFConverter::ConversionResult PDFConverter::convert_page(const std::string& pdf
 }
 
 bool PDFConverter::save_page_as_image(poppler::page* page, 
+                                    const std::string& pdf_path,
                                     const std::string& output_path,
-                                    const ConversionOptions& options) {
+                                    const ConversionOptions& options,
+                                    const PixelPipeline& pipeline,
+                                    PageResult& page_result,
+                                    std::future<bool>& written) {
     if (!page) return false;
 
     poppler::page_renderer renderer;
     renderer.set_render_hint(poppler::page_renderer::antialiasing, true);
     renderer.set_render_hint(poppler::page_renderer::text_antialiasing, true);
+    renderer.set_image_format(pipeline.render_format);
 
     // Get page dimensions
     poppler::rectf page_rect = page->page_rect();
@@ -202,36 +290,294 @@ bool PDFConverter::save_page_as_image(poppler::page* page,
     }
 
     // Render the page
+    if (options.adaptive_compression) {
+        adaptive_.render_started();
+    }
     poppler::image img = renderer.render_page(page, 
                                             scale_x * 72.0, scale_y * 72.0);
+    if (options.adaptive_compression) {
+        adaptive_.render_finished();
+    }
     
     if (!img.is_valid()) {
         spdlog::error("Failed to render page");
         return false;
     }
 
-    // Ensure output directory exists
-    std::filesystem::path output_file_path(output_path);
-    std::filesystem::create_directories(output_file_path.parent_path());
+    // Formats without a built-in encoder go straight through poppler
+    if (pipeline.encoder == EncoderKind::Poppler) {
+        if (!writer_.ensure_directory(std::filesystem::path(output_path).parent_path().string())) {
+            return false;
+        }
+        page_result.output_path = output_path;
+        page_result.encoder = options.output_format;
+        page_result.encode_attempts = 1;
+        bool saved = img.save(output_path, options.output_format);
+        if (!saved) {
+            spdlog::error("Failed to save image: {}", output_path);
+            return false;
+        }
+        // Poppler wrote the file itself, so this is the one case that reads it back
+        std::error_code ec;
+        page_result.output_bytes = std::filesystem::file_size(output_path, ec);
+        if (options.digest != Digest::Algorithm::None &&
+            !Digest::of_file(output_path, options.digest, page_result.digest)) {
+            spdlog::warn("Failed to checksum {}", output_path);
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> storage;
+    Raster raster;
+    if (!pipeline.prepare(img, storage, raster)) {
+        return false;
+    }
+
+    int level = options.adaptive_compression ? adaptive_.current_level() : options.compression_level;
+    page_result.compression_level = level;
+
+    std::vector<unsigned char> encoded;
+    if (options.adaptive_compression) {
+        adaptive_.encode_started();
+    }
+    bool encoded_ok = encode_page(raster, output_path, options, pipeline.encoder, level,
+                                  page_result, encoded);
+    page_result.encode_attempts = 1;
+    if (encoded_ok && options.max_file_size > 0 && encoded.size() > options.max_file_size) {
+        encoded_ok = fit_to_size(raster, options, page_result, encoded);
+    }
+    if (options.adaptive_compression) {
+        adaptive_.encode_finished(encoded_ok ? encoded.size() : 0);
+    }
+
+    if (!encoded_ok) {
+        spdlog::error("Failed to encode image: {}", page_result.output_path);
+        return false;
+    }
+
+    // Hashed here, written in the background when a write queue is configured
+    page_result.output_bytes = encoded.size();
+    EncodedPage output;
+    output.path = page_result.output_path;
+    output.data = std::move(encoded);
+    output.source = std::filesystem::path(pdf_path).filename().string();
+    output.page_number = page_result.page_number;
+    output.width = std::max(1, static_cast<int>(std::lround(raster.width * page_result.scale)));
+    output.height = std::max(1, static_cast<int>(std::lround(raster.height * page_result.scale)));
+    output.encoder = page_result.encoder;
+    output.channels = pipeline.encoder == EncoderKind::Raw ? raster.channels : 0;
+    Digest digest(options.digest);
+    written = writer_.write(std::move(output), digest);
+    page_result.digest = digest.finish();
+
+    return true;
+}
+
+bool PDFConverter::encode_page(const Raster& raster,
+                               const std::string& output_path,
+                               const ConversionOptions& options,
+                               EncoderKind encoder,
+                               int compression_level,
+                               PageResult& page_result,
+                               std::vector<unsigned char>& encoded) {
+    page_result.output_path = output_path;
+
+    if (encoder == EncoderKind::Auto) {
+        // Auto pipelines always hand over tightly packed RGBA
+        auto classification = PageClassifier::classify(raster.data, raster.width, raster.height);
+        page_result.page_class = PageClassifier::to_string(classification.page_class);
+        spdlog::debug("Page {} classified as {} (colors: {}, edges: {:.3f}, dominant: {:.2f})",
+                      page_result.page_number, page_result.page_class, classification.sampled_colors,
+                      classification.edge_density, classification.dominant_fraction);
+
+        std::filesystem::path path(output_path);
+        switch (classification.page_class) {
+        case PageClassifier::PageClass::Bilevel:
+            page_result.encoder = "png-1bit";
+            page_result.output_path = path.replace_extension(".png").string();
+            return ImageEncoder::encode_bilevel_png(raster, compression_level, encoded);
+        case PageClassifier::PageClass::Palette:
+            encoder = EncoderKind::PalettePng;
+            page_result.output_path = path.replace_extension(".png").string();
+            break;
+        case PageClassifier::PageClass::Photo:
+            encoder = EncoderKind::Jpeg;
+            page_result.output_path = path.replace_extension(".jpg").string();
+            break;
+        }
+    }
+
+    switch (encoder) {
+    case EncoderKind::Raw: {
+        // Tightly packed rows, dropping any stride padding
+        page_result.encoder = "raw";
+        size_t row_bytes = static_cast<size_t>(raster.width) * raster.channels;
+        encoded.resize(row_bytes * raster.height);
+        for (int y = 0; y < raster.height; ++y) {
+            std::memcpy(encoded.data() + y * row_bytes, raster.row(y), row_bytes);
+        }
+        return true;
+    }
+    case EncoderKind::Jpeg:
+        page_result.encoder = "jpeg";
+        return ImageEncoder::encode_jpeg(raster, options.jpeg_quality, compression_level, encoded);
+    case EncoderKind::PalettePng: {
+        page_result.encoder = "png-palette";
+        PaletteQuantizer::Options quantizer_options;
+        quantizer_options.dither = options.dither;
+        auto quantized = PaletteQuantizer::quantize(raster.data, raster.width, raster.height,
+                                                    quantizer_options);
+        spdlog::debug("Quantized page {} to {} colors ({})", page_result.page_number,
+                      quantized.palette.size() / 4, quantized.exact ? "exact" : "approximated");
+        return ImageEncoder::encode_indexed_png(quantized, raster.width, raster.height,
+                                                compression_level, encoded);
+    }
+    default:
+        page_result.encoder = "png";
+        return ImageEncoder::encode_png(raster, compression_level, encoded);
+    }
+}
 
-    // Save the image
-    bool saved = false;
-    if (options.output_format == "png") {
-        saved = img.save(output_path, "png");
-    } else if (options.output_format == "jpg" || options.output_format == "jpeg") {
-        saved = img.save(output_path, "jpeg");
+bool PDFConverter::fit_to_size(const Raster& raster,
+                               const ConversionOptions& options,
+                               PageResult& page_result,
+                               std::vector<unsigned char>& encoded) {
+    SizeFitter::Options fit_options;
+    fit_options.max_bytes = options.max_file_size;
+    SizeFitter::EncodeFn encode;
+    const int effort = page_result.compression_level;
+
+    if (page_result.encoder == "jpeg") {
+        // Search quality first; the oversized attempt in encoded is reused
+        fit_options.lossy = true;
+        fit_options.max_quality = options.jpeg_quality;
+        fit_options.min_quality = std::min(fit_options.min_quality, options.jpeg_quality);
+        encode = [effort](const Raster& r, int quality, std::vector<unsigned char>& out) {
+            return ImageEncoder::encode_jpeg(r, quality, effort, out);
+        };
+    } else if (page_result.encoder == "png-1bit") {
+        encoded.clear();
+        encode = [](const Raster& r, int, std::vector<unsigned char>& out) {
+            return ImageEncoder::encode_bilevel_png(r, 9, out);
+        };
+    } else if (raster.channels == 1) {
+        encoded.clear();
+        encode = [](const Raster& r, int, std::vector<unsigned char>& out) {
+            return ImageEncoder::encode_png(r, 9, out);
+        };
     } else {
-        saved = img.save(output_path, options.output_format);
+        // Color PNG has no quality knob; an indexed palette at full deflate
+        // effort is usually the biggest lossless-looking saving before shrinking
+        encoded.clear();
+        page_result.encoder = "png-palette";
+        encode = [&options](const Raster& r, int, std::vector<unsigned char>& out) {
+            std::vector<uint8_t> storage;
+            Raster rgba = ImageResampler::to_rgba(r, storage);
+            PaletteQuantizer::Options quantizer_options;
+            quantizer_options.dither = options.dither;
+            auto quantized = PaletteQuantizer::quantize(rgba.data, rgba.width, rgba.height,
+                                                        quantizer_options);
+            return ImageEncoder::encode_indexed_png(quantized, rgba.width, rgba.height, 9, out);
+        };
     }
 
-    if (!saved) {
-        spdlog::error("Failed to save image: {}", output_path);
+    bool reused = !encoded.empty();
+    SizeFitter::Result fit;
+    if (!SizeFitter::fit(raster, fit_options, encode, encoded, fit)) {
+        return false;
+    }
+
+    page_result.encode_attempts = (reused ? 0 : 1) + fit.attempts;
+    page_result.scale = fit.scale;
+    page_result.within_budget = fit.fits;
+    if (fit.fits) {
+        spdlog::debug("Page {} fit {} bytes in {} attempts (quality {}, scale {:.2f})",
+                      page_result.page_number, encoded.size(), page_result.encode_attempts,
+                      fit.quality, fit.scale);
+    } else {
+        spdlog::warn("Page {} is still {} bytes after {} attempts, over the {} byte budget",
+                     page_result.page_number, encoded.size(), page_result.encode_attempts,
+                     options.max_file_size);
     }
+    return true;
+}
+
+bool PDFConverter::configure_output(const WriteQueue::Options& options, const OutputSink::Options& sink) {
+    return writer_.configure(options, sink);
+}
+
+bool PDFConverter::finish_output() {
+    return writer_.finish();
+}
 
-    return saved;
+bool PDFConverter::sync_output() {
+    return writer_.sync();
+}
+
+void PDFConverter::reset_adaptive_compression(const ConversionOptions& options) {
+    AdaptiveCompression::Options adaptive_options;
+    adaptive_options.min_level = options.min_compression_level;
+    adaptive_options.max_level = options.max_compression_level;
+    adaptive_options.initial_level = options.compression_level;
+    adaptive_options.max_page_bytes = options.size_ceiling;
+    adaptive_.reset(adaptive_options);
+}
+
+bool PDFConverter::select_pages(const std::string& ranges, int page_count, std::vector<int>& pages) {
+    pages.clear();
+    if (ranges.empty()) {
+        for (int page = 1; page <= page_count; ++page) {
+            pages.push_back(page);
+        }
+        return true;
+    }
+
+    auto parse_number = [](const char*& p, const char* end, int& value) {
+        auto [next, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc() || value < 1) {
+            return false;
+        }
+        p = next;
+        return true;
+    };
+
+    std::vector<bool> wanted(static_cast<size_t>(std::max(page_count, 0)) + 1, false);
+    const char* p = ranges.data();
+    const char* end = p + ranges.size();
+    for (;;) {
+        int first = 0;
+        if (!parse_number(p, end, first)) {
+            return false;
+        }
+        int last = first;
+        if (p < end && *p == '-') {
+            ++p;
+            // "10-" runs to the last page
+            last = p == end || *p == ',' ? std::max(first, page_count) : 0;
+            if (last == 0 && (!parse_number(p, end, last) || last < first)) {
+                return false;
+            }
+        }
+        for (int page = first; page <= std::min(last, page_count); ++page) {
+            wanted[page] = true;
+        }
+        if (p == end) {
+            break;
+        }
+        if (*p++ != ',') {
+            return false;
+        }
+    }
+
+    for (int page = 1; page <= page_count; ++page) {
+        if (wanted[page]) {
+            pages.push_back(page);
+        }
+    }
+    return true;
 }
 
-std::string PDFConverter::generate_output_filename(const std::string& pdf_path, 
+std::string PDFConverter::generate_output_filename(const std::string& pdf_path,
                                                  int page_number,
                                                  const std::string& extension) {
     std::filesystem::path path(pdf_path);
@@ -0,0 +1,224 @@
+#include "pixel_pipeline.h"
+#include "image_encoder.h"
+#include "image_kernels.h"
+#include <chrono>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+namespace {
+
+template <class Dst>
+RowConverter converter_from(poppler::image::format_enum source) {
+    switch (source) {
+    case poppler::image::format_argb32: return pixel::convert_row<pixel::Argb32, Dst>;
+    case poppler::image::format_rgb24: return pixel::convert_row<pixel::Rgb24, Dst>;
+    case poppler::image::format_bgr24: return pixel::convert_row<pixel::Bgr24, Dst>;
+    case poppler::image::format_gray8: return pixel::convert_row<pixel::Gray8, Dst>;
+    case poppler::image::format_mono: return pixel::convert_row<pixel::Mono1, Dst>;
+    default: return nullptr;
+    }
+}
+
+// The per-pixel path the pipelines replace: both layouts are decided
+// inside the loop and every page is expanded to RGBA
+void expand_generic(poppler::image::format_enum source, const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        pixel::Rgba p{0, 0, 0, 255};
+        switch (source) {
+        case poppler::image::format_argb32: p = pixel::Argb32::load(src, x); break;
+        case poppler::image::format_rgb24: p = pixel::Rgb24::load(src, x); break;
+        case poppler::image::format_bgr24: p = pixel::Bgr24::load(src, x); break;
+        case poppler::image::format_gray8: p = pixel::Gray8::load(src, x); break;
+        case poppler::image::format_mono: p = pixel::Mono1::load(src, x); break;
+        default: break;
+        }
+        pixel::Rgba8::store(dst, x, p);
+    }
+}
+
+// A page of text-like strokes on white paper, roughly A4 at 150 dpi
+poppler::image synthetic_page(poppler::image::format_enum format) {
+    constexpr int kWidth = 1240;
+    constexpr int kHeight = 1754;
+    poppler::image img(kWidth, kHeight, format);
+    int bytes = format == poppler::image::format_argb32 ? 4 : format == poppler::image::format_gray8 ? 1 : 3;
+    uint32_t state = 12345;
+    for (int y = 0; y < kHeight; ++y) {
+        auto* row = reinterpret_cast<uint8_t*>(img.data()) + static_cast<size_t>(y) * img.bytes_per_row();
+        bool text_line = y % 24 < 14 && y > 100 && y < kHeight - 100;
+        for (int x = 0; x < kWidth; ++x) {
+            state = state * 1664525u + 1013904223u;
+            bool ink = text_line && x > 100 && x < kWidth - 100 && (state >> 24) < 70;
+            uint8_t v = ink ? static_cast<uint8_t>(state >> 8 & 63) : 255;
+            for (int c = 0; c < bytes; ++c) {
+                // Opaque alpha in the high byte of argb32, and a tinted heading
+                row[x * bytes + c] = bytes == 4 && c == 3 ? 255 : y < 80 && c == 0 ? 200 : v;
+            }
+        }
+    }
+    return img;
+}
+
+} // namespace
+
+OutputFormat PixelPipeline::parse_format(const std::string& name) {
+    if (name == "png") return OutputFormat::Png;
+    if (name == "jpg" || name == "jpeg") return OutputFormat::Jpeg;
+    if (name == "auto") return OutputFormat::Auto;
+    if (name == "raw") return OutputFormat::Raw;
+    return OutputFormat::Other;
+}
+
+PixelPipeline PixelPipeline::resolve(OutputFormat format, bool palette, bool grayscale) {
+    auto gray_or = [grayscale](poppler::image::format_enum color) {
+        return grayscale ? poppler::image::format_gray8 : color;
+    };
+
+    switch (format) {
+    case OutputFormat::Png:
+        if (palette) {
+            // The quantizer works on RGBA
+            return {format, EncoderKind::PalettePng, gray_or(poppler::image::format_argb32), 4};
+        }
+        // Pages render onto opaque paper, so skip alpha entirely
+        return {format, EncoderKind::Png, gray_or(poppler::image::format_rgb24), grayscale ? 1 : 3};
+    case OutputFormat::Jpeg:
+        return {format, EncoderKind::Jpeg, gray_or(poppler::image::format_rgb24), grayscale ? 1 : 3};
+    case OutputFormat::Auto:
+        // The classifier and every candidate encoder accept RGBA
+        return {format, EncoderKind::Auto, gray_or(poppler::image::format_argb32), 4};
+    case OutputFormat::Raw:
+        return {format, EncoderKind::Raw, gray_or(poppler::image::format_rgb24), grayscale ? 1 : 3};
+    case OutputFormat::Other:
+        break;
+    }
+    return {format, EncoderKind::Poppler, poppler::image::format_argb32, 4};
+}
+
+RowConverter PixelPipeline::select_converter(poppler::image::format_enum source, int channels) {
+    switch (channels) {
+    case 1:
+        if (source == poppler::image::format_gray8) return nullptr;
+        // ARGB32 rows, as poppler renders when it ignores the requested format
+        if (source == poppler::image::format_argb32) return ImageKernels::get().argb32_to_luma;
+        return converter_from<pixel::Luma8>(source);
+    case 3:
+        if (source == poppler::image::format_rgb24) return nullptr;
+        if (source == poppler::image::format_argb32) return ImageKernels::get().argb32_to_rgb;
+        return converter_from<pixel::Rgb8>(source);
+    default:
+        // The hot path for palette and auto output: use the CPU-dispatched swizzle
+        if (source == poppler::image::format_argb32) return ImageKernels::get().argb32_to_rgba;
+        return converter_from<pixel::Rgba8>(source);
+    }
+}
+
+bool PixelPipeline::prepare(const poppler::image& img, std::vector<uint8_t>& storage,
+                            Raster& raster) const {
+    if (!img.is_valid()) {
+        return false;
+    }
+
+    int width = img.width();
+    int height = img.height();
+    const auto* data = reinterpret_cast<const uint8_t*>(img.const_data());
+    size_t stride = static_cast<size_t>(img.bytes_per_row());
+
+    // Usually the requested render format, but older poppler may ignore it
+    bool passthrough = (img.format() == poppler::image::format_gray8 && channels == 1) ||
+                       (img.format() == poppler::image::format_rgb24 && channels == 3);
+    if (passthrough) {
+        raster = {data, width, height, stride, channels};
+        return true;
+    }
+
+    RowConverter convert = select_converter(img.format(), channels);
+    if (!convert) {
+        spdlog::error("Unsupported image format: {}", static_cast<int>(img.format()));
+        return false;
+    }
+
+    size_t packed_stride = static_cast<size_t>(width) * channels;
+    storage.resize(packed_stride * height);
+    for (int y = 0; y < height; ++y) {
+        convert(data + y * stride, storage.data() + y * packed_stride, width);
+    }
+
+    raster = {storage.data(), width, height, packed_stride, channels};
+    return true;
+}
+
+void PixelPipeline::benchmark(std::ostream& out) {
+    constexpr int kRounds = 10;
+    constexpr int kCompression = 6;
+    constexpr int kQuality = 90;
+
+    struct Case {
+        const char* name;
+        OutputFormat format;
+        bool grayscale;
+    };
+    out << fmt::format("Converting and encoding a {}x{} page, {} rounds, ms per page\n", 1240, 1754, kRounds);
+    out << fmt::format("  {:<12} {:>10} {:>10} {:>10} {:>10}\n", "", "generic", "pipeline", "generic", "pipeline");
+    out << fmt::format("  {:<12} {:>10} {:>10} {:>10} {:>10}\n", "", "convert", "convert", "total", "total");
+
+    for (const Case& c : {Case{"RGBA->PNG", OutputFormat::Auto, false}, Case{"RGB->JPEG", OutputFormat::Jpeg, false},
+                          Case{"Gray->PNG", OutputFormat::Png, true}}) {
+        PixelPipeline pipeline = resolve(c.format, false, c.grayscale);
+        poppler::image img = synthetic_page(pipeline.render_format);
+        auto encode = [&](const Raster& raster, std::vector<unsigned char>& encoded) {
+            return c.format == OutputFormat::Jpeg ? ImageEncoder::encode_jpeg(raster, kQuality, kCompression, encoded)
+                                                  : ImageEncoder::encode_png(raster, kCompression, encoded);
+        };
+
+        // Each round converts once, timed alone, then encodes what it made
+        auto run = [&](bool generic, double& convert_ms, double& total_ms, size_t& bytes) {
+            std::vector<uint8_t> storage;
+            std::vector<unsigned char> encoded;
+            convert_ms = total_ms = 0;
+            for (int round = 0; round < kRounds; ++round) {
+                auto start = std::chrono::steady_clock::now();
+                Raster raster{};
+                if (generic) {
+                    size_t stride = static_cast<size_t>(img.width()) * 4;
+                    storage.resize(stride * img.height());
+                    const auto* data = reinterpret_cast<const uint8_t*>(img.const_data());
+                    for (int y = 0; y < img.height(); ++y) {
+                        expand_generic(img.format(), data + static_cast<size_t>(y) * img.bytes_per_row(),
+                                       storage.data() + y * stride, img.width());
+                    }
+                    raster = {storage.data(), img.width(), img.height(), stride, 4};
+                } else if (!pipeline.prepare(img, storage, raster)) {
+                    return false;
+                }
+                auto converted = std::chrono::steady_clock::now();
+                encoded.clear();
+                if (!encode(raster, encoded)) {
+                    return false;
+                }
+                auto done = std::chrono::steady_clock::now();
+                convert_ms += std::chrono::duration<double, std::milli>(converted - start).count();
+                total_ms += std::chrono::duration<double, std::milli>(done - start).count();
+            }
+            convert_ms /= kRounds;
+            total_ms /= kRounds;
+            bytes = encoded.size();
+            return true;
+        };
+
+        double generic_convert, generic_total, pipeline_convert, pipeline_total;
+        size_t generic_bytes, pipeline_bytes;
+        if (!run(true, generic_convert, generic_total, generic_bytes) ||
+            !run(false, pipeline_convert, pipeline_total, pipeline_bytes)) {
+            out << fmt::format("  {:<12} failed to encode\n", c.name);
+            continue;
+        }
+        out << fmt::format("  {:<12} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}  ({} vs {} bytes)\n", c.name,
+                           generic_convert, pipeline_convert, generic_total, pipeline_total, generic_bytes,
+                           pipeline_bytes);
+    }
+}
+
+} // namespace popplershot
@@ -0,0 +1,114 @@
+#include "s3_signer.h"
+#include "sha256.h"
+#include <cstdlib>
+#include <ctime>
+#include <fmt/format.h>
+
+namespace popplershot {
+
+bool S3Credentials::from_environment(S3Credentials& credentials) {
+    const char* access = std::getenv("AWS_ACCESS_KEY_ID");
+    const char* secret = std::getenv("AWS_SECRET_ACCESS_KEY");
+    const char* token = std::getenv("AWS_SESSION_TOKEN");
+    if (!access || !secret || !*access || !*secret) {
+        return false;
+    }
+    credentials.access_key = access;
+    credentials.secret_key = secret;
+    credentials.session_token = token ? token : "";
+    return true;
+}
+
+S3Signer::S3Signer(S3Credentials credentials, std::string region, std::string service)
+    : credentials_(std::move(credentials)), region_(std::move(region)), service_(std::move(service)) {}
+
+std::string S3Signer::amz_date() {
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char buffer[17];
+    std::strftime(buffer, sizeof(buffer), "%Y%m%dT%H%M%SZ", &utc);
+    return buffer;
+}
+
+std::string S3Signer::uri_encode(const std::string& value, bool keep_slash) {
+    std::string encoded;
+    encoded.reserve(value.size());
+    for (unsigned char c : value) {
+        bool unreserved = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                          c == '-' || c == '_' || c == '.' || c == '~';
+        if (unreserved || (keep_slash && c == '/')) {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += fmt::format("%{:02X}", c);
+        }
+    }
+    return encoded;
+}
+
+std::string S3Signer::sha256_hex(const void* data, size_t size) {
+    Sha256::Hash hash = Sha256::hash(data, size);
+    return Sha256::to_hex(hash.data(), hash.size());
+}
+
+std::string S3Signer::hmac(const std::string& key, const std::string& message) {
+    constexpr size_t kBlock = 64;
+    std::string block = key;
+    if (block.size() > kBlock) {
+        Sha256::Hash hashed = Sha256::hash(block.data(), block.size());
+        block.assign(hashed.begin(), hashed.end());
+    }
+    block.resize(kBlock, '\0');
+
+    std::string inner_pad(kBlock, '\0'), outer_pad(kBlock, '\0');
+    for (size_t i = 0; i < kBlock; ++i) {
+        inner_pad[i] = static_cast<char>(block[i] ^ 0x36);
+        outer_pad[i] = static_cast<char>(block[i] ^ 0x5c);
+    }
+    Sha256 inner;
+    inner.update(inner_pad.data(), inner_pad.size());
+    inner.update(message.data(), message.size());
+    Sha256::Hash inner_hash = inner.finish();
+
+    Sha256 outer;
+    outer.update(outer_pad.data(), outer_pad.size());
+    outer.update(inner_hash.data(), inner_hash.size());
+    Sha256::Hash result = outer.finish();
+    return std::string(result.begin(), result.end());
+}
+
+std::string S3Signer::authorization(const std::string& method, const std::string& uri,
+                                    const std::string& query,
+                                    const std::map<std::string, std::string>& headers,
+                                    const std::string& payload_hash) const {
+    std::string canonical_headers;
+    std::string signed_headers;
+    for (const auto& [name, value] : headers) {
+        canonical_headers += name + ":" + value + "\n";
+        signed_headers += (signed_headers.empty() ? "" : ";") + name;
+    }
+    std::string canonical_request = method + "\n" + uri + "\n" + query + "\n" + canonical_headers +
+                                    "\n" + signed_headers + "\n" + payload_hash;
+
+    const std::string& timestamp = headers.at("x-amz-date");
+    std::string date = timestamp.substr(0, 8);
+    std::string scope = date + "/" + region_ + "/" + service_ + "/aws4_request";
+    std::string string_to_sign = "AWS4-HMAC-SHA256\n" + timestamp + "\n" + scope + "\n" +
+                                 sha256_hex(canonical_request.data(), canonical_request.size());
+
+    std::string key = hmac("AWS4" + credentials_.secret_key, date);
+    key = hmac(key, region_);
+    key = hmac(key, service_);
+    key = hmac(key, "aws4_request");
+    std::string signature = hmac(key, string_to_sign);
+
+    return "AWS4-HMAC-SHA256 Credential=" + credentials_.access_key + "/" + scope +
+           ", SignedHeaders=" + signed_headers + ", Signature=" +
+           Sha256::to_hex(reinterpret_cast<const uint8_t*>(signature.data()), signature.size());
+}
+
+} // namespace popplershot
@@ -0,0 +1,317 @@
+#include "s3_sink.h"
+
+#ifdef POPPLERSHOT_HAVE_CURL
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <curl/curl.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+namespace {
+
+constexpr int kMaxAttempts = 4;
+
+size_t collect_body(char* data, size_t size, size_t count, void* user) {
+    static_cast<std::string*>(user)->append(data, size * count);
+    return size * count;
+}
+
+size_t collect_etag(char* data, size_t size, size_t count, void* user) {
+    std::string line(data, size * count);
+    std::string name = line.substr(0, 5);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (line.size() > 5 && name == "etag:") {
+        std::string value = line.substr(5);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r\n") + 1);
+        *static_cast<std::string*>(user) = value;
+    }
+    return size * count;
+}
+
+std::string xml_element(const std::string& xml, const std::string& name) {
+    size_t start = xml.find("<" + name + ">");
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += name.size() + 2;
+    size_t end = xml.find("</" + name + ">", start);
+    return end == std::string::npos ? "" : xml.substr(start, end - start);
+}
+
+} // namespace
+
+// One reusable easy handle; curl keeps its connection alive between requests
+class S3Sink::Connection {
+public:
+    Connection() : handle(curl_easy_init()) {}
+    ~Connection() {
+        if (handle) {
+            curl_easy_cleanup(handle);
+        }
+    }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    CURL* handle;
+};
+
+S3Sink::S3Sink(const Options& options)
+    : options_(options), inflight_bytes_(0), active_(0), stopping_(false), failed_(false) {
+    static std::once_flag curl_init;
+    std::call_once(curl_init, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    if (!parse_url(options_.s3_url, endpoint_, host_, bucket_, prefix_)) {
+        spdlog::error("Invalid S3 URL: {} (expected http(s)://host[:port]/bucket[/prefix])",
+                      options_.s3_url);
+        return;
+    }
+    S3Credentials credentials;
+    if (!S3Credentials::from_environment(credentials)) {
+        spdlog::error("S3 output needs AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY");
+        return;
+    }
+    signer_ = std::make_unique<S3Signer>(std::move(credentials), options_.s3_region);
+
+    int threads = std::max(1, options_.upload_threads);
+    for (int i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { run(); });
+    }
+    spdlog::info("Uploading pages to {}/{}/{} with {} connections", endpoint_, bucket_, prefix_, threads);
+}
+
+S3Sink::~S3Sink() {
+    finish();
+}
+
+bool S3Sink::parse_url(const std::string& url, std::string& endpoint, std::string& host,
+                       std::string& bucket, std::string& prefix) {
+    size_t scheme = url.find("://");
+    if (scheme == std::string::npos) {
+        return false;
+    }
+    std::string protocol = url.substr(0, scheme);
+    if (protocol != "http" && protocol != "https") {
+        return false;
+    }
+    size_t host_start = scheme + 3;
+    size_t path = url.find('/', host_start);
+    host = url.substr(host_start, path == std::string::npos ? std::string::npos : path - host_start);
+    if (host.empty() || path == std::string::npos) {
+        return false;
+    }
+    endpoint = protocol + "://" + host;
+
+    std::string rest = url.substr(path + 1);
+    size_t slash = rest.find('/');
+    bucket = rest.substr(0, slash);
+    prefix = slash == std::string::npos ? "" : rest.substr(slash + 1);
+    while (!prefix.empty() && prefix.back() == '/') {
+        prefix.pop_back();
+    }
+    return !bucket.empty();
+}
+
+bool S3Sink::write(const std::string& name, EncodedPage page) {
+    return enqueue({prefix_.empty() ? name : prefix_ + "/" + name, std::move(page.data), nullptr});
+}
+
+std::future<bool> S3Sink::submit(const std::string& name, EncodedPage page) {
+    auto done = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = done->get_future();
+    if (!enqueue({prefix_.empty() ? name : prefix_ + "/" + name, std::move(page.data), done})) {
+        done->set_value(false);
+    }
+    return result;
+}
+
+bool S3Sink::enqueue(Upload upload) {
+    size_t bytes = upload.data.size();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Always admit one upload so a page above the limit cannot deadlock
+    space_.wait(lock, [&] {
+        return failed_ || inflight_bytes_ == 0 ||
+               inflight_bytes_ + bytes <= options_.max_inflight_bytes;
+    });
+    if (failed_ || stopping_ || workers_.empty()) {
+        return false;
+    }
+    inflight_bytes_ += bytes;
+    queue_.push_back(std::move(upload));
+    ready_.notify_one();
+    return true;
+}
+
+void S3Sink::run() {
+    Connection connection;
+    for (;;) {
+        Upload upload;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            upload = std::move(queue_.front());
+            queue_.pop_front();
+            active_++;
+        }
+
+        bool ok = connection.handle && this->upload(connection, upload);
+        if (upload.done) {
+            upload.done->set_value(ok);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok) {
+            failed_ = true;
+        }
+        inflight_bytes_ -= upload.data.size();
+        active_--;
+        space_.notify_all();
+        if (queue_.empty() && active_ == 0) {
+            idle_.notify_all();
+        }
+    }
+}
+
+bool S3Sink::upload(Connection& connection, const Upload& upload) {
+    if (upload.data.size() > options_.part_size) {
+        return upload_multipart(connection, upload);
+    }
+    Response response;
+    return request(connection, "PUT", upload.key, "", upload.data.data(), upload.data.size(), response);
+}
+
+bool S3Sink::upload_multipart(Connection& connection, const Upload& upload) {
+    Response response;
+    if (!request(connection, "POST", upload.key, "uploads=", nullptr, 0, response)) {
+        return false;
+    }
+    std::string upload_id = xml_element(response.body, "UploadId");
+    if (upload_id.empty()) {
+        spdlog::error("No upload id in the multipart reply for {}", upload.key);
+        return false;
+    }
+    std::string id_query = "uploadId=" + S3Signer::uri_encode(upload_id, false);
+
+    std::string parts = "<CompleteMultipartUpload>";
+    bool ok = true;
+    int part = 1;
+    for (size_t offset = 0; ok && offset < upload.data.size(); offset += options_.part_size, ++part) {
+        size_t size = std::min(options_.part_size, upload.data.size() - offset);
+        // Canonical query parameters are sorted: partNumber before uploadId
+        ok = request(connection, "PUT", upload.key, fmt::format("partNumber={}&{}", part, id_query),
+                     upload.data.data() + offset, size, response);
+        parts += fmt::format("<Part><PartNumber>{}</PartNumber><ETag>{}</ETag></Part>", part, response.etag);
+    }
+    parts += "</CompleteMultipartUpload>";
+
+    if (ok) {
+        ok = request(connection, "POST", upload.key, id_query,
+                     reinterpret_cast<const unsigned char*>(parts.data()), parts.size(), response) &&
+             response.body.find("<Error>") == std::string::npos;
+    }
+    if (!ok) {
+        spdlog::error("Multipart upload of {} failed, aborting it", upload.key);
+        request(connection, "DELETE", upload.key, id_query, nullptr, 0, response);
+    }
+    return ok;
+}
+
+bool S3Sink::request(Connection& connection, const std::string& method, const std::string& key,
+                     const std::string& query, const unsigned char* body, size_t size,
+                     Response& response) {
+    std::string uri = "/" + bucket_ + "/" + S3Signer::uri_encode(key, true);
+    std::string url = endpoint_ + uri + (query.empty() ? "" : "?" + query);
+    std::string payload_hash = S3Signer::sha256_hex(body ? body : reinterpret_cast<const unsigned char*>(""), size);
+    CURL* curl = connection.handle;
+
+    auto backoff = std::chrono::milliseconds(100);
+    for (int attempt = 1;; ++attempt) {
+        std::map<std::string, std::string> headers = {
+            {"host", host_},
+            {"x-amz-content-sha256", payload_hash},
+            {"x-amz-date", S3Signer::amz_date()},
+        };
+        if (!signer_->credentials().session_token.empty()) {
+            headers["x-amz-security-token"] = signer_->credentials().session_token;
+        }
+        std::string authorization = signer_->authorization(method, uri, query, headers, payload_hash);
+
+        curl_slist* list = nullptr;
+        for (const auto& [name, value] : headers) {
+            if (name != "host") {
+                list = curl_slist_append(list, (name + ": " + value).c_str());
+            }
+        }
+        list = curl_slist_append(list, ("Authorization: " + authorization).c_str());
+        list = curl_slist_append(list, "Content-Type: application/octet-stream");
+        list = curl_slist_append(list, "Expect:"); // No 100-continue round trip
+
+        response = Response{};
+        // Reset keeps the connection cache, so the socket is reused
+        curl_easy_reset(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+        if (method == "PUT" || method == "POST") {
+            curl_easy_setopt(curl, CURLOPT_POST, 1L);
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body ? reinterpret_cast<const char*>(body) : "");
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(size));
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, collect_body);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collect_etag);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response.etag);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        // Give up on a connection that stalls below 1 KB/s for 30 seconds
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+
+        CURLcode code = curl_easy_perform(curl);
+        curl_slist_free_all(list);
+        if (code == CURLE_OK) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+            if (response.status >= 200 && response.status < 300) {
+                return true;
+            }
+        }
+
+        bool retry = code != CURLE_OK || response.status >= 500 || response.status == 429;
+        std::string reason = code != CURLE_OK ? curl_easy_strerror(code)
+                                              : fmt::format("HTTP {} {}", response.status,
+                                                            xml_element(response.body, "Code"));
+        if (!retry || attempt == kMaxAttempts) {
+            spdlog::error("S3 {} {} failed: {}", method, key, reason);
+            return false;
+        }
+        spdlog::debug("S3 {} {} failed ({}), retrying", method, key, reason);
+        std::this_thread::sleep_for(backoff);
+        backoff *= 2;
+    }
+}
+
+bool S3Sink::finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && active_ == 0; });
+    stopping_ = true;
+    ready_.notify_all();
+    lock.unlock();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    lock.lock();
+    return signer_ && !failed_;
+}
+
+} // namespace popplershot
+
+#endif // POPPLERSHOT_HAVE_CURL
@@ -0,0 +1,120 @@
+#include "shm_sink.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+ShmSink::ShmSink(const Options& options)
+    : name_(options.shm_name), length_(0), header_(nullptr), ring_(nullptr),
+      capacity_(options.shm_size) {
+    // Starts from a fresh, zeroed object so no stale records are visible
+    ::shm_unlink(name_.c_str());
+    int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        spdlog::error("Failed to create shared memory {}: {}", name_, std::strerror(errno));
+        return;
+    }
+    length_ = PS_SHM_HEADER_SIZE + capacity_;
+    void* base = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(length_)) == 0) {
+        base = ::mmap(nullptr, length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        spdlog::error("Failed to map {} bytes of shared memory {}: {}", length_, name_, std::strerror(error));
+        ::shm_unlink(name_.c_str());
+        return;
+    }
+
+    header_ = static_cast<ps_shm_header*>(base);
+    ring_ = static_cast<unsigned char*>(base) + PS_SHM_HEADER_SIZE;
+    header_->version = PS_SHM_VERSION;
+    header_->capacity = capacity_;
+    __atomic_store_n(&header_->magic, PS_SHM_MAGIC, __ATOMIC_RELEASE);
+    spdlog::info("Publishing pages to shared memory {} ({} KiB ring)", name_, capacity_ >> 10);
+}
+
+ShmSink::~ShmSink() {
+    if (header_) {
+        finish();
+        ::munmap(header_, length_);
+    }
+}
+
+uint64_t ShmSink::reserve(uint64_t size) {
+    auto backoff = std::chrono::microseconds(20);
+    uint64_t pos = __atomic_load_n(&header_->write_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t contiguous = capacity_ - (pos & (capacity_ - 1));
+        uint64_t pad = size > contiguous ? contiguous : 0;
+        uint64_t read = __atomic_load_n(&header_->read_pos, __ATOMIC_ACQUIRE);
+        if (pos + pad + size - read > capacity_) {
+            // Ring full: the consumer is behind, so wait for it
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::microseconds(2000));
+            pos = __atomic_load_n(&header_->write_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!__atomic_compare_exchange_n(&header_->write_pos, &pos, pos + pad + size, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        if (pad > 0) {
+            auto* filler = reinterpret_cast<ps_shm_record*>(ring_ + (pos & (capacity_ - 1)));
+            filler->type = PS_SHM_PAD;
+            __atomic_store_n(&filler->size, static_cast<uint32_t>(pad), __ATOMIC_RELEASE);
+        }
+        return pos + pad;
+    }
+}
+
+bool ShmSink::write(const std::string& name, EncodedPage page) {
+    if (!header_) {
+        return false;
+    }
+    uint64_t size = ps_shm_record_size(static_cast<uint32_t>(name.size()), page.data.size());
+    // A record that wraps is preceded by padding to the end of the ring; past
+    // half the ring the two together may not fit even when it is empty
+    if (size > capacity_ / 2) {
+        spdlog::error("Page {} needs {} bytes, more than half the {} byte shared-memory ring; "
+                      "raise --shm-size", name, size, capacity_);
+        return false;
+    }
+
+    uint64_t pos = reserve(size);
+    auto* record = reinterpret_cast<ps_shm_record*>(ring_ + (pos & (capacity_ - 1)));
+    record->type = PS_SHM_PAGE;
+    record->page_number = static_cast<uint32_t>(page.page_number);
+    record->width = page.width;
+    record->height = page.height;
+    record->channels = page.channels;
+    record->name_size = static_cast<uint32_t>(name.size());
+    record->payload_size = page.data.size();
+    std::memset(record->encoder, 0, sizeof(record->encoder));
+    std::memcpy(record->encoder, page.encoder.data(),
+                std::min(page.encoder.size(), sizeof(record->encoder) - 1));
+    std::memcpy(record + 1, name.data(), name.size());
+    std::memcpy(reinterpret_cast<unsigned char*>(record + 1) + name.size(), page.data.data(),
+                page.data.size());
+    __atomic_store_n(&record->size, static_cast<uint32_t>(size), __ATOMIC_RELEASE);
+    return true;
+}
+
+bool ShmSink::finish() {
+    if (!header_) {
+        return false;
+    }
+    __atomic_store_n(&header_->closed, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+} // namespace popplershot
+
+#endif // _WIN32
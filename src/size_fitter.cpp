@@ -0,0 +1,114 @@
+#include "size_fitter.h"
+#include "image_resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+namespace popplershot {
+
+namespace {
+
+// Encoded size scales roughly with pixel count; aim a little low so the
+// next attempt usually lands under budget
+constexpr double kScaleMargin = 0.92;
+constexpr int kMaxScaleSteps = 8;
+
+struct Search {
+    const SizeFitter::Options& options;
+    const SizeFitter::EncodeFn& encode;
+    std::vector<unsigned char>& out;
+    SizeFitter::Result& result;
+    std::vector<unsigned char> attempt;
+
+    // Keeps the attempt if it fits or is the smallest so far
+    bool run(const Raster& raster, int quality, double scale, bool& fits) {
+        attempt.clear();
+        result.attempts++;
+        if (!encode(raster, quality, attempt)) {
+            return false;
+        }
+        fits = attempt.size() <= options.max_bytes;
+        if (fits || out.empty() || attempt.size() < out.size()) {
+            out.swap(attempt);
+            result.quality = options.lossy ? quality : 0;
+            result.scale = scale;
+        }
+        return true;
+    }
+
+    // Highest quality that fits at this scale; false from found if none does
+    bool search_quality(const Raster& raster, double scale, bool reuse_first, bool& found) {
+        found = false;
+        bool fits = false;
+        if (reuse_first) {
+            result.attempts++;
+            result.quality = options.lossy ? options.max_quality : 0;
+            fits = out.size() <= options.max_bytes;
+        } else if (!run(raster, options.max_quality, scale, fits)) {
+            return false;
+        }
+        if (fits || !options.lossy) {
+            found = fits;
+            return true;
+        }
+        if (!run(raster, options.min_quality, scale, fits)) return false;
+        if (!fits) return true;
+
+        // min_quality fits and max_quality does not
+        found = true;
+        std::vector<unsigned char> best;
+        int best_quality = options.min_quality;
+        best.swap(out);
+        int low = options.min_quality + 1;
+        int high = options.max_quality - 1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            if (!run(raster, mid, scale, fits)) return false;
+            if (fits) {
+                best.swap(out);
+                best_quality = mid;
+                low = mid + 1;
+            } else {
+                high = mid - 1;
+            }
+        }
+        out.swap(best);
+        result.quality = best_quality;
+        result.scale = scale;
+        return true;
+    }
+};
+
+} // namespace
+
+bool SizeFitter::fit(const Raster& raster, const Options& options, const EncodeFn& encode,
+                     std::vector<unsigned char>& out, Result& result) {
+    result = {false, 0, 0, 1.0};
+    bool reuse_first = !out.empty();
+    Search search{options, encode, out, result, {}};
+
+    bool found = false;
+    if (!search.search_quality(raster, 1.0, reuse_first, found)) return false;
+
+    std::vector<uint8_t> storage;
+    double scale = 1.0;
+    for (int step = 0; !found && step < kMaxScaleSteps && scale > options.min_scale; ++step) {
+        double ratio = static_cast<double>(options.max_bytes) / static_cast<double>(out.size());
+        double next = result.scale * std::sqrt(ratio) * kScaleMargin;
+        // Always make progress, but never throw away more than half at once
+        scale = std::clamp(next, scale * 0.5, scale * 0.9);
+        scale = std::max(scale, options.min_scale);
+
+        int width = std::max(1, static_cast<int>(std::lround(raster.width * scale)));
+        int height = std::max(1, static_cast<int>(std::lround(raster.height * scale)));
+        Raster scaled = ImageResampler::downscale(raster, width, height, storage);
+        spdlog::debug("Size fit: {} bytes over {} budget, retrying at {}x{}",
+                      out.size(), options.max_bytes, width, height);
+        if (!search.search_quality(scaled, scale, false, found)) return false;
+    }
+
+    result.fits = found;
+    return true;
+}
+
+} // namespace popplershot
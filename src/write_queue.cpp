@@ -0,0 +1,673 @@
+#include "write_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <fstream>
+#include <process.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef POPPLERSHOT_HAVE_IO_URING
+#include <liburing.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace popplershot {
+
+namespace {
+
+struct Job {
+    EncodedPage page;
+    WriteQueue::Completion done;
+};
+
+class ThreadPoolWriteQueue : public WriteQueue {
+public:
+    explicit ThreadPoolWriteQueue(const Options& options) : WriteQueue(options), stopping_(false) {
+        int threads = std::max(1, options_.threads);
+        for (int i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPoolWriteQueue() override {
+        drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void submit(EncodedPage page, Completion done) override {
+        reserve(page.data.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back({std::move(page), std::move(done)});
+        }
+        cv_.notify_one();
+    }
+
+    const char* name() const override { return "threads"; }
+
+private:
+    void run() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            bool ok = write_file(job.page.path, job.page.data,
+                                 options_.durability == Durability::File, options_.atomic);
+            size_t bytes = job.page.data.size();
+            if (job.done) {
+                job.done(ok);
+            }
+            release(bytes);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::vector<std::thread> workers_;
+    bool stopping_;
+};
+
+#ifdef POPPLERSHOT_HAVE_IO_URING
+
+// One ring owned by a dedicated I/O thread. Each page becomes a linked chain
+// openat(direct) -> fallocate -> write -> [fsync] -> close(direct) on a
+// registered file slot, so no descriptor ever comes back to userspace.
+// Atomic writes target a temporary name that the I/O thread renames into
+// place once the whole chain has succeeded.
+// Submitters hand pages over through a mutex-protected deque and an eventfd
+// the ring polls, so the I/O thread sleeps in the kernel when idle.
+class UringWriteQueue : public WriteQueue {
+public:
+    explicit UringWriteQueue(const Options& options)
+        : WriteQueue(options), event_fd_(-1), ready_(false), stopping_(false), in_flight_(0) {}
+
+    ~UringWriteQueue() override {
+        if (!ready_) {
+            return;
+        }
+        drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake();
+        thread_.join();
+        io_uring_queue_exit(&ring_);
+        ::close(event_fd_);
+    }
+
+    // False if the kernel cannot run the chain; the caller then falls back
+    bool init() {
+        unsigned depth = std::max(1u, options_.queue_depth);
+        if (io_uring_queue_init(depth * kMaxOpsPerPage + 1, &ring_, 0) < 0) {
+            return false;
+        }
+        if (io_uring_register_files_sparse(&ring_, depth) < 0 || !probe_direct_open()) {
+            io_uring_queue_exit(&ring_);
+            return false;
+        }
+        event_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd_ < 0) {
+            io_uring_queue_exit(&ring_);
+            return false;
+        }
+        for (unsigned slot = depth; slot > 0; --slot) {
+            free_slots_.push_back(slot - 1);
+        }
+        ready_ = true;
+        thread_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    void submit(EncodedPage page, Completion done) override {
+        reserve(page.data.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            incoming_.push_back({std::move(page), std::move(done)});
+        }
+        wake();
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+private:
+    static constexpr unsigned kMaxOpsPerPage = 5;
+
+    enum Op : uintptr_t { Open, Fallocate, Write, Fsync, Close };
+
+    struct Request {
+        Job job;
+        unsigned slot;
+        int remaining;
+        bool failed;
+        std::string temp; // Written instead of the page path when atomic
+    };
+
+    // Distinguishes the eventfd poll from page operations
+    static constexpr uintptr_t kWakeTag = 1;
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(event_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Kernels before 5.15 accept the opcodes but not direct descriptors
+    bool probe_direct_open() {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_openat_direct(sqe, AT_FDCWD, "/dev/null", O_WRONLY, 0, 0);
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_close_direct(sqe, 0);
+        if (io_uring_submit_and_wait(&ring_, 2) < 0) {
+            return false;
+        }
+        bool ok = true;
+        for (int i = 0; i < 2; ++i) {
+            io_uring_cqe* cqe;
+            if (io_uring_wait_cqe(&ring_, &cqe) < 0) {
+                return false;
+            }
+            ok = ok && cqe->res >= 0;
+            io_uring_cqe_seen(&ring_, cqe);
+        }
+        return ok;
+    }
+
+    void arm_wake_poll() {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_poll_add(sqe, event_fd_, POLLIN);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(kWakeTag));
+    }
+
+    void prepare(Request* request) {
+        const EncodedPage& page = request->job.page;
+        auto tag = [request](Op op) {
+            return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(request) | op);
+        };
+
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        if (options_.atomic) {
+            io_uring_prep_openat_direct(sqe, AT_FDCWD, request->temp.c_str(),
+                                        O_WRONLY | O_CREAT | O_EXCL, 0644, request->slot);
+        } else {
+            io_uring_prep_openat_direct(sqe, AT_FDCWD, page.path.c_str(),
+                                        O_WRONLY | O_CREAT | O_TRUNC, 0644, request->slot);
+        }
+        io_uring_sqe_set_data(sqe, tag(Open));
+        // A failed open cancels the rest of the chain
+        sqe->flags |= IOSQE_IO_LINK;
+
+        // Later links are hard so the close still runs when they fail;
+        // fallocate failing (unsupported filesystem) is not an error at all
+        sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_fallocate(sqe, request->slot, 0, 0, page.data.size());
+        io_uring_sqe_set_data(sqe, tag(Fallocate));
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+        sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_write(sqe, request->slot, page.data.data(),
+                            static_cast<unsigned>(page.data.size()), 0);
+        io_uring_sqe_set_data(sqe, tag(Write));
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        request->remaining = 4;
+
+        if (options_.durability == Durability::File) {
+            sqe = io_uring_get_sqe(&ring_);
+            io_uring_prep_fsync(sqe, request->slot, 0);
+            io_uring_sqe_set_data(sqe, tag(Fsync));
+            sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            request->remaining++;
+        }
+
+        sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_close_direct(sqe, request->slot);
+        io_uring_sqe_set_data(sqe, tag(Close));
+    }
+
+    void complete(io_uring_cqe* cqe) {
+        auto data = reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe));
+        auto* request = reinterpret_cast<Request*>(data & ~uintptr_t{7});
+        auto op = static_cast<Op>(data & 7);
+
+        bool op_failed = op != Fallocate && cqe->res < 0;
+        if (op == Write && cqe->res >= 0 &&
+            static_cast<size_t>(cqe->res) != request->job.page.data.size()) {
+            op_failed = true; // Regular files only write short on ENOSPC-like conditions
+        }
+        if (op_failed && !request->failed) {
+            request->failed = true;
+            spdlog::error("io_uring write of {} failed: {}", request->job.page.path,
+                          cqe->res < 0 ? std::strerror(-cqe->res) : "short write");
+        }
+
+        if (--request->remaining > 0) {
+            return;
+        }
+        if (!request->temp.empty()) {
+            if (!request->failed && ::rename(request->temp.c_str(), request->job.page.path.c_str()) != 0) {
+                spdlog::error("Failed to rename {} into place: {}", request->job.page.path,
+                              std::strerror(errno));
+                request->failed = true;
+            }
+            if (request->failed) {
+                ::unlink(request->temp.c_str());
+            }
+        }
+        free_slots_.push_back(request->slot);
+        in_flight_--;
+        size_t bytes = request->job.page.data.size();
+        if (request->job.done) {
+            request->job.done(!request->failed);
+        }
+        delete request;
+        release(bytes);
+    }
+
+    void run() {
+        arm_wake_poll();
+        while (true) {
+            std::deque<Job> batch;
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                size_t take = std::min(incoming_.size(), free_slots_.size());
+                for (size_t i = 0; i < take; ++i) {
+                    batch.push_back(std::move(incoming_.front()));
+                    incoming_.pop_front();
+                }
+                stopping = stopping_ && incoming_.empty();
+            }
+
+            for (auto& job : batch) {
+                auto* request = new Request{std::move(job), free_slots_.back(), 0, false, {}};
+                free_slots_.pop_back();
+                if (options_.atomic) {
+                    request->temp = temp_path(request->job.page.path);
+                }
+                prepare(request);
+                in_flight_++;
+            }
+
+            if (stopping && in_flight_ == 0) {
+                return;
+            }
+
+            // Sleep until any page operation completes or a submitter wakes us
+            int submitted = io_uring_submit_and_wait(&ring_, 1);
+            if (submitted < 0 && submitted != -EINTR) {
+                spdlog::error("io_uring submit failed: {}", std::strerror(-submitted));
+            }
+
+            io_uring_cqe* cqe;
+            unsigned head;
+            unsigned seen = 0;
+            bool rearm = false;
+            io_uring_for_each_cqe(&ring_, head, cqe) {
+                seen++;
+                if (reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)) == kWakeTag) {
+                    uint64_t value;
+                    ssize_t ignored = ::read(event_fd_, &value, sizeof(value));
+                    (void)ignored;
+                    rearm = true;
+                } else {
+                    complete(cqe);
+                }
+            }
+            io_uring_cq_advance(&ring_, seen);
+            if (rearm) {
+                arm_wake_poll();
+            }
+        }
+    }
+
+    io_uring ring_;
+    int event_fd_;
+    bool ready_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::deque<Job> incoming_;
+    bool stopping_;
+
+    // Only touched by the I/O thread
+    std::vector<unsigned> free_slots_;
+    size_t in_flight_;
+};
+
+#endif // POPPLERSHOT_HAVE_IO_URING
+
+} // namespace
+
+WriteQueue::WriteQueue(const Options& options)
+    : options_(options), pending_bytes_(0), pending_pages_(0) {}
+
+void WriteQueue::reserve(size_t bytes) {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    // Always admit one page so a page larger than the limit cannot deadlock
+    pending_cv_.wait(lock, [this, bytes] {
+        return pending_pages_ == 0 || pending_bytes_ + bytes <= options_.max_pending_bytes;
+    });
+    pending_bytes_ += bytes;
+    pending_pages_++;
+}
+
+void WriteQueue::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_bytes_ -= bytes;
+        pending_pages_--;
+    }
+    pending_cv_.notify_all();
+}
+
+void WriteQueue::drain() {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    pending_cv_.wait(lock, [this] { return pending_pages_ == 0; });
+}
+
+std::unique_ptr<WriteQueue> WriteQueue::create(const Options& options) {
+    if (options.backend == Backend::Sync) {
+        return nullptr;
+    }
+#ifdef POPPLERSHOT_HAVE_IO_URING
+    if (options.backend == Backend::IoUring || options.backend == Backend::Auto) {
+        auto queue = std::make_unique<UringWriteQueue>(options);
+        if (queue->init()) {
+            return queue;
+        }
+        spdlog::log(options.backend == Backend::IoUring ? spdlog::level::warn : spdlog::level::debug,
+                    "io_uring unavailable, writing through the thread pool instead");
+    }
+#else
+    if (options.backend == Backend::IoUring) {
+        spdlog::warn("Built without io_uring support, writing through the thread pool instead");
+    }
+#endif
+    return std::make_unique<ThreadPoolWriteQueue>(options);
+}
+
+bool WriteQueue::parse_backend(const std::string& name, Backend& backend) {
+    if (name == "sync") backend = Backend::Sync;
+    else if (name == "threads") backend = Backend::ThreadPool;
+    else if (name == "io_uring" || name == "io-uring") backend = Backend::IoUring;
+    else if (name == "auto") backend = Backend::Auto;
+    else return false;
+    return true;
+}
+
+bool WriteQueue::parse_durability(const std::string& name, Durability& durability) {
+    if (name == "none") durability = Durability::None;
+    else if (name == "file") durability = Durability::File;
+    else if (name == "batch") durability = Durability::Batch;
+    else if (name == "document") durability = Durability::Document;
+    else return false;
+    return true;
+}
+
+std::string WriteQueue::temp_path(const std::string& path) {
+    static std::atomic<uint64_t> counter{0};
+    std::filesystem::path target(path);
+#ifdef _WIN32
+    unsigned long pid = ::_getpid();
+#else
+    long pid = static_cast<long>(::getpid());
+#endif
+    return (target.parent_path() /
+            fmt::format(".{}.tmp-{}-{}", target.filename().string(), pid, counter++)).string();
+}
+
+bool WriteQueue::io_uring_supported() {
+#ifdef POPPLERSHOT_HAVE_IO_URING
+    Options options;
+    options.queue_depth = 1;
+    UringWriteQueue probe(options);
+    return probe.init();
+#else
+    return false;
+#endif
+}
+
+#ifdef _WIN32
+
+bool WriteQueue::write_file(const std::string& path, const std::vector<unsigned char>& data,
+                            bool fsync, bool atomic) {
+    (void)fsync; // Closing the stream is as durable as this fallback gets
+    std::string target = atomic ? temp_path(path) : path;
+    {
+        std::ofstream file(target, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            spdlog::error("Failed to open output file: {}", target);
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        file.close();
+        if (!file) {
+            std::filesystem::remove(target);
+            return false;
+        }
+    }
+    if (atomic) {
+        std::error_code ec;
+        std::filesystem::rename(target, path, ec);
+        if (ec) {
+            spdlog::error("Failed to rename {} into place: {}", path, ec.message());
+            std::filesystem::remove(target, ec);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteQueue::sync_filesystem(const std::string&) {
+    // No whole-volume flush without administrator rights; rely on --fsync
+    return true;
+}
+
+#else
+
+namespace {
+
+// Gives an O_TMPFILE descriptor the name path. linkat() never replaces, so
+// an existing output is overwritten by linking to a temporary name and
+// renaming that over it.
+bool link_tmpfile(int fd, const std::string& path) {
+    std::string proc = fmt::format("/proc/self/fd/{}", fd);
+    if (::linkat(AT_FDCWD, proc.c_str(), AT_FDCWD, path.c_str(), AT_SYMLINK_FOLLOW) == 0) {
+        return true;
+    }
+    if (errno != EEXIST) {
+        spdlog::error("Failed to link {}: {}", path, std::strerror(errno));
+        return false;
+    }
+    std::string temp = WriteQueue::temp_path(path);
+    if (::linkat(AT_FDCWD, proc.c_str(), AT_FDCWD, temp.c_str(), AT_SYMLINK_FOLLOW) != 0) {
+        spdlog::error("Failed to link {}: {}", temp, std::strerror(errno));
+        return false;
+    }
+    if (::rename(temp.c_str(), path.c_str()) != 0) {
+        spdlog::error("Failed to rename {} into place: {}", path, std::strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool WriteQueue::write_file(const std::string& path, const std::vector<unsigned char>& data,
+                            bool fsync, bool atomic) {
+    // Atomic writes prefer an unnamed file, so nothing is left behind on a
+    // crash; filesystems without O_TMPFILE get a hidden temporary name
+    int fd = -1;
+    bool unnamed = false;
+    std::string temp;
+    if (atomic) {
+#ifdef O_TMPFILE
+        std::string dir = std::filesystem::path(path).parent_path().string();
+        fd = ::open(dir.empty() ? "." : dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+        unnamed = fd >= 0;
+#endif
+        if (!unnamed) {
+            temp = temp_path(path);
+            fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        }
+    } else {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        spdlog::error("Failed to open output file {}: {}", path, std::strerror(errno));
+        return false;
+    }
+    auto abandon = [&] {
+        ::close(fd);
+        if (!temp.empty()) {
+            ::unlink(temp.c_str());
+        }
+        return false;
+    };
+
+    // Reserve the whole extent up front so the filesystem can allocate it
+    // contiguously; not every filesystem supports this, which is fine
+    if (!data.empty()) {
+        ::posix_fallocate(fd, 0, static_cast<off_t>(data.size()));
+    }
+
+    // One write call; the loop only handles short writes and signals
+    const unsigned char* cursor = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, cursor, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            spdlog::error("Failed to write {}: {}", path, std::strerror(errno));
+            return abandon();
+        }
+        cursor += written;
+        remaining -= static_cast<size_t>(written);
+    }
+
+    if (fsync && ::fsync(fd) != 0) {
+        spdlog::error("Failed to sync {}: {}", path, std::strerror(errno));
+        return abandon();
+    }
+    if (unnamed && !link_tmpfile(fd, path)) {
+        return abandon();
+    }
+    if (::close(fd) != 0) {
+        spdlog::error("Failed to close {}: {}", path, std::strerror(errno));
+        if (!temp.empty()) {
+            ::unlink(temp.c_str());
+        }
+        return false;
+    }
+    if (!temp.empty() && ::rename(temp.c_str(), path.c_str()) != 0) {
+        spdlog::error("Failed to rename {} into place: {}", path, std::strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool WriteQueue::sync_filesystem(const std::string& dir) {
+#ifdef __linux__
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        spdlog::error("Failed to open {} for syncing: {}", dir, std::strerror(errno));
+        return false;
+    }
+    bool ok = ::syncfs(fd) == 0;
+    if (!ok) {
+        spdlog::error("Failed to sync filesystem of {}: {}", dir, std::strerror(errno));
+    }
+    ::close(fd);
+    return ok;
+#else
+    (void)dir;
+    ::sync();
+    return true;
+#endif
+}
+
+#endif
+
+void WriteQueue::benchmark(const std::string& dir, int count, size_t file_size, bool fsync,
+                           std::ostream& out) {
+    std::vector<unsigned char> payload(file_size);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<unsigned char>(i * 2654435761u >> 24);
+    }
+
+    std::vector<Backend> backends = {Backend::Sync, Backend::ThreadPool};
+    if (io_uring_supported()) {
+        backends.push_back(Backend::IoUring);
+    }
+
+    out << fmt::format("Writing {} files of {} bytes{}\n", count, file_size, fsync ? " with fsync" : "");
+    for (Backend backend : backends) {
+        Options options;
+        options.backend = backend;
+        options.durability = fsync ? Durability::File : Durability::None;
+        auto queue = create(options);
+        const char* name = queue ? queue->name() : "sync";
+
+        std::filesystem::path target = std::filesystem::path(dir) / fmt::format("popplershot-bench-{}", name);
+        std::filesystem::create_directories(target);
+
+        std::atomic<int> failures{0};
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i) {
+            EncodedPage page;
+            page.path = (target / fmt::format("{:06d}.bin", i)).string();
+            page.data = payload;
+            if (queue) {
+                queue->submit(std::move(page), [&failures](bool ok) { failures += ok ? 0 : 1; });
+            } else if (!write_file(page.path, page.data, fsync, options.atomic)) {
+                failures++;
+            }
+        }
+        if (queue) {
+            queue->drain();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        out << fmt::format("  {:<9} {:>10.0f} files/s {:>9.1f} MB/s{}\n", name, count / seconds,
+                           count * static_cast<double>(file_size) / seconds / 1e6,
+                           failures ? fmt::format(" ({} failed)", failures.load()) : "");
+        std::error_code ec;
+        std::filesystem::remove_all(target, ec);
+    }
+}
+
+} // namespace popplershot
@@ -0,0 +1,28 @@
+# Sourced by the test scripts
+#   make_pdf FILE PAGES [POINTS]
+# Writes a PDF of PAGES blank POINTS x POINTS pages (default 200) with an
+# exact xref table, so poppler loads it without repairs.
+make_pdf() {
+  local file="$1" pages="$2" points="${3:-200}" out=$'%PDF-1.4\n' kids="" entry i
+  local -a objects offsets
+  for ((i = 0; i < pages; i++)); do
+    kids+="$((i + 3)) 0 R "
+  done
+  objects=("<< /Type /Catalog /Pages 2 0 R >>" "<< /Type /Pages /Kids [ $kids] /Count $pages >>")
+  for ((i = 0; i < pages; i++)); do
+    objects+=("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 $points $points] >>")
+  done
+  for ((i = 0; i < ${#objects[@]}; i++)); do
+    offsets+=("${#out}")
+    out+="$((i + 1)) 0 obj"$'\n'"${objects[i]}"$'\n'"endobj"$'\n'
+  done
+  local xref="${#out}"
+  out+="xref"$'\n'"0 $((${#objects[@]} + 1))"$'\n'"0000000000 65535 f "$'\n'
+  for i in "${offsets[@]}"; do
+    printf -v entry '%010d 00000 n \n' "$i"
+    out+="$entry"
+  done
+  out+="trailer"$'\n'"<< /Size $((${#objects[@]} + 1)) /Root 1 0 R >>"$'\n'
+  out+="startxref"$'\n'"$xref"$'\n'"%%EOF"$'\n'
+  printf '%s' "$out" > "$file"
+}
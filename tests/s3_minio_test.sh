@@ -0,0 +1,114 @@
+#!/usr/bin/env bash
+# ==========================================================
+# --sink s3 integration test against a local MinIO server
+#   s3_minio_test.sh POPPLERSHOT [MINIO]
+# Starts MinIO on a scratch directory, converts a small tree of
+# generated PDFs with --sink s3, then lists and fetches the uploaded
+# objects. A page larger than --s3-part-size checks that multipart uploads
+# arrive byte for byte. Exits 77 (skipped) when minio or a SigV4-capable curl
+# (7.75+) is not available.
+# ==========================================================
+set -euo pipefail
+export LC_ALL=C
+
+POPPLERSHOT="${1:?usage: s3_minio_test.sh POPPLERSHOT [MINIO]}"
+MINIO="${2:-${MINIO:-minio}}"
+source "$(dirname -- "${BASH_SOURCE[0]}")/make_pdf.sh"
+PORT="${MINIO_PORT:-19000}"
+ENDPOINT="http://127.0.0.1:$PORT"
+BUCKET="popplershot-test"
+export AWS_ACCESS_KEY_ID="popplershot"
+export AWS_SECRET_ACCESS_KEY="popplershot-secret"
+
+if ! command -v "$MINIO" >/dev/null 2>&1; then
+  echo "SKIP: minio not found (pass its path or set MINIO)"
+  exit 77
+fi
+if ! curl --help all 2>/dev/null | grep -q -- --aws-sigv4; then
+  echo "SKIP: curl lacks --aws-sigv4"
+  exit 77
+fi
+
+WORK="$(mktemp -d)"
+MINIO_PID=""
+cleanup() {
+  if [[ -n "$MINIO_PID" ]]; then
+    kill "$MINIO_PID" 2>/dev/null || true
+    wait "$MINIO_PID" 2>/dev/null || true
+  fi
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL: $*"
+  exit 1
+}
+
+# Signed request to the MinIO endpoint
+s3() {
+  curl -sS --fail --aws-sigv4 "aws:amz:us-east-1:s3" --user "$AWS_ACCESS_KEY_ID:$AWS_SECRET_ACCESS_KEY" "$@"
+}
+
+# ---- start MinIO ----
+mkdir -p "$WORK/data" "$WORK/in/sub" "$WORK/out"
+MINIO_ROOT_USER="$AWS_ACCESS_KEY_ID" MINIO_ROOT_PASSWORD="$AWS_SECRET_ACCESS_KEY" \
+  "$MINIO" server "$WORK/data" --address "127.0.0.1:$PORT" \
+  --console-address "127.0.0.1:$((PORT + 1))" --quiet > "$WORK/minio.log" 2>&1 &
+MINIO_PID=$!
+for ((i = 0; i < 100; i++)); do
+  if curl -sf "$ENDPOINT/minio/health/live" >/dev/null 2>&1; then
+    break
+  fi
+  kill -0 "$MINIO_PID" 2>/dev/null || { cat "$WORK/minio.log"; fail "minio exited"; }
+  sleep 0.2
+done
+curl -sf "$ENDPOINT/minio/health/live" >/dev/null || fail "minio did not come up on port $PORT"
+s3 -X PUT "$ENDPOINT/$BUCKET" >/dev/null || fail "could not create bucket $BUCKET"
+
+# ---- convert ----
+make_pdf "$WORK/in/one.pdf" 1
+make_pdf "$WORK/in/sub/three.pdf" 3
+"$POPPLERSHOT" -q -d 72 -j 2 --sink s3 --s3-url "$ENDPOINT/$BUCKET/run-1" --upload-threads 4 \
+  "$WORK/in" "$WORK/out" || fail "popplershot exited with $?"
+
+# ---- check the uploaded objects ----
+expected="run-1/one_page_001.png
+run-1/sub/three_page_001.png
+run-1/sub/three_page_002.png
+run-1/sub/three_page_003.png"
+listing="$(s3 "$ENDPOINT/$BUCKET?list-type=2&prefix=run-1/")" || fail "could not list $BUCKET"
+keys="$(grep -o '<Key>[^<]*</Key>' <<< "$listing" | sed -e 's/<Key>//' -e 's/<\/Key>//' | sort)"
+[[ "$keys" == "$expected" ]] || fail "unexpected objects:"$'\n'"$keys"
+
+while read -r key; do
+  s3 -o "$WORK/page.png" "$ENDPOINT/$BUCKET/$key" || fail "could not fetch $key"
+  signature="$(head -c 8 "$WORK/page.png" | od -An -tx1 | tr -d ' \n')"
+  [[ "$signature" == "89504e470d0a1a0a" ]] || fail "$key is not a PNG"
+done <<< "$keys"
+[[ -z "$(find "$WORK/out" -type f)" ]] || fail "pages were also written to the output directory"
+
+# ---- a page over --s3-part-size goes up in parts ----
+# A blank page at 600 dpi stored without deflate is an 8 MB PNG: two 5 MiB parts
+mkdir -p "$WORK/big" "$WORK/big-out"
+make_pdf "$WORK/big/big.pdf" 1
+big_options=(-q -d 600 --compression 0)
+"$POPPLERSHOT" "${big_options[@]}" "$WORK/big" "$WORK/big-out" || fail "popplershot exited with $? writing to disk"
+big_size="$(wc -c < "$WORK/big-out/big_page_001.png")"
+((big_size > 5 * 1024 * 1024)) || fail "the large page is only $big_size bytes, too small for a multipart upload"
+"$POPPLERSHOT" "${big_options[@]}" --sink s3 --s3-url "$ENDPOINT/$BUCKET/run-2" --s3-part-size 5M \
+  "$WORK/big" "$WORK/out" || fail "popplershot exited with $? uploading the large page"
+s3 -o "$WORK/big.png" -D "$WORK/big.headers" "$ENDPOINT/$BUCKET/run-2/big_page_001.png" ||
+  fail "could not fetch the large page"
+cmp -s "$WORK/big-out/big_page_001.png" "$WORK/big.png" || fail "the uploaded large page differs from the one on disk"
+# Multipart objects have an ETag of "<md5 of the part md5s>-<parts>"
+grep -qi '^etag: *"[0-9a-f]*-2"' "$WORK/big.headers" || fail "the large page was not uploaded in two parts:"$'\n'"$(cat "$WORK/big.headers")"
+[[ -z "$(find "$WORK/out" -type f)" ]] || fail "the large page was also written to the output directory"
+
+# ---- a missing bucket must fail the run ----
+if "$POPPLERSHOT" -q -d 72 --sink s3 --s3-url "$ENDPOINT/no-such-bucket/run-1" \
+  "$WORK/in" "$WORK/out" > "$WORK/missing.log" 2>&1; then
+  fail "upload to a missing bucket exited 0"
+fi
+
+echo "PASS: $(wc -l <<< "$keys") pages and a $big_size byte multipart page uploaded to $BUCKET"
@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+# ==========================================================
+# --sink shm end to end with the demo consumer
+#   shm_consumer_test.sh POPPLERSHOT CONSUMER
+# Converts generated PDFs to raw grayscale pages through a 128 KiB ring,
+# small enough that the 40 KB pages wrap it several times, and checks the
+# pages and byte totals the consumer prints. The second run slows the
+# consumer down so the producer has to wait for space.
+# ==========================================================
+set -euo pipefail
+export LC_ALL=C
+
+POPPLERSHOT="${1:?usage: shm_consumer_test.sh POPPLERSHOT CONSUMER}"
+CONSUMER="${2:?usage: shm_consumer_test.sh POPPLERSHOT CONSUMER}"
+source "$(dirname -- "${BASH_SOURCE[0]}")/make_pdf.sh"
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  exit 1
+}
+
+mkdir -p "$WORK/in/sub" "$WORK/out"
+make_pdf "$WORK/in/one.pdf" 1
+make_pdf "$WORK/in/sub/three.pdf" 3
+make_pdf "$WORK/in/sub/four.pdf" 4
+expected_names="one_page_001.raw
+sub/four_page_001.raw
+sub/four_page_002.raw
+sub/four_page_003.raw
+sub/four_page_004.raw
+sub/three_page_001.raw
+sub/three_page_002.raw
+sub/three_page_003.raw"
+
+# run_ring NAME DELAY_MS: one producer and consumer pair over a fresh ring
+run_ring() {
+  local name="/popplershot-test-$$-$1" delay="$2" log="$WORK/consumer-$1.log"
+  local consumer_pid pages bytes sum names
+  "$CONSUMER" --name "$name" --delay-ms "$delay" --unlink > "$log" &
+  consumer_pid=$!
+  "$POPPLERSHOT" -q -d 72 -j 2 --gray -f raw --sink shm --shm-name "$name" --shm-size 128K \
+    "$WORK/in" "$WORK/out" || fail "popplershot exited with $? (delay $delay ms)"
+  wait "$consumer_pid" || fail "consumer exited with $? (delay $delay ms)"
+
+  # "<name> page <n> <w>x<h> raw <bytes> bytes" per page, then the totals
+  names="$(grep ' page ' "$log" | cut -d' ' -f1 | sort)"
+  [[ "$names" == "$expected_names" ]] || fail "unexpected pages (delay $delay ms):"$'\n'"$names"
+  sum=0
+  while read -r _ _ _ size _ bytes _; do
+    local width="${size%x*}" height="${size#*x}"
+    ((bytes == width * height)) || fail "page of ${size} has $bytes bytes, not one per pixel"
+    sum=$((sum + bytes))
+  done < <(grep ' page ' "$log")
+  read -r pages _ bytes _ < <(tail -n 1 "$log")
+  [[ "$pages" == 8 ]] || fail "consumer counted $pages pages, expected 8 (delay $delay ms)"
+  [[ "$bytes" == "$sum" ]] || fail "consumer counted $bytes bytes, the pages add up to $sum"
+  ((sum > 2 * 128 * 1024)) || fail "$sum bytes of pages are too few to wrap the ring"
+  echo "delay ${delay} ms: $pages pages, $bytes bytes"
+}
+
+run_ring fast 0
+run_ring slow 50
+[[ -z "$(find "$WORK/out" -type f)" ]] || fail "pages were also written to the output directory"
+echo "PASS"
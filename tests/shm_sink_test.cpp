@@ -0,0 +1,162 @@
+// ShmSink against the consumer side of popplershot_shm.h: records that wrap
+// at the end of the ring arrive intact, and records too large for the ring
+// are rejected instead of waiting forever for space.
+
+#include "shm_sink.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+using popplershot::EncodedPage;
+using popplershot::OutputSink;
+using popplershot::ShmSink;
+
+namespace {
+
+constexpr uint64_t kCapacity = 64 << 10;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+unsigned char pattern(int page, size_t i) {
+    return static_cast<unsigned char>(page * 31 + i);
+}
+
+EncodedPage make_page(int page_number, size_t bytes) {
+    EncodedPage page;
+    page.page_number = page_number;
+    page.encoder = "raw";
+    page.data.resize(bytes);
+    for (size_t i = 0; i < bytes; ++i) {
+        page.data[i] = pattern(page_number, i);
+    }
+    return page;
+}
+
+std::string page_name(int page_number) {
+    return "doc/page_" + std::to_string(page_number) + ".raw";
+}
+
+uint64_t record_size(int page_number, size_t bytes) {
+    return ps_shm_record_size(static_cast<uint32_t>(page_name(page_number).size()), bytes);
+}
+
+} // namespace
+
+int main() {
+    // A broken ring hangs the producer; fail the test instead
+    std::thread([] {
+        std::this_thread::sleep_for(std::chrono::seconds(30));
+        std::fprintf(stderr, "FAIL: timed out, a write is waiting for ring space forever\n");
+        std::_Exit(1);
+    }).detach();
+
+    OutputSink::Options options;
+    options.kind = OutputSink::Kind::Shm;
+    options.shm_name = "/popplershot-test-" + std::to_string(::getpid());
+    options.shm_size = kCapacity;
+    ShmSink sink(options);
+    if (!sink.is_open()) {
+        std::fprintf(stderr, "FAIL: could not create %s\n", options.shm_name.c_str());
+        return 1;
+    }
+
+    std::atomic<int> received{0};
+    std::atomic<int> corrupt{0};
+    std::thread consumer([&] {
+        ps_shm_consumer ring = {};
+        if (ps_shm_open(&ring, options.shm_name.c_str()) != 0) {
+            corrupt++;
+            return;
+        }
+        for (;;) {
+            int done = 0;
+            const ps_shm_record* record = ps_shm_peek(&ring, &done);
+            if (!record) {
+                if (done) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            int page_number = static_cast<int>(record->page_number);
+            std::string name(ps_shm_record_name(record), record->name_size);
+            const unsigned char* payload = ps_shm_record_payload(record);
+            bool intact = name == page_name(page_number);
+            for (uint64_t i = 0; intact && i < record->payload_size; ++i) {
+                intact = payload[i] == pattern(page_number, i);
+            }
+            if (!intact) {
+                corrupt++;
+            }
+            received++;
+            ps_shm_release(&ring, record);
+            // Slow enough that the producer has to wait for space
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ps_shm_close(&ring);
+    });
+
+    // Fill up to just short of the end of the ring, so the next large record
+    // starts near the end and has to wrap behind a pad record
+    int page_number = 0;
+    uint64_t written = 0;
+    size_t large = kCapacity / 2 - 4096;
+    int sent = 0;
+    while (kCapacity - written % kCapacity >= record_size(page_number, large) ||
+           written < kCapacity) {
+        check(sink.write(page_name(page_number), make_page(page_number, 3000)), "small page");
+        written += record_size(page_number, 3000);
+        ++page_number;
+        ++sent;
+    }
+    check(sink.write(page_name(page_number), make_page(page_number, large)), "wrapping page");
+    ++page_number;
+    ++sent;
+
+    // A small record moves the write offset past the middle, so the largest
+    // record allowed needs nearly all of the ring with its padding
+    check(sink.write(page_name(page_number), make_page(page_number, 10 << 10)), "10 KiB page");
+    ++page_number;
+    ++sent;
+    size_t half = kCapacity / 2 - sizeof(ps_shm_record) - page_name(page_number).size();
+    half -= half % PS_SHM_ALIGN;
+    check(record_size(page_number, half) == kCapacity / 2, "half-ring page size");
+    check(sink.write(page_name(page_number), make_page(page_number, half)), "half-ring page");
+    ++page_number;
+    ++sent;
+
+    // Over half the ring is rejected, not left waiting for space that never
+    // comes; 60 KiB after a 10 KiB page hung the producer before
+    check(sink.write(page_name(page_number), make_page(page_number, 10 << 10)), "10 KiB page");
+    ++page_number;
+    ++sent;
+    check(!sink.write(page_name(page_number), make_page(page_number, 60 << 10)),
+          "page over half the ring is rejected");
+    check(!sink.write(page_name(page_number), make_page(page_number, kCapacity)),
+          "page over the whole ring is rejected");
+
+    sink.finish();
+    consumer.join();
+    check(received == sent, "consumer received " + std::to_string(received.load()) + " of " +
+                                std::to_string(sent) + " pages");
+    check(corrupt == 0, std::to_string(corrupt.load()) + " corrupt pages");
+    ::shm_unlink(options.shm_name.c_str());
+
+    if (failures == 0) {
+        std::printf("PASS: %d pages through a %llu byte ring\n", sent,
+                    static_cast<unsigned long long>(kCapacity));
+    }
+    return failures == 0 ? 0 : 1;
+}